@@ -0,0 +1,103 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Allocation traces replayed by the benchmarks. A trace file has one event per line: "a <id> <size> <alignment> <memoryType>"
+// allocates and "f <id>" frees the allocation made with that id, ids are only reused once freed
+struct AllocationEvent
+{
+	enum Type : uint8_t
+	{
+		ALLOCATE,
+		FREE
+	};
+
+	Type type = ALLOCATE;
+	uint64_t id = 0;
+	uint64_t size = 0;
+	uint64_t alignment = 1;
+	uint32_t memoryType = 0;
+};
+
+struct SyntheticTraceSettings
+{
+	uint32_t eventCount = 200000;
+	uint32_t seed = 1;
+	// Sizes are log-uniform between the two, so small allocations dominate like they do in a real scene
+	uint64_t minSize = 256;
+	uint64_t maxSize = 4LL * 1024 * 1024;
+	// Frees pick a random live allocation, once this many are live every other event is a free
+	uint32_t maxLiveAllocations = 4096;
+	uint32_t memoryTypeCount = 1;
+};
+
+inline std::vector<AllocationEvent> generateSyntheticTrace(const SyntheticTraceSettings& settings)
+{
+	constexpr uint64_t alignments[] = {16, 64, 256, 4096, 65536};
+
+	std::mt19937_64 random(settings.seed);
+	std::uniform_real_distribution<double> logSize(std::log2(static_cast<double>(settings.minSize)), std::log2(static_cast<double>(settings.maxSize)));
+	std::uniform_int_distribution<size_t> alignmentIndex(0, std::size(alignments) - 1);
+	std::uniform_int_distribution<uint32_t> memoryType(0, settings.memoryTypeCount - 1);
+	std::bernoulli_distribution shouldFree(0.45);
+
+	std::vector<AllocationEvent> trace;
+	trace.reserve(settings.eventCount);
+	std::vector<uint64_t> liveIDs;
+	uint64_t nextID = 0;
+	while (trace.size() < settings.eventCount)
+	{
+		const bool isFull = liveIDs.size() >= settings.maxLiveAllocations;
+		if (!liveIDs.empty() && (isFull || shouldFree(random)))
+		{
+			const size_t index = std::uniform_int_distribution<size_t>(0, liveIDs.size() - 1)(random);
+			trace.push_back({AllocationEvent::FREE, liveIDs[index]});
+			liveIDs[index] = liveIDs.back();
+			liveIDs.pop_back();
+			continue;
+		}
+
+		const uint64_t size = static_cast<uint64_t>(std::exp2(logSize(random)));
+		trace.push_back({AllocationEvent::ALLOCATE, nextID, size, alignments[alignmentIndex(random)], memoryType(random)});
+		liveIDs.push_back(nextID++);
+	}
+	return trace;
+}
+
+inline std::vector<AllocationEvent> loadTrace(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open allocation trace " + filename);
+
+	std::vector<AllocationEvent> trace;
+	std::string type;
+	while (file >> type)
+	{
+		AllocationEvent event{};
+		if (type == "a")
+		{
+			event.type = AllocationEvent::ALLOCATE;
+			file >> event.id >> event.size >> event.alignment >> event.memoryType;
+		}
+		else if (type == "f")
+		{
+			event.type = AllocationEvent::FREE;
+			file >> event.id;
+		}
+		else
+		{
+			throw std::runtime_error("Unknown event \"" + type + "\" in allocation trace " + filename);
+		}
+
+		if (file.fail())
+			throw std::runtime_error("Malformed event in allocation trace " + filename);
+		trace.push_back(event);
+	}
+	return trace;
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <ranges>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_trace.hpp"
+#include "logger.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_memory_backend.hpp"
+
+// Replays an allocation trace through the whole allocator (thread cache, chunk policy, memory type selection) on top of a
+// fake backend, so it runs without a GPU. Traces are synthetic or captured from the application with --capture-allocations.
+// Usage: allocator_replay [trace file] [--events N] [--seed N] [--types N] [--samples N] [--strategy best_fit|tlsf]
+
+struct LiveAllocation
+{
+	MemoryChunk::MemoryBlock block;
+	VkDeviceSize alignment;
+};
+
+struct Sample
+{
+	size_t event;
+	VulkanMemoryAllocator::MemoryUsage usage;
+	VkDeviceSize reservedByBackend;
+	VkDeviceSize alignmentWaste;
+};
+
+// Free gaps in front of a live block that are smaller than its alignment, space that is only lost to aligning the block
+static VkDeviceSize measureAlignmentWaste(const std::unordered_map<uint64_t, LiveAllocation>& liveAllocations)
+{
+	std::map<uint32_t, std::vector<const LiveAllocation*>> chunks;
+	for (const LiveAllocation& allocation : liveAllocations | std::views::values)
+		chunks[allocation.block.chunk].push_back(&allocation);
+
+	VkDeviceSize waste = 0;
+	for (std::vector<const LiveAllocation*>& blocks : chunks | std::views::values)
+	{
+		std::ranges::sort(blocks, {}, [](const LiveAllocation* allocation) { return allocation->block.offset; });
+		VkDeviceSize previousEnd = 0;
+		for (const LiveAllocation* allocation : blocks)
+		{
+			const VkDeviceSize gap = allocation->block.offset - std::min(previousEnd, allocation->block.offset);
+			if (gap > 0 && gap < allocation->alignment)
+				waste += gap;
+			previousEnd = allocation->block.offset + allocation->block.size;
+		}
+	}
+	return waste;
+}
+
+static double toMegabytes(const VkDeviceSize bytes)
+{
+	return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string traceFile;
+	SyntheticTraceSettings settings{};
+	uint32_t sampleCount = 20;
+	MemoryChunk::AllocationStrategy strategy = MemoryChunk::BEST_FIT;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--events" && i + 1 < argc)
+			settings.eventCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (argument == "--seed" && i + 1 < argc)
+			settings.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (argument == "--types" && i + 1 < argc)
+			settings.memoryTypeCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (argument == "--samples" && i + 1 < argc)
+			sampleCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (argument == "--strategy" && i + 1 < argc)
+			strategy = std::string(argv[++i]) == "tlsf" ? MemoryChunk::TLSF : MemoryChunk::BEST_FIT;
+		else
+			traceFile = argument;
+	}
+
+	try
+	{
+		Logger::setEnabled(false);
+
+		const std::vector<AllocationEvent> trace = traceFile.empty() ? generateSyntheticTrace(settings) : loadTrace(traceFile);
+
+		// Captured traces keep the memory type indices of the device they were captured on, the fake device has as many types
+		uint32_t typeCount = 1;
+		for (const AllocationEvent& event : trace)
+		{
+			if (event.type == AllocationEvent::ALLOCATE)
+				typeCount = std::max(typeCount, event.memoryType + 1);
+		}
+		if (typeCount > VK_MAX_MEMORY_TYPES)
+			throw std::runtime_error("Allocation trace uses memory type " + std::to_string(typeCount - 1) + ", devices have at most " + std::to_string(VK_MAX_MEMORY_TYPES));
+
+		auto backend = std::make_unique<FakeMemoryBackend>(FakeMemoryBackend::makeMemoryProperties(typeCount, 64LL * 1024 * 1024 * 1024));
+		const FakeMemoryBackend& fakeBackend = *backend;
+		VulkanMemoryAllocator allocator(std::move(backend));
+		for (uint32_t type = 0; type < typeCount; type++)
+			allocator.setAllocationStrategy(type, strategy);
+
+		std::cout << "Replaying " << trace.size() << " events from " << (traceFile.empty() ? "a synthetic trace" : traceFile)
+			<< " over " << typeCount << " memory types with " << (strategy == MemoryChunk::TLSF ? "TLSF" : "best fit") << " chunks\n\n";
+
+		std::unordered_map<uint64_t, LiveAllocation> liveAllocations;
+		std::vector<Sample> samples;
+		uint64_t failedAllocations = 0;
+		VkDeviceSize peakUsedSize = 0;
+		VkDeviceSize usedSize = 0;
+		std::chrono::steady_clock::duration replayTime{};
+
+		const size_t sampleInterval = std::max<size_t>(1, trace.size() / sampleCount);
+		for (size_t first = 0; first < trace.size(); first += sampleInterval)
+		{
+			const size_t last = std::min(trace.size(), first + sampleInterval);
+
+			// Only the allocator calls are timed, sampling walks every chunk and would dominate otherwise
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = first; i < last; i++)
+			{
+				const AllocationEvent& event = trace[i];
+				if (event.type == AllocationEvent::FREE)
+				{
+					const auto it = liveAllocations.find(event.id);
+					if (it == liveAllocations.end())
+						continue;
+
+					usedSize -= it->second.block.size;
+					allocator.deallocate(it->second.block);
+					liveAllocations.erase(it);
+					continue;
+				}
+
+				try
+				{
+					const MemoryChunk::MemoryBlock block = allocator.allocate(event.size, event.alignment, event.memoryType);
+					liveAllocations[event.id] = {block, event.alignment};
+					usedSize += block.size;
+					peakUsedSize = std::max(peakUsedSize, usedSize);
+				}
+				catch (const std::runtime_error&)
+				{
+					failedAllocations++;
+				}
+			}
+			replayTime += std::chrono::steady_clock::now() - start;
+
+			samples.push_back({last, allocator.getStatistics().total, fakeBackend.getStatistics().reservedSize, measureAlignmentWaste(liveAllocations)});
+		}
+
+		std::cout << std::setw(10) << "events" << std::setw(15) << "reserved MB" << std::setw(12) << "used MB" << std::setw(10) << "chunks"
+			<< std::setw(12) << "free ranges" << std::setw(15) << "fragmentation" << std::setw(20) << "alignment waste KB" << '\n';
+		for (const Sample& sample : samples)
+		{
+			std::cout << std::fixed << std::setw(10) << sample.event
+				<< std::setw(15) << std::setprecision(2) << toMegabytes(sample.reservedByBackend)
+				<< std::setw(12) << std::setprecision(2) << toMegabytes(sample.usage.usedSize)
+				<< std::setw(10) << sample.usage.chunkCount
+				<< std::setw(12) << sample.usage.freeRangeCount
+				<< std::setw(15) << std::setprecision(3) << sample.usage.fragmentation
+				<< std::setw(20) << std::setprecision(1) << static_cast<double>(sample.alignmentWaste) / 1024.0 << '\n';
+		}
+
+		const double seconds = std::chrono::duration<double>(replayTime).count();
+		const FakeMemoryBackend::Statistics backendStatistics = fakeBackend.getStatistics();
+		VkDeviceSize peakAlignmentWaste = 0;
+		for (const Sample& sample : samples)
+			peakAlignmentWaste = std::max(peakAlignmentWaste, sample.alignmentWaste);
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "\nThroughput:           " << static_cast<double>(trace.size()) / seconds / 1e6 << " Mevents/s (" << seconds * 1000.0 << " ms)\n"
+			<< "Peak reserved:        " << toMegabytes(backendStatistics.peakReservedSize) << " MB for a peak of " << toMegabytes(peakUsedSize) << " MB live\n"
+			<< "Peak alignment waste: " << static_cast<double>(peakAlignmentWaste) / 1024.0 << " KB\n"
+			<< "Driver allocations:   " << backendStatistics.allocations << ", frees " << backendStatistics.frees << '\n'
+			<< "Failed allocations:   " << failedAllocations << '\n';
+
+		for (const LiveAllocation& allocation : liveAllocations | std::views::values)
+			allocator.deallocate(allocation.block);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_trace.hpp"
+#include "logger.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_memory_backend.hpp"
+
+// Every thread replays its own synthetic trace into one shared allocator on a fake backend, for 1, 2, 4... threads, to see
+// how allocation throughput scales with the thread count. Usage: allocator_stress [--events N] [--max-threads N] [--types N]
+
+struct RunResult
+{
+	double seconds = 0.0;
+	uint64_t failedAllocations = 0;
+};
+
+static RunResult runThreads(const std::vector<std::vector<AllocationEvent>>& traces, const uint32_t threadCount, const uint32_t typeCount)
+{
+	VulkanMemoryAllocator allocator(std::make_unique<FakeMemoryBackend>(FakeMemoryBackend::makeMemoryProperties(typeCount, 256LL * 1024 * 1024 * 1024)));
+
+	std::atomic<uint64_t> failedAllocations = 0;
+	std::latch ready(threadCount + 1);
+	std::latch done(threadCount);
+	std::vector<std::thread> threads;
+	for (uint32_t thread = 0; thread < threadCount; thread++)
+	{
+		threads.emplace_back([&, thread]
+		{
+			const std::vector<AllocationEvent>& trace = traces[thread];
+			std::unordered_map<uint64_t, MemoryChunk::MemoryBlock> liveBlocks;
+			liveBlocks.reserve(trace.size());
+
+			ready.arrive_and_wait();
+			for (const AllocationEvent& event : trace)
+			{
+				if (event.type == AllocationEvent::FREE)
+				{
+					const auto it = liveBlocks.find(event.id);
+					if (it == liveBlocks.end())
+						continue;
+
+					allocator.deallocate(it->second);
+					liveBlocks.erase(it);
+					continue;
+				}
+
+				try
+				{
+					liveBlocks[event.id] = allocator.allocate(event.size, event.alignment, event.memoryType);
+				}
+				catch (const std::runtime_error&)
+				{
+					++failedAllocations;
+				}
+			}
+			done.count_down();
+
+			for (const MemoryChunk::MemoryBlock& block : liveBlocks | std::views::values)
+				allocator.deallocate(block);
+		});
+	}
+
+	ready.arrive_and_wait();
+	const auto start = std::chrono::steady_clock::now();
+	done.wait();
+	const auto end = std::chrono::steady_clock::now();
+
+	for (std::thread& thread : threads)
+		thread.join();
+	return {std::chrono::duration<double>(end - start).count(), failedAllocations};
+}
+
+int main(int argc, char* argv[])
+{
+	SyntheticTraceSettings settings{};
+	settings.eventCount = 100000;
+	// Mostly blocks small enough for the thread caches, with a tail that has to go through the chunks
+	settings.minSize = 64;
+	settings.maxSize = 1024 * 1024;
+	settings.maxLiveAllocations = 1024;
+	settings.memoryTypeCount = 4;
+	uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--events" && i + 1 < argc)
+			settings.eventCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (argument == "--max-threads" && i + 1 < argc)
+			maxThreads = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (argument == "--types" && i + 1 < argc)
+			settings.memoryTypeCount = std::max(1u, std::min(static_cast<uint32_t>(VK_MAX_MEMORY_TYPES), static_cast<uint32_t>(std::stoul(argv[++i]))));
+	}
+
+	try
+	{
+		Logger::setEnabled(false);
+
+		// Generated up front so that every run replays the same work and only the allocator is timed
+		std::vector<std::vector<AllocationEvent>> traces;
+		for (uint32_t thread = 0; thread < maxThreads; thread++)
+		{
+			SyntheticTraceSettings threadSettings = settings;
+			threadSettings.seed = settings.seed + thread;
+			traces.push_back(generateSyntheticTrace(threadSettings));
+		}
+
+		std::cout << settings.eventCount << " events per thread over " << settings.memoryTypeCount << " memory types\n\n"
+			<< std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(14) << "Mevents/s" << std::setw(10) << "scaling" << std::setw(10) << "failed" << '\n';
+
+		double singleThreadRate = 0.0;
+		for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount = threadCount < maxThreads ? std::min(threadCount * 2, maxThreads) : threadCount + 1)
+		{
+			const RunResult result = runThreads(traces, threadCount, settings.memoryTypeCount);
+			const double rate = static_cast<double>(settings.eventCount) * threadCount / result.seconds;
+			if (threadCount == 1)
+				singleThreadRate = rate;
+
+			std::cout << std::fixed << std::setw(8) << threadCount
+				<< std::setw(12) << std::setprecision(2) << result.seconds * 1000.0
+				<< std::setw(14) << std::setprecision(2) << rate / 1e6
+				<< std::setw(9) << std::setprecision(2) << rate / singleThreadRate << 'x'
+				<< std::setw(10) << result.failedAllocations << '\n';
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <ranges>
+#include <string>
+#include <unordered_map>
+
+#include "allocation_trace.hpp"
+#include "logger.hpp"
+#include "vulkan_memory.hpp"
+
+// Replays an allocation trace into a single BEST_FIT chunk, once with the linear scan chunk the size index replaced and
+// once with MemoryChunk. Usage: chunk_benchmark [trace file] [--events N] [--seed N] [--runs N]
+
+// The best fit chunk as it was before its free ranges were indexed by size: every allocation scans all free ranges and
+// every free walks all of them to merge neighbours
+class LegacyChunk
+{
+public:
+	explicit LegacyChunk(const VkDeviceSize size)
+		: m_size(size), m_unallocatedSize(size)
+	{
+		m_unallocatedData[0] = size;
+	}
+
+	MemoryChunk::MemoryBlock allocate(const VkDeviceSize newSize, const VkDeviceSize alignment)
+	{
+		VkDeviceSize best = m_size;
+		VkDeviceSize bestAlignOffset = 0;
+		if (newSize > getBiggestChunkSize())
+			return {0, 0};
+
+		for (const auto& [offset, size] : m_unallocatedData)
+		{
+			if (size < newSize) continue;
+
+			const VkDeviceSize alignedOffset = offset > 0 ? offset + (alignment - (offset % alignment)) : 0;
+			const VkDeviceSize offsetDifference = alignedOffset - offset;
+
+			if (size < newSize + offsetDifference) continue;
+
+			if (best == m_size || m_unallocatedData.at(best) > size)
+			{
+				best = offset;
+				bestAlignOffset = offsetDifference;
+			}
+		}
+
+		if (best == m_size)
+			return {0, 0};
+
+		const VkDeviceSize bestSize = m_unallocatedData.at(best);
+		const VkDeviceSize rangeOffset = best;
+		m_unallocatedData.erase(best);
+		if (bestAlignOffset != 0)
+		{
+			m_unallocatedData[best] = bestAlignOffset;
+			best += bestAlignOffset;
+		}
+		if (bestSize - bestAlignOffset != newSize)
+		{
+			m_unallocatedData[best + newSize] = (bestSize - bestAlignOffset) - newSize;
+		}
+
+		Logger::print("Allocated block of size " + std::to_string(newSize) + " at offset " + std::to_string(best));
+
+		if (m_biggestChunk == rangeOffset || !m_unallocatedData.contains(m_biggestChunk))
+		{
+			for (const auto& [offset, size] : m_unallocatedData)
+			{
+				if (!m_unallocatedData.contains(m_biggestChunk) || size > m_unallocatedData.at(m_biggestChunk))
+					m_biggestChunk = offset;
+			}
+		}
+
+		m_unallocatedSize -= newSize;
+		return {newSize, best};
+	}
+
+	void deallocate(const MemoryChunk::MemoryBlock& block)
+	{
+		m_unallocatedData[block.offset] = block.size;
+		Logger::print("Deallocated block of size " + std::to_string(block.size) + " at offset " + std::to_string(block.offset));
+
+		m_unallocatedSize += block.size;
+		if (!m_unallocatedData.contains(m_biggestChunk) || block.size > m_unallocatedData.at(m_biggestChunk))
+			m_biggestChunk = block.offset;
+
+		defragment();
+	}
+
+	[[nodiscard]] VkDeviceSize getBiggestChunkSize() const
+	{
+		const auto it = m_unallocatedData.find(m_biggestChunk);
+		return it == m_unallocatedData.end() ? 0 : it->second;
+	}
+
+	[[nodiscard]] uint32_t getFreeRangeCount() const
+	{
+		return static_cast<uint32_t>(m_unallocatedData.size());
+	}
+
+private:
+	void defragment()
+	{
+		if (m_unallocatedSize == m_size)
+			return;
+
+		for (auto it = m_unallocatedData.begin(); it != m_unallocatedData.end();)
+		{
+			const auto next = std::next(it);
+			if (next == m_unallocatedData.end())
+				break;
+
+			if (it->first + it->second == next->first)
+			{
+				it->second += next->second;
+				if (next->first == m_biggestChunk || it->second > m_unallocatedData.at(m_biggestChunk))
+					m_biggestChunk = it->first;
+				m_unallocatedData.erase(next);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	VkDeviceSize m_size;
+	VkDeviceSize m_unallocatedSize;
+	VkDeviceSize m_biggestChunk = 0;
+	std::map<VkDeviceSize, VkDeviceSize> m_unallocatedData;
+};
+
+class ChunkBenchmark
+{
+public:
+	struct Result
+	{
+		double seconds = 0.0;
+		uint64_t failedAllocations = 0;
+		uint32_t peakFreeRanges = 0;
+	};
+
+	static MemoryChunk createChunk(const VkDeviceSize size)
+	{
+		return {size, 0, VK_NULL_HANDLE, MemoryChunk::BEST_FIT};
+	}
+
+	template<typename Chunk>
+	static Result replay(Chunk& chunk, const std::vector<AllocationEvent>& trace)
+	{
+		Result result{};
+		std::unordered_map<uint64_t, MemoryChunk::MemoryBlock> liveBlocks;
+		liveBlocks.reserve(trace.size());
+
+		const auto start = std::chrono::steady_clock::now();
+		for (const AllocationEvent& event : trace)
+		{
+			if (event.type == AllocationEvent::FREE)
+			{
+				const auto it = liveBlocks.find(event.id);
+				if (it == liveBlocks.end())
+					continue;
+
+				chunk.deallocate(it->second);
+				liveBlocks.erase(it);
+				continue;
+			}
+
+			const MemoryChunk::MemoryBlock block = chunk.allocate(event.size, event.alignment);
+			if (block.size == 0)
+			{
+				result.failedAllocations++;
+				continue;
+			}
+			liveBlocks[event.id] = block;
+			result.peakFreeRanges = std::max(result.peakFreeRanges, chunk.getFreeRangeCount());
+		}
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (const MemoryChunk::MemoryBlock& block : liveBlocks | std::views::values)
+			chunk.deallocate(block);
+		return result;
+	}
+};
+
+static void printResult(const std::string& name, const ChunkBenchmark::Result& result, const size_t eventCount)
+{
+	std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+		<< std::setw(10) << std::setprecision(2) << result.seconds * 1000.0 << " ms"
+		<< std::setw(12) << std::setprecision(2) << static_cast<double>(eventCount) / result.seconds / 1e6 << " Mevents/s"
+		<< std::setw(10) << result.failedAllocations << " failed"
+		<< std::setw(10) << result.peakFreeRanges << " peak free ranges\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::string traceFile;
+	SyntheticTraceSettings settings{};
+	uint32_t runs = 3;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--events" && i + 1 < argc)
+			settings.eventCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (argument == "--seed" && i + 1 < argc)
+			settings.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (argument == "--runs" && i + 1 < argc)
+			runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else
+			traceFile = argument;
+	}
+
+	try
+	{
+		Logger::setEnabled(false);
+
+		const std::vector<AllocationEvent> trace = traceFile.empty() ? generateSyntheticTrace(settings) : loadTrace(traceFile);
+		// Big enough that failures only come from fragmentation, the chunk is never backed by memory
+		constexpr VkDeviceSize chunkSize = 16LL * 1024 * 1024 * 1024;
+
+		std::cout << "Replaying " << trace.size() << " events from " << (traceFile.empty() ? "a synthetic trace" : traceFile) << ", best of " << runs << " runs\n";
+
+		// Both chunks are built fresh for every run so each one starts from a single free range
+		ChunkBenchmark::Result legacyResult{1e30};
+		ChunkBenchmark::Result indexedResult{1e30};
+		for (uint32_t run = 0; run < runs; run++)
+		{
+			LegacyChunk legacyChunk(chunkSize);
+			const ChunkBenchmark::Result legacy = ChunkBenchmark::replay(legacyChunk, trace);
+			if (legacy.seconds < legacyResult.seconds)
+				legacyResult = legacy;
+
+			MemoryChunk chunk = ChunkBenchmark::createChunk(chunkSize);
+			const ChunkBenchmark::Result indexed = ChunkBenchmark::replay(chunk, trace);
+			if (indexed.seconds < indexedResult.seconds)
+				indexedResult = indexed;
+		}
+
+		printResult("linear scan", legacyResult, trace.size());
+		printResult("size index", indexedResult, trace.size());
+		std::cout << "Speedup: " << std::setprecision(2) << legacyResult.seconds / indexedResult.seconds << "x\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "command_stream.hpp"
+#include "logger.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_command_buffer.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_device.hpp"
+#include "vulkan_gpu.hpp"
+#include "vulkan_pipeline.hpp"
+#include "vulkan_queues.hpp"
+#include "vulkan_render_pass.hpp"
+
+// Records the draws of the application's frame into a command buffer on the null driver, so only the CPU cost of the
+// wrappers is measured. "context lookup" records the same commands but resolves the device through VulkanContext before
+// every command that looks up a handle, like the wrappers did before they kept a pointer to their device.
+// Usage: record_benchmark [--draws N] [--runs N] [--devices N]
+
+struct Scene
+{
+	Handle<VulkanRenderPass> renderPass;
+	Handle<VulkanFramebuffer> framebuffer;
+	std::array<Handle<VulkanPipeline>, 2> pipelines;
+	Handle<VulkanPipelineLayout> layout;
+	Handle<VulkanBuffer> vertexBuffer;
+	Handle<VulkanBuffer> indexBuffer;
+	VkExtent2D extent;
+	uint32_t indexCount;
+	std::vector<std::array<float, 16>> matrices;
+	std::vector<std::array<float, 3>> colors;
+};
+
+// Keeps the looked up devices alive so the searches cannot be dropped
+static uintptr_t g_lookupSink = 0;
+
+static void lookUpDevice(const uint32_t deviceID)
+{
+	g_lookupSink += reinterpret_cast<uintptr_t>(&VulkanContext::getDevice(deviceID));
+}
+
+// The per draw commands of buildSubpassDraws, with one context lookup for every command that used to do one when lookUp is set
+static void recordDraws(const VulkanCommandBuffer& commandBuffer, const Scene& scene, const uint32_t subpass, const uint32_t deviceID, const bool lookUp)
+{
+	const VkViewport viewport{0.0f, 0.0f, static_cast<float>(scene.extent.width), static_cast<float>(scene.extent.height), 0.0f, 1.0f};
+	const VkRect2D scissor{{0, 0}, scene.extent};
+	for (uint32_t draw = 0; draw < scene.matrices.size(); ++draw)
+	{
+		if (lookUp) lookUpDevice(deviceID);
+		commandBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipelines[subpass]);
+		if (lookUp) lookUpDevice(deviceID);
+		commandBuffer.cmdBindVertexBuffer(scene.vertexBuffer, 0);
+		if (lookUp) lookUpDevice(deviceID);
+		commandBuffer.cmdBindIndexBuffer(scene.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		commandBuffer.cmdSetViewport(viewport);
+		commandBuffer.cmdSetScissor(scissor);
+
+		if (lookUp) lookUpDevice(deviceID);
+		commandBuffer.cmdPushConstant(scene.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(scene.matrices[draw]), scene.matrices[draw].data());
+		if (subpass == 1)
+		{
+			if (lookUp) lookUpDevice(deviceID);
+			commandBuffer.cmdPushConstant(scene.layout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(scene.matrices[draw]), sizeof(scene.colors[draw]), scene.colors[draw].data());
+		}
+		commandBuffer.cmdDrawIndexed(scene.indexCount, 0, 0);
+	}
+}
+
+// The same draws encoded into a command stream and replayed, like the worker threads of the application do
+static void buildDraws(CommandStream& stream, const Scene& scene, const uint32_t subpass)
+{
+	const CommandStream::Viewport viewport{0.0f, 0.0f, static_cast<float>(scene.extent.width), static_cast<float>(scene.extent.height), 0.0f, 1.0f};
+	const CommandStream::Rect scissor{0, 0, scene.extent.width, scene.extent.height};
+
+	stream.clear();
+	for (uint32_t draw = 0; draw < scene.matrices.size(); ++draw)
+	{
+		stream.beginPacket(draw);
+		stream.cmdBindPipeline(CommandStream::BindPoint::GRAPHICS, scene.pipelines[subpass]);
+		stream.cmdBindVertexBuffer(scene.vertexBuffer, 0);
+		stream.cmdBindIndexBuffer(scene.indexBuffer, 0, CommandStream::IndexType::UINT32);
+		stream.cmdSetViewport(viewport);
+		stream.cmdSetScissor(scissor);
+		stream.cmdPushConstant(scene.layout, CommandStream::VERTEX_STAGE, 0, sizeof(scene.matrices[draw]), scene.matrices[draw].data());
+		if (subpass == 1)
+			stream.cmdPushConstant(scene.layout, CommandStream::FRAGMENT_STAGE, sizeof(scene.matrices[draw]), sizeof(scene.colors[draw]), scene.colors[draw].data());
+		stream.cmdDrawIndexed(scene.indexCount, 0, 0);
+	}
+}
+
+// Records both subpasses into one primary command buffer and returns how long it took
+static double recordFrame(VulkanCommandBuffer& commandBuffer, const Scene& scene, const bool trackState, const std::function<void(const VulkanCommandBuffer&, uint32_t)>& recordSubpass)
+{
+	std::vector<VkClearValue> clearValues{2};
+	clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	clearValues[1].depthStencil = {1.0f, 0};
+
+	const auto start = std::chrono::steady_clock::now();
+	commandBuffer.reset();
+	commandBuffer.setStateTracking(trackState);
+	commandBuffer.beginRecording(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	commandBuffer.cmdBeginRenderPass(scene.renderPass, scene.framebuffer, scene.extent, clearValues);
+		recordSubpass(commandBuffer, 0);
+		commandBuffer.cmdNextSubpass();
+		recordSubpass(commandBuffer, 1);
+	commandBuffer.cmdEndRenderPass();
+	commandBuffer.endRecording();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Scene createScene(VulkanDevice& device, const uint32_t drawCount)
+{
+	Scene scene{};
+	scene.extent = {1920, 1080};
+	scene.indexCount = 36;
+
+	VulkanRenderPassBuilder renderPassBuilder{};
+	renderPassBuilder.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, {}, 0);
+	renderPassBuilder.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, {}, 0);
+	scene.renderPass = device.createRenderPass(renderPassBuilder, 0);
+	scene.framebuffer = device.createFramebuffer({scene.extent.width, scene.extent.height, 1}, device.getRenderPass(scene.renderPass), {});
+
+	const std::vector<VkPushConstantRange> pushConstantRanges = {
+		{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(std::array<float, 16>)},
+		{VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(std::array<float, 16>), sizeof(std::array<float, 3>)}
+	};
+	scene.layout = device.createPipelineLayout({}, pushConstantRanges);
+
+	// The null driver accepts pipelines without shaders, the wrappers do the same work for them
+	const VulkanPipelineBuilder pipelineBuilder{&device};
+	for (uint32_t subpass = 0; subpass < scene.pipelines.size(); subpass++)
+		scene.pipelines[subpass] = device.createPipeline(pipelineBuilder, scene.layout, scene.renderPass, subpass);
+
+	scene.vertexBuffer = device.createBuffer(1024 * 1024, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	scene.indexBuffer = device.createBuffer(1024 * 1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	for (uint32_t draw = 0; draw < drawCount; draw++)
+	{
+		std::array<float, 16> matrix{};
+		for (uint32_t i = 0; i < 4; i++)
+			matrix[i * 5] = 1.0f;
+		matrix[12] = static_cast<float>(draw);
+		scene.matrices.push_back(matrix);
+		scene.colors.push_back({static_cast<float>(draw % 3) / 2.0f, 0.5f, 1.0f});
+	}
+	return scene;
+}
+
+static void printResult(const std::string& name, const double seconds, const uint32_t drawCount, const uint64_t commandCount)
+{
+	std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+		<< std::setw(10) << std::setprecision(3) << seconds * 1000.0 << " ms"
+		<< std::setw(10) << std::setprecision(1) << seconds * 1e9 / (2.0 * drawCount) << " ns/draw"
+		<< std::setw(10) << std::setprecision(2) << static_cast<double>(commandCount) / seconds / 1e6 << " Mcommands/s\n";
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t drawCount = 10000;
+	uint32_t runs = 10;
+	uint32_t deviceCount = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--draws" && i + 1 < argc)
+			drawCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (argument == "--runs" && i + 1 < argc)
+			runs = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		else if (argument == "--devices" && i + 1 < argc)
+			deviceCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+	}
+
+	try
+	{
+		Logger::setEnabled(false);
+
+		VulkanContext::init(VK_API_VERSION_1_0, false, {});
+		const VulkanGPU gpu = VulkanContext::getGPUs()[0];
+		const GPUQueueStructure queueStructure = gpu.getQueueFamilies();
+		const QueueFamily graphicsQueueFamily = queueStructure.findQueueFamily(VK_QUEUE_GRAPHICS_BIT);
+		QueueFamilySelector selector{queueStructure};
+		selector.selectQueueFamily(graphicsQueueFamily, QueueFamilyTypeBits::GRAPHICS);
+		selector.getOrAddQueue(graphicsQueueFamily, 1.0);
+
+		// The context searches its devices in creation order, the measured one is created last so --devices makes every lookup longer
+		uint32_t deviceID = 0;
+		for (uint32_t i = 0; i < deviceCount; i++)
+			deviceID = VulkanContext::createDevice(gpu, selector, {}, {});
+		VulkanDevice& device = VulkanContext::getDevice(deviceID);
+
+		const Scene scene = createScene(device, drawCount);
+		VulkanCommandBuffer& commandBuffer = device.getCommandBuffer(device.createCommandBuffer(graphicsQueueFamily, 0, false), 0);
+
+		// Per draw: pipeline, vertex buffer, index buffer, viewport, scissor, push constants and the draw, one more push constant
+		// in the color subpass, plus the render pass begin, next subpass and end
+		const uint64_t commandCount = 2ULL * drawCount * 7 + drawCount + 3;
+		std::cout << drawCount << " draws in 2 subpasses on the null driver with " << deviceCount << " device(s), best of " << runs << " runs\n\n";
+
+		CommandStream stream;
+		const std::vector<std::pair<std::string, std::function<void(const VulkanCommandBuffer&, uint32_t)>>> recorders = {
+			{"context lookup", [&](const VulkanCommandBuffer& buffer, const uint32_t subpass) { recordDraws(buffer, scene, subpass, deviceID, true); }},
+			{"direct", [&](const VulkanCommandBuffer& buffer, const uint32_t subpass) { recordDraws(buffer, scene, subpass, deviceID, false); }},
+			{"command stream + replay", [&](const VulkanCommandBuffer& buffer, const uint32_t subpass) { buildDraws(stream, scene, subpass); buffer.cmdReplay(stream); }}
+		};
+
+		for (const bool trackState : {false, true})
+		{
+			std::cout << "State tracking " << (trackState ? "on" : "off") << '\n';
+			// The recorders take turns within a run so that all of them see the same machine state
+			std::vector<double> bestSeconds(recorders.size(), 1e30);
+			for (uint32_t run = 0; run < runs; run++)
+			{
+				for (size_t recorder = 0; recorder < recorders.size(); recorder++)
+					bestSeconds[recorder] = std::min(bestSeconds[recorder], recordFrame(commandBuffer, scene, trackState, recorders[recorder].second));
+			}
+
+			for (size_t recorder = 0; recorder < recorders.size(); recorder++)
+				printResult(recorders[recorder].first, bestSeconds[recorder], drawCount, commandCount);
+			std::cout << "Saved by the device pointer: " << std::setprecision(1) << (bestSeconds[0] - bestSeconds[1]) * 1e9 / (2.0 * drawCount)
+				<< " ns/draw, " << std::setprecision(2) << bestSeconds[0] / bestSeconds[1] << "x\n\n";
+		}
+
+		VulkanContext::free();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
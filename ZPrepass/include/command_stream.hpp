@@ -0,0 +1,243 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "vulkan_handle.hpp"
+
+class VulkanBuffer;
+class VulkanPipeline;
+class VulkanPipelineLayout;
+
+// Commands encoded into a plain byte buffer instead of a VkCommandBuffer, so draw lists can be built on any thread without
+// a device and turned into driver calls later in one pass (VulkanCommandBuffer::cmdReplay). Commands are grouped in packets
+// carrying a sort key, packets are reordered as a whole by sort() and merge(), so each one has to bind everything its draws
+// rely on. The stream only knows objects by handle and has no Vulkan types, it builds and is tested without the SDK
+class CommandStream
+{
+public:
+	static constexpr uint32_t MAX_VERTEX_BUFFERS = 16;
+
+	enum class BindPoint : uint8_t
+	{
+		GRAPHICS,
+		COMPUTE
+	};
+
+	enum class IndexType : uint8_t
+	{
+		UINT16,
+		UINT32
+	};
+
+	// Same bits as VkShaderStageFlagBits
+	enum ShaderStage : uint32_t
+	{
+		VERTEX_STAGE = 0x1,
+		TESSELLATION_CONTROL_STAGE = 0x2,
+		TESSELLATION_EVALUATION_STAGE = 0x4,
+		GEOMETRY_STAGE = 0x8,
+		FRAGMENT_STAGE = 0x10,
+		COMPUTE_STAGE = 0x20
+	};
+	using ShaderStageFlags = uint32_t;
+
+	struct Viewport
+	{
+		float x;
+		float y;
+		float width;
+		float height;
+		float minDepth;
+		float maxDepth;
+	};
+
+	struct Rect
+	{
+		int32_t x;
+		int32_t y;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	enum class CommandType : uint8_t
+	{
+		BIND_PIPELINE,
+		BIND_VERTEX_BUFFERS,
+		BIND_INDEX_BUFFER,
+		SET_VIEWPORT,
+		SET_SCISSOR,
+		PUSH_CONSTANT,
+		DRAW,
+		DRAW_INDEXED
+	};
+
+	struct BindPipeline
+	{
+		BindPoint bindPoint;
+		Handle<VulkanPipeline> pipeline;
+	};
+
+	// Only the first count entries are stored in the stream
+	struct BindVertexBuffers
+	{
+		uint32_t count = 0;
+		std::array<Handle<VulkanBuffer>, MAX_VERTEX_BUFFERS> buffers{};
+		std::array<uint64_t, MAX_VERTEX_BUFFERS> offsets{};
+	};
+
+	struct BindIndexBuffer
+	{
+		Handle<VulkanBuffer> buffer;
+		uint64_t offset;
+		IndexType indexType;
+	};
+
+	struct SetViewport
+	{
+		Viewport viewport;
+	};
+
+	struct SetScissor
+	{
+		Rect scissor;
+	};
+
+	// Followed by size bytes of values in the stream
+	struct PushConstant
+	{
+		Handle<VulkanPipelineLayout> layout;
+		ShaderStageFlags stageFlags;
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct Draw
+	{
+		uint32_t vertexCount;
+		uint32_t firstVertex;
+	};
+
+	struct DrawIndexed
+	{
+		uint32_t indexCount;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t firstInstance;
+	};
+
+	// Commands recorded after this go into a new packet, packets with a lower key are replayed first
+	void beginPacket(uint64_t sortKey);
+
+	void cmdBindPipeline(BindPoint bindPoint, Handle<VulkanPipeline> pipeline);
+	void cmdBindVertexBuffer(Handle<VulkanBuffer> buffer, uint64_t offset);
+	void cmdBindVertexBuffers(const std::vector<Handle<VulkanBuffer>>& buffers, const std::vector<uint64_t>& offsets);
+	void cmdBindIndexBuffer(Handle<VulkanBuffer> buffer, uint64_t offset, IndexType indexType);
+	void cmdSetViewport(const Viewport& viewport);
+	void cmdSetScissor(Rect scissor);
+	void cmdPushConstant(Handle<VulkanPipelineLayout> layout, ShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues);
+	void cmdDraw(uint32_t vertexCount, uint32_t firstVertex);
+	void cmdDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset);
+	void cmdDrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+
+	// Stable, packets with the same key keep the order they were recorded or merged in
+	void sort();
+	// Appends the packets of another stream, e.g. the one a worker thread built for its share of the scene
+	void merge(const CommandStream& other);
+	// Keeps the memory, a stream rebuilt every frame stops allocating once it has reached its largest size
+	void clear();
+
+	// Calls visitor(command) for every command in packet order, push constants are visited as visitor(command, pValues)
+	template<typename Visitor>
+	void forEachCommand(Visitor&& visitor) const;
+
+	[[nodiscard]] bool isEmpty() const;
+	[[nodiscard]] uint32_t getPacketCount() const;
+	[[nodiscard]] uint32_t getCommandCount() const;
+	[[nodiscard]] size_t getByteSize() const;
+
+private:
+	struct Packet
+	{
+		uint64_t sortKey;
+		size_t begin;
+		size_t end;
+	};
+
+	void beginCommand(CommandType type);
+	void write(const void* data, size_t size);
+
+	template<typename T>
+	static T read(const std::byte*& cursor);
+
+	std::vector<std::byte> m_data;
+	std::vector<Packet> m_packets;
+	uint32_t m_commandCount = 0;
+	// Only the last packet begun is recorded into, and only until the packets are reordered
+	bool m_isPacketOpen = false;
+};
+
+template<typename T>
+T CommandStream::read(const std::byte*& cursor)
+{
+	// The stream is tightly packed, commands are copied out instead of being accessed in place
+	T value;
+	std::memcpy(&value, cursor, sizeof(T));
+	cursor += sizeof(T);
+	return value;
+}
+
+template<typename Visitor>
+void CommandStream::forEachCommand(Visitor&& visitor) const
+{
+	for (const Packet& packet : m_packets)
+	{
+		const std::byte* cursor = m_data.data() + packet.begin;
+		const std::byte* end = m_data.data() + packet.end;
+		while (cursor < end)
+		{
+			switch (read<CommandType>(cursor))
+			{
+			case CommandType::BIND_PIPELINE:
+				visitor(read<BindPipeline>(cursor));
+				break;
+			case CommandType::BIND_VERTEX_BUFFERS:
+			{
+				BindVertexBuffers command;
+				command.count = read<uint32_t>(cursor);
+				std::memcpy(command.buffers.data(), cursor, command.count * sizeof(Handle<VulkanBuffer>));
+				cursor += command.count * sizeof(Handle<VulkanBuffer>);
+				std::memcpy(command.offsets.data(), cursor, command.count * sizeof(uint64_t));
+				cursor += command.count * sizeof(uint64_t);
+				visitor(command);
+				break;
+			}
+			case CommandType::BIND_INDEX_BUFFER:
+				visitor(read<BindIndexBuffer>(cursor));
+				break;
+			case CommandType::SET_VIEWPORT:
+				visitor(read<SetViewport>(cursor));
+				break;
+			case CommandType::SET_SCISSOR:
+				visitor(read<SetScissor>(cursor));
+				break;
+			case CommandType::PUSH_CONSTANT:
+			{
+				const PushConstant command = read<PushConstant>(cursor);
+				visitor(command, static_cast<const void*>(cursor));
+				cursor += command.size;
+				break;
+			}
+			case CommandType::DRAW:
+				visitor(read<Draw>(cursor));
+				break;
+			case CommandType::DRAW_INDEXED:
+				visitor(read<DrawIndexed>(cursor));
+				break;
+			}
+		}
+	}
+}
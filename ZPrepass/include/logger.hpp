@@ -1,5 +1,7 @@
 #pragma once
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <sstream>
 
@@ -13,10 +15,17 @@ public:
 
 	static void print(std::string_view message);
 
+	// Benchmarks and tools turn printing off so the output does not end up in their measurements
+	static void setEnabled(bool enabled);
+	[[nodiscard]] static bool isEnabled();
+
 private:
 
-	inline static std::vector<std::string> m_contexts{};
+	// Every thread nests its own contexts, only the output itself is shared
+	inline static thread_local std::vector<std::string> m_contexts{};
 	inline static std::string m_rootContext = "ROOT";
+	inline static std::mutex m_outputMutex;
+	inline static std::atomic<bool> m_enabled = true;
 
 	Logger() = default;
 };
@@ -38,8 +47,21 @@ inline void Logger::popContext()
 	m_contexts.pop_back();
 }
 
+inline void Logger::setEnabled(const bool enabled)
+{
+	m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline bool Logger::isEnabled()
+{
+	return m_enabled.load(std::memory_order_relaxed);
+}
+
 inline void Logger::print(const std::string_view message)
 {
+	if (!m_enabled.load(std::memory_order_relaxed))
+		return;
+
 	std::stringstream context;
 	if (!m_contexts.empty())
 	{
@@ -54,5 +76,6 @@ inline void Logger::print(const std::string_view message)
 		context << "[" << m_rootContext << "]: ";
 	}
 
+	std::scoped_lock lock(m_outputMutex);
 	std::cout << context.str() << message << '\n';
 }
@@ -4,7 +4,10 @@
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+#include "vulkan_handle.hpp"
+
 class VulkanFence;
+class VulkanSemaphore;
 class VulkanDevice;
 class VulkanContext;
 class VulkanQueue;
@@ -37,7 +40,7 @@ public:
 	void createSurface();
 	void createSwapchain(uint32_t deviceID, VkSurfaceFormatKHR desiredFormat);
 
-	[[nodiscard]] uint32_t acquireNextImage(uint32_t semaphoreID, const VulkanFence* fence = nullptr) const;
+	[[nodiscard]] uint32_t acquireNextImage(Handle<VulkanSemaphore> semaphore, const VulkanFence* fence = nullptr) const;
 	[[nodiscard]] bool getAndResetSwapchainRebuildFlag();
 	[[nodiscard]] VkImageView getImageView(uint32_t index) const;
 	[[nodiscard]] uint32_t getImageCount() const;
@@ -46,7 +49,7 @@ public:
 	[[nodiscard]] VkSurfaceKHR getSurface() const;
 
 	void free();
-	void present(const VulkanQueue& queue, uint32_t imageIndex, uint32_t waitSemaphore = UINT32_MAX) const;
+	void present(const VulkanQueue& queue, uint32_t imageIndex, Handle<VulkanSemaphore> waitSemaphore = {}) const;
 
 private:
 	struct Swapchain
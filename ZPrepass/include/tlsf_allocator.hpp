@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+// Two-level segregated fit allocator over an abstract [0, size) range. It only hands out offsets, the owner decides
+// what the range represents (a VkDeviceMemory, a VkBuffer...). Allocation and deallocation are constant time
+class TLSFAllocator
+{
+public:
+	explicit TLSFAllocator(VkDeviceSize size = 0);
+
+	[[nodiscard]] std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment);
+	void deallocate(VkDeviceSize offset);
+
+	[[nodiscard]] VkDeviceSize getSize() const;
+	[[nodiscard]] VkDeviceSize getFreeSize() const;
+	[[nodiscard]] VkDeviceSize getLargestFreeSize() const;
+	[[nodiscard]] uint32_t getFreeRangeCount() const;
+	// Free ranges as (offset, size) pairs sorted by offset
+	[[nodiscard]] std::vector<std::pair<VkDeviceSize, VkDeviceSize>> getFreeRanges() const;
+
+private:
+	static constexpr uint32_t SL_INDEX_COUNT_LOG2 = 5;
+	static constexpr uint32_t SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+	static constexpr uint32_t FL_INDEX_COUNT = 64 - SL_INDEX_COUNT_LOG2 + 1;
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	struct Block
+	{
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t prevPhysical = NONE;
+		uint32_t nextPhysical = NONE;
+		uint32_t prevFree = NONE;
+		uint32_t nextFree = NONE;
+		bool isFree = false;
+	};
+
+	static void mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+	static void mappingSearch(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+
+	[[nodiscard]] uint32_t findSuitableBlock(VkDeviceSize size) const;
+	[[nodiscard]] uint32_t findFittingBlock(VkDeviceSize size, VkDeviceSize alignment) const;
+
+	uint32_t createBlock(VkDeviceSize offset, VkDeviceSize size);
+	void releaseBlock(uint32_t block);
+
+	void insertFreeBlock(uint32_t block);
+	void removeFreeBlock(uint32_t block);
+	void mergeWithNext(uint32_t block);
+
+	VkDeviceSize m_size = 0;
+	VkDeviceSize m_freeSize = 0;
+	uint32_t m_freeCount = 0;
+
+	uint64_t m_flBitmap = 0;
+	std::array<uint32_t, FL_INDEX_COUNT> m_slBitmaps{};
+	std::array<std::array<uint32_t, SL_INDEX_COUNT>, FL_INDEX_COUNT> m_freeHeads{};
+
+	std::vector<Block> m_blocks;
+	std::vector<uint32_t> m_unusedBlocks;
+	std::unordered_map<VkDeviceSize, uint32_t> m_allocatedBlocks;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 
 class VulkanBase
@@ -13,5 +14,9 @@ protected:
 	uint32_t m_id = 0;
 
 private:
-	inline static uint32_t s_idCounter = 0;
+	inline static std::atomic<uint32_t> s_idCounter = 0;
+
+	// Objects owned by a device get the key of their slot as ID instead
+	template<typename T>
+	friend class VulkanSlotMap;
 };
@@ -9,7 +9,9 @@ class VulkanBinding
 public:
 	VulkanBinding(uint32_t binding, VkVertexInputRate rate, uint32_t stride);
 
+	// Locations follow the previous attribute of the binding, bindings after the first one have to place their first attribute explicitly
 	void addAttribDescription(VkFormat format, uint32_t offset);
+	void addAttribDescription(uint32_t location, VkFormat format, uint32_t offset);
 
 	[[nodiscard]] uint32_t getStride() const;
 
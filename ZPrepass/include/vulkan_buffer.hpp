@@ -3,9 +3,19 @@
 
 #include "vulkan_memory.hpp"
 #include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
 
+class VulkanBuffer;
 class VulkanDevice;
 
+// A slice of a buffer, usually handed out by a VulkanBufferSuballocator
+struct VulkanBufferRange
+{
+	Handle<VulkanBuffer> buffer{};
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+};
+
 class VulkanBuffer : public VulkanBase
 {
 public:
@@ -16,15 +26,21 @@ public:
 
 	void* map(VkDeviceSize size, VkDeviceSize offset);
 	void unmap();
+	void flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
+	void invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
 
 	[[nodiscard]] bool isMemoryMapped() const;
 	[[nodiscard]] void* getMappedData() const;
 	[[nodiscard]] VkDeviceSize getSize() const;
+	[[nodiscard]] VkBufferUsageFlags getUsage() const;
+	// Bumped whenever memory compaction moves the buffer to a new VkBuffer, command buffers recorded against an older
+	// version reference a destroyed buffer and have to be recorded again
+	[[nodiscard]] uint32_t getVersion() const;
 
 private:
 	void free();
 
-	VulkanBuffer(uint32_t device, VkBuffer vkHandle, VkDeviceSize size);
+	VulkanBuffer(VulkanDevice& device, VkBuffer vkHandle, VkDeviceSize size, VkBufferUsageFlags usage);
 
 	void setBoundMemory(const MemoryChunk::MemoryBlock& memoryRegion);
 
@@ -32,9 +48,11 @@ private:
 
 	MemoryChunk::MemoryBlock m_memoryRegion;
 	VkDeviceSize m_size = 0;
+	VkBufferUsageFlags m_usage = 0;
 	void* m_mappedData = nullptr;
+	uint32_t m_version = 0;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class VulkanCommandBuffer;
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "tlsf_allocator.hpp"
+#include "vulkan_base.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_memory.hpp"
+
+class VulkanDevice;
+
+// Carves many logical buffers out of a few big VkBuffers so that geometry of different meshes can share one binding.
+// Ranges are handed out with TLSF and a new backing buffer is only created when none of the current ones has room
+class VulkanBufferSuballocator : public VulkanBase
+{
+public:
+	[[nodiscard]] VulkanBufferRange allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+	void deallocate(const VulkanBufferRange& range);
+
+	[[nodiscard]] VkBufferUsageFlags getUsage() const;
+	[[nodiscard]] VkDeviceSize getBlockSize() const;
+	[[nodiscard]] uint32_t getBufferCount() const;
+	[[nodiscard]] VkDeviceSize getUsedSize() const;
+
+private:
+	struct Block
+	{
+		Handle<VulkanBuffer> buffer;
+		TLSFAllocator allocator;
+	};
+
+	void free();
+
+	VulkanBufferSuballocator(VulkanDevice& device, VkDeviceSize blockSize, VkBufferUsageFlags usage, VulkanMemoryAllocator::MemoryPropertyPreferences memoryProperties, VkDeviceSize minAlignment);
+
+	Block& createBlock(VkDeviceSize size);
+
+	std::vector<Block> m_blocks;
+	VkDeviceSize m_blockSize;
+	VkBufferUsageFlags m_usage;
+	VulkanMemoryAllocator::MemoryPropertyPreferences m_memoryProperties;
+	VkDeviceSize m_minAlignment;
+
+	VulkanDevice* m_device;
+
+	friend class VulkanDevice;
+};
@@ -1,57 +1,125 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
 #include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
 
 
+class CommandStream;
 class VulkanBuffer;
+struct VulkanBufferRange;
 class VulkanQueue;
 class VulkanFence;
 class VulkanRenderPass;
+class VulkanFramebuffer;
+class VulkanPipeline;
+class VulkanPipelineLayout;
+class VulkanSemaphore;
 class VulkanDevice;
 
 class VulkanCommandBuffer : public VulkanBase
 {
 public:
+	struct StateStatistics
+	{
+		uint64_t elidedPipelineBinds = 0;
+		uint64_t elidedVertexBufferBinds = 0;
+		uint64_t elidedIndexBufferBinds = 0;
+		uint64_t elidedViewports = 0;
+		uint64_t elidedScissors = 0;
+		uint64_t elidedPushConstants = 0;
+	};
+
+	// When enabled, binds, dynamic state and push constants that would not change anything are not sent to the driver.
+	// Tracking starts over at every beginRecording and after executing secondary command buffers, the counters keep adding up
+	void setStateTracking(bool enabled);
+	[[nodiscard]] StateStatistics getStateStatistics() const;
+
 	void beginRecording(VkCommandBufferUsageFlags flags = 0);
+	// Secondary command buffers that are executed inside a subpass inherit it, the framebuffer is optional but lets the driver specialize
+	void beginRecording(Handle<VulkanRenderPass> renderPass, uint32_t subpass, Handle<VulkanFramebuffer> framebuffer, VkCommandBufferUsageFlags flags = 0);
 	void endRecording();
-	void submit(const VulkanQueue& queue, const std::vector<std::pair<uint32_t, VkSemaphoreWaitFlags>>& waitSemaphoreData, const std::vector<uint32_t>& signalSemaphores, const uint32_t fence = UINT32_MAX) const;
+	void submit(const VulkanQueue& queue, const std::vector<std::pair<Handle<VulkanSemaphore>, VkSemaphoreWaitFlags>>& waitSemaphoreData, const std::vector<Handle<VulkanSemaphore>>& signalSemaphores, Handle<VulkanFence> fence = {}) const;
 	void reset() const;
 
-	void cmdBeginRenderPass(uint32_t renderPass, uint32_t frameBuffer, VkExtent2D extent, const std::vector<VkClearValue>& clearValues) const;
+	void cmdBeginRenderPass(Handle<VulkanRenderPass> renderPass, Handle<VulkanFramebuffer> frameBuffer, VkExtent2D extent, const std::vector<VkClearValue>& clearValues, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) const;
 	void cmdEndRenderPass() const;
-	void cmdBindPipeline(VkPipelineBindPoint bindPoint, uint32_t pipeline) const;
-	void cmdNextSubpass() const;
+	void cmdBindPipeline(VkPipelineBindPoint bindPoint, Handle<VulkanPipeline> pipeline) const;
+	void cmdNextSubpass(VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) const;
+	// Command buffer handles are only unique within their thread, so every secondary buffer comes with the thread it belongs to
+	void cmdExecuteCommands(const std::vector<std::pair<Handle<VulkanCommandBuffer>, uint32_t /*threadID*/>>& commandBuffers) const;
 	void cmdPipelineBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags, 
 		const std::vector<VkMemoryBarrier>& memoryBarriers, 
 		const std::vector<VkBufferMemoryBarrier>& bufferMemoryBarriers, 
 		const std::vector<VkImageMemoryBarrier>& imageMemoryBarriers) const;
 
-	void cmdBindVertexBuffer(uint32_t buffer, VkDeviceSize offset) const;
-	void cmdBindVertexBuffers(const std::vector<uint32_t>& bufferIDs, const std::vector<VkDeviceSize>& offsets) const;
-	void cmdBindIndexBuffer(uint32_t bufferID, VkDeviceSize offset, VkIndexType indexType) const;
+	void cmdBindVertexBuffer(Handle<VulkanBuffer> buffer, VkDeviceSize offset) const;
+	void cmdBindVertexBuffers(const std::vector<Handle<VulkanBuffer>>& buffers, const std::vector<VkDeviceSize>& offsets) const;
+	void cmdBindVertexBuffer(const VulkanBufferRange& range) const;
+	void cmdBindIndexBuffer(Handle<VulkanBuffer> buffer, VkDeviceSize offset, VkIndexType indexType) const;
+	void cmdBindIndexBuffer(const VulkanBufferRange& range, VkIndexType indexType) const;
 
-	void cmdCopyBuffer(uint32_t source, uint32_t destination, const std::vector<VkBufferCopy>& copyRegions) const;
-	void cmdPushConstant(uint32_t layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues) const;
+	void cmdCopyBuffer(Handle<VulkanBuffer> source, Handle<VulkanBuffer> destination, const std::vector<VkBufferCopy>& copyRegions) const;
+	void cmdPushConstant(Handle<VulkanPipelineLayout> layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues) const;
 
 	void cmdSetViewport(const VkViewport& viewport) const;
 	void cmdSetScissor(VkRect2D scissor) const;
 
 	void cmdDraw(uint32_t vertexCount, uint32_t firstVertex) const;
 	void cmdDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset) const;
+	void cmdDrawIndexedInstanced(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) const;
+
+	// Records every command of the stream in packet order, redundant binds between packets are only dropped with state tracking
+	void cmdReplay(const CommandStream& stream) const;
 
 private:
-	VulkanCommandBuffer(uint32_t device, VkCommandBuffer commandBuffer, bool isSecondary, uint32_t familyIndex, uint32_t threadID);
+	static constexpr uint32_t MAX_TRACKED_VERTEX_BINDINGS = 16;
+	static constexpr uint32_t MAX_TRACKED_PUSH_CONSTANT_SIZE = 256;
+
+	// What the command buffer is known to have bound, anything unknown is always forwarded
+	struct TrackedState
+	{
+		// Indexed by bind point, only graphics and compute are tracked
+		std::array<VkPipeline, 2> pipelines{};
+		std::array<VkBuffer, MAX_TRACKED_VERTEX_BINDINGS> vertexBuffers{};
+		std::array<VkDeviceSize, MAX_TRACKED_VERTEX_BINDINGS> vertexOffsets{};
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkDeviceSize indexOffset = 0;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+		std::optional<VkViewport> viewport;
+		std::optional<VkRect2D> scissor;
+		// Push constant bytes are only known for the layout they were pushed with, a stage mask of 0 means unknown
+		Handle<VulkanPipelineLayout> pushConstantLayout{};
+		std::array<std::byte, MAX_TRACKED_PUSH_CONSTANT_SIZE> pushConstants{};
+		std::array<VkShaderStageFlags, MAX_TRACKED_PUSH_CONSTANT_SIZE> pushConstantStages{};
+	};
+
+	// Returns true when the push is redundant, otherwise records the new bytes
+	bool trackPushConstant(Handle<VulkanPipelineLayout> layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues) const;
+
+	VulkanCommandBuffer(VulkanDevice& device, VkCommandBuffer commandBuffer, VkCommandPool pool, bool isSecondary, uint32_t familyIndex, uint32_t threadID, bool ownsPool = false);
 
 	VkCommandBuffer m_vkHandle = VK_NULL_HANDLE;
+	VkCommandPool m_pool = VK_NULL_HANDLE;
 
 	bool m_isRecording = false;
 	bool m_isSecondary = false;
+	// The pool holds only this buffer, it is reset and destroyed along with it
+	bool m_ownsPool = false;
 	uint32_t m_familyIndex = 0;
 	uint32_t m_threadID = 0;
 
-	uint32_t m_device;
+	bool m_trackState = false;
+	// Recording commands does not change the wrapper itself, only what the GPU will see, so the cache stays out of constness
+	mutable TrackedState m_state;
+	mutable StateStatistics m_stateStatistics;
+
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 };
@@ -1,5 +1,6 @@
 #pragma once
 #include <vulkan/vulkan_core.h>
+#include <memory>
 #include <vector>
 
 #include "vulkan_device.hpp"
@@ -13,6 +14,7 @@ public:
 	static void init(uint32_t vulkanApiVersion, bool enableValidationLayers, const std::vector<const char*>& extensions);
 
 	static [[nodiscard]] std::vector<VulkanGPU> getGPUs();
+	static [[nodiscard]] bool isInstanceExtensionSupported(const char* extension);
 
 	static uint32_t createDevice(VulkanGPU gpu, const QueueFamilySelector& queues, const std::vector<const char*>& extensions, const VkPhysicalDeviceFeatures& features);
 	static VulkanDevice& getDevice(uint32_t index);
@@ -25,8 +27,10 @@ private:
 	inline static VkInstance m_vkHandle = VK_NULL_HANDLE;
 	inline static bool m_validationLayersEnabled = false;
 
-	inline static std::vector<VulkanDevice> m_devices{};
+	// Wrappers point straight at their device, so devices are heap allocated and never move
+	inline static std::vector<std::unique_ptr<VulkanDevice>> m_devices{};
 
 	friend class SDLWindow;
+	friend class VulkanMemoryBackend;
 };
 
@@ -1,13 +1,23 @@
 #pragma once
+#include <deque>
 #include <map>
+#include <mutex>
+#include <set>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vulkan/vulkan_core.h>
 
 #include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
 #include "vulkan_queues.hpp"
 #include "vulkan_gpu.hpp"
 #include "vulkan_memory.hpp"
 #include "vulkan_buffer.hpp"
+#include "vulkan_frame_allocator.hpp"
+#include "vulkan_frame_ring.hpp"
+#include "vulkan_buffer_suballocator.hpp"
 #include "vulkan_render_pass.hpp"
 #include "vulkan_framebuffer.hpp"
 #include "vulkan_image.hpp"
@@ -15,89 +25,141 @@
 #include "vulkan_pipeline.hpp"
 #include "vulkan_shader.hpp"
 #include "vulkan_command_buffer.hpp"
+#include "vulkan_slot_map.hpp"
 
 
+// Thread safety: creating and getting resources may happen on any thread, e.g. pipelines and meshes can be built by workers
+// during startup. Freeing them is meant for the thread driving the frame, lookups take no lock and could otherwise see an
+// object destroyed under them. Command buffers and their pools belong to the thread ID they were created with, and fences,
+// queues and the staging buffer need external synchronization like their Vulkan counterparts. Everything else (memory
+// configuration, trim and defragmentation, releasing deferred resources, free) is meant for the thread driving the frame
 class VulkanDevice : public VulkanBase
 {
 public:
 
 	void configureOneTimeQueue(QueueSelection queue);
 
-	void initializeOneTimeCommandPool(uint32_t threadID);
 	void initializeCommandPool(const QueueFamily& family, uint32_t threadID, bool secondary);
-	uint32_t createCommandBuffer(const QueueFamily& family, uint32_t threadID, bool isSecondary);
-	uint32_t createOneTimeCommandBuffer(uint32_t threadID);
-	uint32_t getOrCreateCommandBuffer(const QueueFamily& family, uint32_t threadID, bool isSecondary);
-	VulkanCommandBuffer& getCommandBuffer(uint32_t id, uint32_t threadID);
+	Handle<VulkanCommandBuffer> createCommandBuffer(const QueueFamily& family, uint32_t threadID, bool isSecondary);
+	// Buffers recorded once and submitted many times get a pool of their own, re-recording one resets the whole pool
+	Handle<VulkanCommandBuffer> createRecordOnceCommandBuffer(const QueueFamily& family, uint32_t threadID);
+	// Per frame command buffers come from pools that are only ever reset as a whole. A buffer handed out here stays valid until
+	// the next reset of its thread and frame, after that it is handed out again instead of allocating a new one
+	Handle<VulkanCommandBuffer> getOrCreateCommandBuffer(const QueueFamily& family, uint32_t threadID, uint32_t frameIndex, bool isSecondary);
+	void resetFrameCommandPools(uint32_t threadID, uint32_t frameIndex);
+	VulkanCommandBuffer& getCommandBuffer(Handle<VulkanCommandBuffer> handle, uint32_t threadID);
 	void freeCommandBuffer(const VulkanCommandBuffer& commandBuffer, uint32_t threadID);
-	void freeCommandBuffer(uint32_t id, uint32_t threadID);
+	void freeCommandBuffer(Handle<VulkanCommandBuffer> handle, uint32_t threadID);
 
-	uint32_t createFramebuffer(VkExtent3D size, const VulkanRenderPass& renderPass, const std::vector<VkImageView>& attachments);
-	VulkanFramebuffer& getFramebuffer(uint32_t id);
-	void freeFramebuffer(uint32_t id);
+	Handle<VulkanFramebuffer> createFramebuffer(VkExtent3D size, const VulkanRenderPass& renderPass, const std::vector<VkImageView>& attachments);
+	VulkanFramebuffer& getFramebuffer(Handle<VulkanFramebuffer> handle);
+	void freeFramebuffer(Handle<VulkanFramebuffer> handle);
 	void freeFramebuffer(const VulkanFramebuffer& framebuffer);
 
-	uint32_t createBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
-	VulkanBuffer& getBuffer(uint32_t id);
-	void freeBuffer(uint32_t id);
+	Handle<VulkanBuffer> createBuffer(VkDeviceSize size, VkBufferUsageFlags usage);
+	VulkanBuffer& getBuffer(Handle<VulkanBuffer> handle);
+	void freeBuffer(Handle<VulkanBuffer> handle);
 	void freeBuffer(const VulkanBuffer& buffer);
 
-	uint32_t createImage(VkImageType type, VkFormat format, VkExtent3D extent, VkImageUsageFlags usage, VkImageCreateFlags flags);
-	VulkanImage& getImage(uint32_t id);
-	void freeImage(uint32_t id);
+	Handle<VulkanFrameAllocator> createFrameAllocator(VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage);
+	VulkanFrameAllocator& getFrameAllocator(Handle<VulkanFrameAllocator> handle);
+	void freeFrameAllocator(Handle<VulkanFrameAllocator> handle);
+	void freeFrameAllocator(const VulkanFrameAllocator& allocator);
+
+	// A transient frame size of 0 creates the ring without a per frame allocator
+	Handle<VulkanFrameRing> createFrameRing(const QueueFamily& family, uint32_t threadID, uint32_t frameCount, VkDeviceSize transientFrameSize = 0, VkBufferUsageFlags transientUsage = 0);
+	VulkanFrameRing& getFrameRing(Handle<VulkanFrameRing> handle);
+	void freeFrameRing(Handle<VulkanFrameRing> handle);
+	void freeFrameRing(const VulkanFrameRing& ring);
+
+	Handle<VulkanBufferSuballocator> createBufferSuballocator(VkDeviceSize blockSize, VkBufferUsageFlags usage, VulkanMemoryAllocator::MemoryPropertyPreferences memoryProperties);
+	VulkanBufferSuballocator& getBufferSuballocator(Handle<VulkanBufferSuballocator> handle);
+	void freeBufferSuballocator(Handle<VulkanBufferSuballocator> handle);
+	void freeBufferSuballocator(const VulkanBufferSuballocator& suballocator);
+
+	Handle<VulkanImage> createImage(VkImageType type, VkFormat format, VkExtent3D extent, VkImageUsageFlags usage, VkImageCreateFlags flags);
+	VulkanImage& getImage(Handle<VulkanImage> handle);
+	void freeImage(Handle<VulkanImage> handle);
 	void freeImage(const VulkanImage& image);
 
 	void disallowMemoryType(uint32_t type);
 	void allowMemoryType(uint32_t type);
+	void setMemoryTypeAllocationStrategy(uint32_t type, MemoryChunk::AllocationStrategy strategy);
+	void configureMemoryChunkPolicy(const VulkanMemoryAllocator::ChunkPolicy& policy);
+	VkDeviceSize trimMemory();
+	// Allocation traces for the allocator benchmarks, see VulkanMemoryAllocator::startCapture
+	void startAllocationCapture(const std::string& filename);
+	void stopAllocationCapture();
+	// Moves buffers out of sparsely used chunks without stalling. The copies run on the one time queue and the buffers switch
+	// to their new storage once a later call (releaseDeferredResources, dumpStagingBuffer, defragmentMemory) sees them done,
+	// only one compaction is in flight at a time. Buffers the GPU writes to are never moved, and a command buffer recorded
+	// before a move has to be recorded again (see VulkanBuffer::getVersion)
+	VkDeviceSize defragmentMemory(VkDeviceSize byteBudget, uint32_t threadID, float maxOccupancy = 0.5f);
 
-	uint32_t createRenderPass(const VulkanRenderPassBuilder& builder, VkRenderPassCreateFlags flags);
-	VulkanRenderPass& getRenderPass(uint32_t id);
-	void freeRenderPass(uint32_t id);
+	Handle<VulkanRenderPass> createRenderPass(const VulkanRenderPassBuilder& builder, VkRenderPassCreateFlags flags);
+	VulkanRenderPass& getRenderPass(Handle<VulkanRenderPass> handle);
+	void freeRenderPass(Handle<VulkanRenderPass> handle);
 	void freeRenderPass(const VulkanRenderPass& renderPass);
 
-	uint32_t createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
-	VulkanPipelineLayout& getPipelineLayout(uint32_t id);
-	void freePipelineLayout(uint32_t id);
+	Handle<VulkanPipelineLayout> createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+	VulkanPipelineLayout& getPipelineLayout(Handle<VulkanPipelineLayout> handle);
+	void freePipelineLayout(Handle<VulkanPipelineLayout> handle);
 	void freePipelineLayout(const VulkanPipelineLayout& layout);
 
-	uint32_t createShader(const std::string& filename, VkShaderStageFlagBits stage);
-	VulkanShader& getShader(uint32_t id);
-	void freeShader(uint32_t id);
+	Handle<VulkanShader> createShader(const std::string& filename, VkShaderStageFlagBits stage);
+	VulkanShader& getShader(Handle<VulkanShader> handle);
+	void freeShader(Handle<VulkanShader> handle);
 	void freeShader(const VulkanShader& shader);
 	void freeAllShaders();
 
-	uint32_t createPipeline(const VulkanPipelineBuilder& builder, uint32_t pipelineLayout, uint32_t renderPass, uint32_t subpass);
-	VulkanPipeline& getPipeline(uint32_t id);
-	void freePipeline(uint32_t id);
+	Handle<VulkanPipeline> createPipeline(const VulkanPipelineBuilder& builder, Handle<VulkanPipelineLayout> pipelineLayout, Handle<VulkanRenderPass> renderPass, uint32_t subpass);
+	VulkanPipeline& getPipeline(Handle<VulkanPipeline> handle);
+	void freePipeline(Handle<VulkanPipeline> handle);
 	void freePipeline(const VulkanPipeline& pipeline);
 
-	uint32_t createSemaphore();
-	VulkanSemaphore& getSemaphore(uint32_t id);
-	void freeSemaphore(uint32_t id);
+	Handle<VulkanSemaphore> createSemaphore();
+	VulkanSemaphore& getSemaphore(Handle<VulkanSemaphore> handle);
+	void freeSemaphore(Handle<VulkanSemaphore> handle);
 	void freeSemaphore(VulkanSemaphore& semaphore);
 
-	uint32_t createFence(bool signaled);
-	VulkanFence& getFence(uint32_t id);
-	void freeFence(uint32_t id);
+	Handle<VulkanFence> createFence(bool signaled);
+	VulkanFence& getFence(Handle<VulkanFence> handle);
+	void freeFence(Handle<VulkanFence> handle);
 	void freeFence(const VulkanFence& fence);
 
 	void waitIdle() const;
+	// Destroys the buffers, images and framebuffers whose last use the GPU has finished and refreshes the memory budget,
+	// meant to be called once per frame
+	void releaseDeferredResources();
 
 	void configureStagingBuffer(VkDeviceSize size, const QueueSelection& queue, bool forceAllowStagingMemory = false);
 	void* mapStagingBuffer(VkDeviceSize size, VkDeviceSize offset);
 	void unmapStagingBuffer();
-	void dumpStagingBuffer(uint32_t buffer, VkDeviceSize size, VkDeviceSize offset, uint32_t threadID);
-	void dumpStagingBuffer(uint32_t buffer, const std::vector<VkBufferCopy>& regions, uint32_t threadID);
+	void dumpStagingBuffer(Handle<VulkanBuffer> buffer, VkDeviceSize size, VkDeviceSize offset, uint32_t threadID);
+	void dumpStagingBuffer(Handle<VulkanBuffer> buffer, const std::vector<VkBufferCopy>& regions, uint32_t threadID);
 
 	[[nodiscard]] VulkanQueue getQueue(const QueueSelection& queueSelection) const;
 	[[nodiscard]] VulkanGPU getGPU() const;
 	[[nodiscard]] const VulkanMemoryAllocator& getMemoryAllocator() const;
-	[[nodiscard]] uint32_t getStagingBufferSemaphore() const;
+	[[nodiscard]] Handle<VulkanSemaphore> getStagingBufferSemaphore() const;
+	[[nodiscard]] bool isExtensionEnabled(const std::string& extension) const;
 
 private:
 	void free();
 
-	[[nodiscard]] VkDeviceMemory getMemoryHandle(uint32_t chunk) const;
+	[[nodiscard]] VkDeviceMemory getMemoryHandle(const MemoryChunk::MemoryBlock& block) const;
+	VulkanSlotMap<VulkanCommandBuffer>& getThreadCommandBuffers(uint32_t threadID);
+	// Reset and reused by the blocking submissions of a thread (staging copies, layout transitions), through a transient pool
+	// of its own that is reset as a whole
+	VulkanCommandBuffer& getImmediateCommandBuffer(uint32_t familyIndex, uint32_t threadID);
+
+	// Switches the buffers of the compaction in flight to their new storage if its copies are done, or once they are
+	void completeRelocations(bool wait);
+
+	template<typename T>
+	void deferFree(VulkanSlotMap<T>& resources, Handle<T> handle);
+	void trackSubmission(VulkanFence& fence);
+	[[nodiscard]] uint64_t getCompletedSubmission();
 
 	struct ThreadCommandInfo
 	{
@@ -107,45 +169,111 @@ private:
 			VkCommandPool secondaryPool = VK_NULL_HANDLE;
 		};
 
-		VkCommandPool oneTimePool = VK_NULL_HANDLE;
+		struct FramePoolInfo
+		{
+			VkCommandPool pool = VK_NULL_HANDLE;
+			// Everything ever allocated from the pool, the first used ones are handed out until the next reset
+			std::vector<Handle<VulkanCommandBuffer>> primaryBuffers;
+			std::vector<Handle<VulkanCommandBuffer>> secondaryBuffers;
+			uint32_t usedPrimaryBuffers = 0;
+			uint32_t usedSecondaryBuffers = 0;
+		};
+
+		struct ImmediatePoolInfo
+		{
+			VkCommandPool pool = VK_NULL_HANDLE;
+			Handle<VulkanCommandBuffer> buffer;
+		};
+
 		std::map<uint32_t, CommandPoolInfo> commandPools;
+		std::map<std::pair<uint32_t /*familyIndex*/, uint32_t /*frameIndex*/>, FramePoolInfo> framePools;
+		std::map<uint32_t /*familyIndex*/, ImmediatePoolInfo> immediatePools;
 	};
+	ThreadCommandInfo& getThreadCommandInfo(uint32_t threadID);
 
 	struct StagingBufferInfo
 	{
-		uint32_t stagingBuffer = UINT32_MAX;
+		Handle<VulkanBuffer> stagingBuffer{};
 		QueueSelection queue{};
 	} m_stagingBufferInfo;
 
-	VulkanDevice(VulkanGPU pDevice, VkDevice device);
+	VulkanDevice(VulkanGPU pDevice, VkDevice device, const std::vector<const char*>& extensions);
+	VulkanDevice(const VulkanDevice&) = delete;
+	VulkanDevice& operator=(const VulkanDevice&) = delete;
 
 	VkDevice m_vkHandle;
 
 	VulkanGPU m_physicalDevice;
+	std::set<std::string> m_enabledExtensions;
 
+	// Guards the structure of m_threadCommandInfos and m_commandBuffers, not the per thread entries
+	std::mutex m_commandPoolMutex;
 	std::map<uint32_t, ThreadCommandInfo> m_threadCommandInfos;
-	std::vector<VulkanFramebuffer> m_framebuffers;
-	std::vector<VulkanBuffer> m_buffers;
-	std::unordered_map<uint32_t /*threadID*/, std::vector<VulkanCommandBuffer>> m_commandBuffers;
-	std::vector<VulkanRenderPass> m_renderPasses;
-	std::vector<VulkanPipelineLayout> m_pipelineLayouts;
-	std::vector<VulkanShader> m_shaders;
-	std::vector<VulkanPipeline> m_pipelines;
-	std::vector<VulkanImage> m_images;
-	std::vector<VulkanSemaphore> m_semaphores;
-	std::vector<VulkanFence> m_fences;
+	VulkanSlotMap<VulkanFramebuffer> m_framebuffers{"Framebuffer"};
+	VulkanSlotMap<VulkanBuffer> m_buffers{"Buffer"};
+	VulkanSlotMap<VulkanFrameAllocator> m_frameAllocators{"Frame allocator"};
+	VulkanSlotMap<VulkanFrameRing> m_frameRings{"Frame ring"};
+	VulkanSlotMap<VulkanBufferSuballocator> m_bufferSuballocators{"Buffer suballocator"};
+	// Handles are only unique within a thread, command buffers are always looked up together with their thread
+	std::unordered_map<uint32_t /*threadID*/, VulkanSlotMap<VulkanCommandBuffer>> m_commandBuffers;
+	VulkanSlotMap<VulkanRenderPass> m_renderPasses{"Render pass"};
+	VulkanSlotMap<VulkanPipelineLayout> m_pipelineLayouts{"Pipeline layout"};
+	VulkanSlotMap<VulkanShader> m_shaders{"Shader"};
+	VulkanSlotMap<VulkanPipeline> m_pipelines{"Pipeline"};
+	VulkanSlotMap<VulkanImage> m_images{"Image"};
+	VulkanSlotMap<VulkanSemaphore> m_semaphores{"Semaphore"};
+	VulkanSlotMap<VulkanFence> m_fences{"Fence"};
 
 	VulkanMemoryAllocator m_memoryAllocator;
-	uint32_t m_stagingSemaphore = UINT32_MAX;
+	Handle<VulkanSemaphore> m_stagingSemaphore{};
+
+	// Storage a buffer was moved out of by memory compaction
+	struct RetiredBufferStorage
+	{
+		VulkanDevice* device;
+		VkBuffer vkHandle;
+		MemoryChunk::MemoryBlock memoryRegion;
+
+		void free();
+	};
+
+	// Freed resources wait here until every fenced submission made before the free has completed
+	struct DeferredFree
+	{
+		uint64_t submission;
+		std::variant<VulkanBuffer, VulkanImage, VulkanFramebuffer, RetiredBufferStorage> resource;
+	};
+	std::mutex m_deferredFreeMutex;
+	std::deque<DeferredFree> m_deferredFrees;
+	uint64_t m_submissionCounter = 0;
 	QueueSelection m_oneTimeQueue{UINT32_MAX, UINT32_MAX};
 
+	// Buffers of the compaction in flight keep their old storage until the copies into the new one are fenced as done
+	struct Relocation
+	{
+		Handle<VulkanBuffer> buffer;
+		VkBuffer newHandle;
+		MemoryChunk::MemoryBlock newRegion;
+	};
+	struct RelocationBatch
+	{
+		std::vector<Relocation> relocations;
+		Handle<VulkanCommandBuffer> commandBuffer{};
+		uint32_t threadID = 0;
+		Handle<VulkanFence> fence{};
+	} m_relocationBatch;
+
 	friend class VulkanContext;
 	friend class SDLWindow;
 	friend class VulkanGPU;
 
 	friend class VulkanResource;
 	friend class VulkanMemoryAllocator;
+	friend class VulkanMemoryBackend;
 	friend class VulkanBuffer;
+	friend class VulkanFrameAllocator;
+	friend class VulkanFrameRing;
+	friend class VulkanBufferSuballocator;
 	friend class VulkanRenderPass;
 	friend class VulkanImage;
 	friend class VulkanFence;
@@ -154,4 +282,5 @@ private:
 	friend class VulkanPipelineLayout;
 	friend class VulkanFramebuffer;
 	friend class VulkanShader;
+	friend class VulkanCommandBuffer;
 };
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
+
+class VulkanBuffer;
+class VulkanDevice;
+class VulkanFence;
+
+// Linear allocator over one persistently mapped host visible buffer, split in one region per frame in flight.
+// Allocations are never freed individually, the whole region of a frame is reset once its fence has signaled
+class VulkanFrameAllocator : public VulkanBase
+{
+public:
+	struct Allocation
+	{
+		Handle<VulkanBuffer> buffer{};
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* data = nullptr;
+	};
+
+	void beginFrame(uint32_t frameIndex, Handle<VulkanFence> fence);
+
+	[[nodiscard]] Allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+	[[nodiscard]] Allocation push(const void* data, VkDeviceSize size, VkDeviceSize alignment = 1);
+
+	[[nodiscard]] Handle<VulkanBuffer> getBuffer() const;
+	[[nodiscard]] uint32_t getFrameCount() const;
+	[[nodiscard]] VkDeviceSize getFrameSize() const;
+	[[nodiscard]] VkDeviceSize getUsedSize() const;
+
+private:
+	void free();
+
+	VulkanFrameAllocator(VulkanDevice& device, Handle<VulkanBuffer> buffer, VkDeviceSize frameSize, VkDeviceSize frameStride, uint32_t frameCount, void* mappedData);
+
+	Handle<VulkanBuffer> m_buffer;
+	VkDeviceSize m_frameSize;
+	VkDeviceSize m_frameStride;
+	uint32_t m_frameCount;
+	void* m_mappedData;
+
+	uint32_t m_currentFrame = 0;
+	VkDeviceSize m_head = 0;
+
+	VulkanDevice* m_device;
+
+	friend class VulkanDevice;
+};
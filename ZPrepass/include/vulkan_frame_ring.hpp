@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
+#include "vulkan_queues.hpp"
+
+class VulkanCommandBuffer;
+class VulkanDevice;
+class VulkanFence;
+class VulkanFrameAllocator;
+class VulkanQueue;
+class VulkanSemaphore;
+
+// Owns the objects every frame in flight needs its own copy of and cycles through them, so the CPU can record the next
+// frame while the GPU is still busy with the previous ones. Only the oldest frame is waited on before its objects are reused
+class VulkanFrameRing : public VulkanBase
+{
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+	struct FrameContext
+	{
+		Handle<VulkanCommandBuffer> commandBuffer{};
+		Handle<VulkanSemaphore> imageAvailableSemaphore{};
+		Handle<VulkanSemaphore> renderFinishedSemaphore{};
+		Handle<VulkanFence> inFlightFence{};
+	};
+
+	// Moves to the next frame and waits until the GPU has finished the last submission that used its objects, then resets
+	// the frame command pools of the ring thread. Other threads recording for the frame reset their own pools
+	const FrameContext& beginFrame();
+	// Waits for the frame that last rendered into the swapchain image, it may be another one than the one being reused
+	void waitForImage(uint32_t imageIndex);
+	// Submits the frame command buffer, waiting for the image and signaling the render finished semaphore and the frame fence.
+	// Another primary buffer of the ring thread can be submitted instead, e.g. one recorded once and replayed every frame
+	void submit(const VulkanQueue& queue, VkPipelineStageFlags waitStage, Handle<VulkanCommandBuffer> commandBuffer = {}) const;
+
+	[[nodiscard]] const FrameContext& getCurrentFrame() const;
+	[[nodiscard]] uint32_t getFrameIndex() const;
+	[[nodiscard]] uint32_t getFrameCount() const;
+	[[nodiscard]] uint64_t getFrameNumber() const;
+	[[nodiscard]] uint32_t getThreadID() const;
+	[[nodiscard]] Handle<VulkanFrameAllocator> getTransientAllocator() const;
+
+private:
+	void free();
+
+	VulkanFrameRing(VulkanDevice& device, std::vector<FrameContext> frames, Handle<VulkanFrameAllocator> transientAllocator, const QueueFamily& family, uint32_t threadID);
+
+	std::vector<FrameContext> m_frames;
+	Handle<VulkanFrameAllocator> m_transientAllocator;
+	QueueFamily m_family;
+	uint32_t m_threadID;
+
+	uint32_t m_frameIndex = 0;
+	uint64_t m_frameNumber = 0;
+	// Fence of the frame that last rendered into each swapchain image
+	std::vector<Handle<VulkanFence>> m_imageFences;
+
+	VulkanDevice* m_device;
+
+	friend class VulkanDevice;
+};
@@ -11,11 +11,11 @@ public:
 private:
 	void free();
 
-	VulkanFramebuffer(uint32_t device, VkFramebuffer handle);
+	VulkanFramebuffer(VulkanDevice& device, VkFramebuffer handle);
 
 	VkFramebuffer m_vkHandle = VK_NULL_HANDLE;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class VulkanCommandBuffer;
@@ -23,6 +23,8 @@ public:
 	[[nodiscard]] VkFormatProperties getFormatProperties(VkFormat format) const;
 	[[nodiscard]] VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, const VkImageTiling tiling, const VkFormatFeatureFlags features) const;
 
+	[[nodiscard]] bool isExtensionSupported(const char* extension) const;
+
 private:
 	explicit VulkanGPU(VkPhysicalDevice physicalDevice);
 
@@ -31,5 +33,6 @@ private:
 	friend class VulkanContext;
 	friend class GPUQueueStructure;
 	friend class MemoryStructure;
+	friend class VulkanMemoryBackend;
 };
 
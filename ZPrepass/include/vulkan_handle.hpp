@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+
+// Typed key of an object owned by a VulkanDevice. It wraps the slot map key of the object, so resolving it is a single
+// index, and handing the handle of one kind of object to a function expecting another kind does not compile
+template<typename T>
+class Handle
+{
+public:
+	constexpr Handle() = default;
+	constexpr explicit Handle(const uint32_t id) : m_id(id) {}
+	explicit Handle(const T& object) : m_id(object.getID()) {}
+
+	[[nodiscard]] constexpr uint32_t getID() const { return m_id; }
+	[[nodiscard]] constexpr bool isNull() const { return m_id == UINT32_MAX; }
+
+	constexpr bool operator==(const Handle&) const = default;
+
+private:
+	// UINT32_MAX is never handed out by a slot map, a default constructed handle refers to no object
+	uint32_t m_id = UINT32_MAX;
+};
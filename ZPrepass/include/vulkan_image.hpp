@@ -25,7 +25,7 @@ public:
 private:
 	void free();
 
-	VulkanImage(uint32_t device, VkImage vkHandle, VkExtent3D size, VkImageType type, VkImageLayout layout);
+	VulkanImage(VulkanDevice& device, VkImage vkHandle, VkExtent3D size, VkImageType type, VkImageLayout layout);
 
 	void setBoundMemory(const MemoryChunk::MemoryBlock& memoryRegion);
 
@@ -35,7 +35,7 @@ private:
 	VkImageLayout m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
 	
 	VkImage m_vkHandle = VK_NULL_HANDLE;
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	std::vector<VkImageView> m_imageViews;
 
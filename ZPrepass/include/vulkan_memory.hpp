@@ -1,13 +1,23 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <ranges>
 #include <set>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+#include "tlsf_allocator.hpp"
 #include "vulkan_base.hpp"
+#include "vulkan_memory_backend.hpp"
 
 class VulkanGPU;
 class VulkanDevice;
@@ -23,7 +33,7 @@ public:
 	[[nodiscard]] bool doesMemoryContainProperties(uint32_t type, VkMemoryPropertyFlags property) const;
 
 private:
-	explicit MemoryStructure(VulkanGPU gpu);
+	explicit MemoryStructure(const VkPhysicalDeviceMemoryProperties& memoryProperties);
 
 	VkPhysicalDeviceMemoryProperties m_memoryProperties;
 
@@ -33,11 +43,32 @@ private:
 class MemoryChunk : public VulkanBase
 {
 public:
+	enum AllocationStrategy
+	{
+		BEST_FIT,
+		TLSF
+	};
+
+	// Buffers are linear resources and images use optimal tiling. When bufferImageGranularity is bigger than 1 the two
+	// kinds cannot share a page, so every chunk only holds one of them
+	enum ResourceKind
+	{
+		LINEAR,
+		OPTIMAL
+	};
+
 	struct MemoryBlock
 	{
 		VkDeviceSize size = 0;
 		VkDeviceSize offset = 0;
 		uint32_t chunk = 0;
+		// Where the chunk lives in the allocator, the generation tells apart the chunks that used the same slot over time
+		uint32_t slot = 0;
+		uint32_t generation = 0;
+		// Copied from the chunk so that a freed block can be recycled without looking the chunk up
+		uint32_t memoryType = 0;
+		ResourceKind resourceKind = LINEAR;
+		bool dedicated = false;
 	};
 
 	[[nodiscard]] VkDeviceSize getSize() const;
@@ -45,65 +76,302 @@ public:
 	[[nodiscard]] bool isEmpty() const;
 	[[nodiscard]] VkDeviceSize getBiggestChunkSize() const;
 	[[nodiscard]] VkDeviceSize getRemainingSize() const;
+	[[nodiscard]] VkDeviceSize getUsedSize() const;
+	[[nodiscard]] uint32_t getAllocationCount() const;
+	[[nodiscard]] uint32_t getFreeRangeCount() const;
+	[[nodiscard]] std::vector<std::pair<VkDeviceSize, VkDeviceSize>> getFreeRanges() const;
+	[[nodiscard]] AllocationStrategy getAllocationStrategy() const;
+	[[nodiscard]] ResourceKind getResourceKind() const;
+	[[nodiscard]] bool isMapped() const;
+	[[nodiscard]] bool isDedicated() const;
+	[[nodiscard]] void* getMappedData() const;
 
 	MemoryBlock allocate(VkDeviceSize newSize, VkDeviceSize alignment);
 	void deallocate(const MemoryBlock& block);
 
 private:
-	MemoryChunk(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory vkHandle);
+	MemoryChunk(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory vkHandle, AllocationStrategy strategy = BEST_FIT, void* mappedData = nullptr, bool dedicated = false, ResourceKind resourceKind = LINEAR);
+
+	void defragment(VkDeviceSize offset);
+	[[nodiscard]] MemoryBlock makeBlock(VkDeviceSize size, VkDeviceSize offset) const;
 
-	void defragment();
+	void addUnallocatedRange(VkDeviceSize offset, VkDeviceSize size);
+	void removeUnallocatedRange(VkDeviceSize offset);
 
 	VkDeviceSize m_size;
 	uint32_t m_memoryType;
+	uint32_t m_slot = 0;
+	uint32_t m_generation = 0;
 
 	VkDeviceMemory m_memory;
+	// Host visible chunks stay mapped for their whole lifetime, buffers only get a pointer into this mapping
+	void* m_mappedData;
+	// Dedicated chunks belong to a single resource, they are never shared or retained once empty
+	bool m_dedicated;
+	ResourceKind m_resourceKind;
 
+	AllocationStrategy m_strategy;
+	TLSFAllocator m_tlsf;
+
+	// BEST_FIT free ranges indexed by offset (for merging neighbours) and by size (for best fit lookups)
 	std::map<VkDeviceSize, VkDeviceSize> m_unallocatedData;
+	std::set<std::pair<VkDeviceSize, VkDeviceSize>> m_unallocatedBySize;
 
 	// Metadata
 	VkDeviceSize m_unallocatedSize;
-	VkDeviceSize m_biggestChunk = 0;
+	uint32_t m_allocationCount = 0;
+	std::chrono::steady_clock::time_point m_emptySince{};
 
 	friend class VulkanResource;
 	friend class VulkanMemoryAllocator;
 	friend class VulkanDevice;
+	// Builds chunks without an allocator to measure the sub-allocation alone
+	friend class ChunkBenchmark;
 };
 
+// Allocation, deallocation and the queries can be called from any thread. Configuration (hidden types, strategies, chunk
+// policy) is expected to happen during setup, before other threads start allocating
 class VulkanMemoryAllocator
 {
 public:
+	// Allocator over an arbitrary backend, e.g. a fake one used to replay traces without a GPU
+	explicit VulkanMemoryAllocator(std::unique_ptr<MemoryBackend> backend, VkDeviceSize defaultChunkSize = 20LL * 1024 * 1024);
+
 	struct MemoryPropertyPreferences
 	{
-		VkMemoryPropertyFlags desiredProperties;
-		VkMemoryPropertyFlags undesiredProperties;
-		bool allowUndesired;
+		VkMemoryPropertyFlags desiredProperties = 0;
+		VkMemoryPropertyFlags undesiredProperties = 0;
+		bool allowUndesired = false;
+		// Nice to have, types with them are tried first but the rest stay valid (e.g. LAZILY_ALLOCATED for transient attachments)
+		VkMemoryPropertyFlags preferredProperties = 0;
+	};
+
+	// Resource an allocation is made for, a value initialized one means the allocation can be shared
+	struct DedicatedResource
+	{
+		VkBuffer buffer;
+		VkImage image;
+	};
+
+	struct ChunkPolicy
+	{
+		// Empty chunks kept alive per memory type, and for how long, before they are given back to the driver
+		uint32_t maxRetainedEmptyChunks = 1;
+		std::chrono::milliseconds retentionTimeout{2000};
+		// Every new chunk of a memory type is growthFactor times bigger than the previous one, up to maxChunkSize
+		float growthFactor = 2.0f;
+		VkDeviceSize maxChunkSize = 256LL * 1024 * 1024;
+	};
+
+	struct ChunkStatistics
+	{
+		uint64_t driverAllocations = 0;
+		uint64_t driverFrees = 0;
+		uint64_t avoidedAllocations = 0;
+		uint32_t retainedChunks = 0;
+	};
+
+	struct MemoryUsage
+	{
+		// Bytes held by the allocator in chunks, and how much of that is handed out (blocks parked in thread caches count as used)
+		VkDeviceSize reservedSize = 0;
+		VkDeviceSize usedSize = 0;
+		VkDeviceSize largestFreeRange = 0;
+		uint32_t chunkCount = 0;
+		uint32_t allocationCount = 0;
+		uint32_t freeRangeCount = 0;
+		// 0 when the free space of every chunk is in one range, tends to 1 as it gets split in many small ones
+		float fragmentation = 0.0f;
 	};
 
-	MemoryChunk::MemoryBlock allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryType);
-	MemoryChunk::MemoryBlock searchAndAllocate(VkDeviceSize size, VkDeviceSize alignment, MemoryPropertyPreferences properties, uint32_t typeFilter, bool includeHidden = false);
+	struct MemoryStatistics
+	{
+		// Indexed by heap and memory type, only the first memoryHeapCount and memoryTypeCount entries are used
+		std::array<MemoryUsage, VK_MAX_MEMORY_HEAPS> heaps{};
+		std::array<MemoryUsage, VK_MAX_MEMORY_TYPES> types{};
+		MemoryUsage total;
+		uint64_t allocations = 0;
+		uint64_t deallocations = 0;
+		// Measured over the time elapsed since the previous call to getStatistics
+		float allocationsPerSecond = 0.0f;
+		float deallocationsPerSecond = 0.0f;
+	};
+
+	MemoryChunk::MemoryBlock allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryType, const DedicatedResource& resource = {});
+	MemoryChunk::MemoryBlock searchAndAllocate(VkDeviceSize size, VkDeviceSize alignment, MemoryPropertyPreferences properties, uint32_t typeFilter, bool includeHidden = false, const DedicatedResource& resource = {});
 	void deallocate(const MemoryChunk::MemoryBlock& block);
+	// Skips the thread cache, for callers that need the chunk of the block to empty out (compaction)
+	void deallocateUncached(const MemoryChunk::MemoryBlock& block);
+	VkDeviceSize trim();
+
+	[[nodiscard]] void* getMappedData(const MemoryChunk::MemoryBlock& block) const;
+	void flush(const MemoryChunk::MemoryBlock& block, VkDeviceSize size, VkDeviceSize offset) const;
+	void invalidate(const MemoryChunk::MemoryBlock& block, VkDeviceSize size, VkDeviceSize offset) const;
 
 	void hideMemoryType(uint32_t type);
 	void unhideMemoryType(uint32_t type);
 
+	void setAllocationStrategy(uint32_t memoryType, MemoryChunk::AllocationStrategy strategy);
+	[[nodiscard]] MemoryChunk::AllocationStrategy getAllocationStrategy(uint32_t memoryType) const;
+
+	void setChunkPolicy(const ChunkPolicy& policy);
+	[[nodiscard]] const ChunkPolicy& getChunkPolicy() const;
+	[[nodiscard]] ChunkStatistics getChunkStatistics() const;
+	[[nodiscard]] MemoryStatistics getStatistics() const;
+	[[nodiscard]] std::string toJson() const;
+
+	// Writes every allocation and deallocation to a trace file in the format the allocator benchmarks replay
+	void startCapture(const std::string& filename);
+	void stopCapture();
+
+	// Queries the heap budgets from the driver. In between two refreshes they are only moved along with our own allocations,
+	// so once per frame is enough
+	void refreshBudget();
+
 	[[nodiscard]] const MemoryStructure& getMemoryStructure() const;
 	[[nodiscard]] VkDeviceSize getRemainingSize(uint32_t heap) const;
-	[[nodiscard]] bool suitableChunkExists(uint32_t memoryType, VkDeviceSize size) const;
+	[[nodiscard]] std::optional<VkDeviceSize> getHeapBudget(uint32_t heap) const;
+	[[nodiscard]] bool isDedicatedAllocationSupported() const;
+	[[nodiscard]] bool isMemoryBudgetSupported() const;
+	[[nodiscard]] bool suitableChunkExists(uint32_t memoryType, VkDeviceSize size, MemoryChunk::ResourceKind resourceKind = MemoryChunk::LINEAR) const;
+	[[nodiscard]] bool separatesResourceKinds() const;
 	[[nodiscard]] bool isMemoryTypeHidden(unsigned value) const;
 
 private:
 	void free();
 
+	// Usage of the chunks of a memory type, updated with every change of one of them so that statistics need not walk the chunks.
+	// The largest free range of every chunk is kept to know the largest of the type
+	struct TypeUsage
+	{
+		std::mutex mutex;
+		MemoryUsage usage;
+		VkDeviceSize largestFreeRangeSum = 0;
+		std::multiset<VkDeviceSize> largestFreeRanges;
+	};
+
+	struct ThreadCache
+	{
+		std::mutex mutex;
+		std::vector<MemoryChunk::MemoryBlock> blocks;
+	};
+
+	// Chunks are guarded on two levels: the chunk list by chunkListMutex, and the contents of the chunks of a memory type
+	// by the mutex of that type. Touching a chunk needs its type mutex plus a shared list lock, or an exclusive list lock
+	struct Synchronization
+	{
+		std::shared_mutex chunkListMutex;
+		std::array<std::mutex, VK_MAX_MEMORY_TYPES> typeMutexes;
+
+		std::mutex threadCacheMutex;
+		std::vector<std::shared_ptr<ThreadCache>> threadCaches;
+
+		std::mutex statisticsMutex;
+		std::array<TypeUsage, VK_MAX_MEMORY_TYPES> typeUsages;
+		std::atomic<uint64_t> allocationCount = 0;
+		std::atomic<uint64_t> deallocationCount = 0;
+		std::atomic<uint64_t> driverAllocations = 0;
+		std::atomic<uint64_t> driverFrees = 0;
+		std::atomic<uint64_t> avoidedAllocations = 0;
+
+		// Budget and usage of every heap as of the last refresh, plus what we allocated and freed since then. Without
+		// VK_EXT_memory_budget the budget is the heap size and the usage is tracked by us alone
+		std::mutex budgetMutex;
+		std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapBudgets{};
+		std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapUsages{};
+
+		// Live blocks are keyed by chunk and offset, the trace refers to them by the id of their allocation
+		std::atomic<bool> isCapturing = false;
+		std::mutex captureMutex;
+		std::ofstream captureFile;
+		std::map<std::pair<uint32_t, VkDeviceSize>, uint64_t> capturedIDs;
+		uint64_t nextCapturedID = 0;
+	};
+
+	// Small freed blocks are parked in a cache of the freeing thread and handed back to the next request of the same size,
+	// that path takes no allocator wide lock
+	static constexpr uint32_t THREAD_CACHE_CAPACITY = 32;
+	static constexpr VkDeviceSize THREAD_CACHE_MAX_BLOCK_SIZE = 256LL * 1024;
+
+	ThreadCache& getThreadCache();
+	std::optional<MemoryChunk::MemoryBlock> takeCachedBlock(VkDeviceSize size, VkDeviceSize alignment, uint32_t typeMask, MemoryChunk::ResourceKind resourceKind);
+	bool cacheBlock(const MemoryChunk::MemoryBlock& block);
+	void flushThreadCaches();
+	void releaseBlock(const MemoryChunk::MemoryBlock& block);
+
+	void captureAllocation(const MemoryChunk::MemoryBlock& block, VkDeviceSize alignment);
+	void captureDeallocation(const MemoryChunk::MemoryBlock& block);
+
+	MemoryChunk::MemoryBlock tryAllocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryType, const DedicatedResource& resource);
+	[[nodiscard]] bool prefersDedicatedAllocation(const DedicatedResource& resource) const;
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType, const DedicatedResource* dedicatedResource);
+	void trackHeapUsage(uint32_t memoryType, VkDeviceSize size, bool allocated);
+	MemoryChunk& createChunk(VkDeviceSize size, uint32_t memoryType, VkDeviceMemory memory, bool dedicated, MemoryChunk::ResourceKind resourceKind);
+	[[nodiscard]] static MemoryChunk::ResourceKind getResourceKind(const DedicatedResource& resource);
+	[[nodiscard]] bool canHostResourceKind(const MemoryChunk& chunk, MemoryChunk::ResourceKind resourceKind) const;
+	VkDeviceSize evictEmptyChunks(uint32_t heap);
+
+	[[nodiscard]] std::vector<uint32_t> getDefragmentationCandidates(float maxOccupancy);
+	MemoryChunk::MemoryBlock allocateInExistingChunk(VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryType, const std::set<uint32_t>& excludedChunks);
+	void releaseEmptyChunk(uint32_t chunkID);
+	[[nodiscard]] VkDeviceMemory getMemoryHandle(const MemoryChunk::MemoryBlock& block) const;
+	void reportChunkUsage(const MemoryChunk& chunk, bool removed = false);
+	static void addUsage(MemoryUsage& usage, const MemoryUsage& other);
+	static void computeFragmentation(MemoryUsage& usage, VkDeviceSize largestFreeRangeSum);
+	[[nodiscard]] std::string getAllocationFailureMessage(VkDeviceSize size, uint32_t memoryType) const;
+
+	[[nodiscard]] MemoryChunk* findChunk(const MemoryChunk::MemoryBlock& block);
+	[[nodiscard]] const MemoryChunk* findChunk(const MemoryChunk::MemoryBlock& block) const;
+	[[nodiscard]] MemoryChunk& getChunk(const MemoryChunk::MemoryBlock& block);
+	[[nodiscard]] const MemoryChunk& getChunk(const MemoryChunk::MemoryBlock& block) const;
+	[[nodiscard]] auto getChunks() { return m_chunkSlots | std::views::filter(&ChunkSlot::isUsed) | std::views::transform(&ChunkSlot::get); }
+	[[nodiscard]] auto getChunks() const { return m_chunkSlots | std::views::filter(&ChunkSlot::isUsed) | std::views::transform(&ChunkSlot::getConst); }
+	[[nodiscard]] VkDeviceSize getNextChunkSize(uint32_t memoryType) const;
+	[[nodiscard]] uint32_t getEmptyChunkCount(uint32_t memoryType) const;
+	void releaseExpiredChunks(uint32_t memoryType);
+	void freeChunk(uint32_t slot);
+	[[nodiscard]] std::optional<VkMappedMemoryRange> getNonCoherentRange(const MemoryChunk::MemoryBlock& block, VkDeviceSize size, VkDeviceSize offset) const;
+
 	explicit VulkanMemoryAllocator(const VulkanDevice& device, VkDeviceSize defaultChunkSize = 20LL * 1024 * 1024);
 
+	std::unique_ptr<MemoryBackend> m_backend;
 	MemoryStructure m_memoryStructure;
 	VkDeviceSize m_chunkSize;
+	VkDeviceSize m_nonCoherentAtomSize;
+	VkDeviceSize m_bufferImageGranularity;
 
-	std::vector<MemoryChunk> m_memoryChunks;
+	// Freeing a chunk empties its slot instead of shifting the others, the next chunk reuses it with a bumped generation
+	struct ChunkSlot
+	{
+		std::optional<MemoryChunk> chunk;
+		uint32_t generation = 1;
+		// What the chunk last added to the usage of its memory type
+		MemoryUsage reportedUsage{};
+
+		[[nodiscard]] bool isUsed() const { return chunk.has_value(); }
+		[[nodiscard]] MemoryChunk& get() { return chunk.value(); }
+		[[nodiscard]] const MemoryChunk& getConst() const { return chunk.value(); }
+	};
+	std::vector<ChunkSlot> m_chunkSlots;
+	std::vector<uint32_t> m_freeChunkSlots;
 	std::set<uint32_t> m_hiddenTypes;
+	std::map<uint32_t, MemoryChunk::AllocationStrategy> m_allocationStrategies;
+
+	ChunkPolicy m_chunkPolicy{};
+	// 0 until the first chunk of a type is created
+	std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> m_nextChunkSizes{};
 
-	uint32_t m_device;
+	std::unique_ptr<Synchronization> m_sync = std::make_unique<Synchronization>();
+	uint64_t m_instanceID = s_instanceCounter++;
+	inline static std::atomic<uint64_t> s_instanceCounter = 0;
+
+	struct StatisticsSample
+	{
+		std::chrono::steady_clock::time_point time;
+		uint64_t allocations = 0;
+		uint64_t deallocations = 0;
+	};
+	mutable StatisticsSample m_lastStatisticsSample{std::chrono::steady_clock::now()};
 
 	friend class VulkanDevice;
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vulkan/vulkan_core.h>
+
+class VulkanDevice;
+
+// Driver side of VulkanMemoryAllocator. The allocator only talks to the GPU through this interface, so it can be driven by
+// a fake backend to replay allocation traces or fuzz it on machines without a GPU
+class MemoryBackend
+{
+public:
+	virtual ~MemoryBackend() = default;
+
+	[[nodiscard]] virtual VkPhysicalDeviceMemoryProperties getMemoryProperties() const = 0;
+	[[nodiscard]] virtual VkDeviceSize getNonCoherentAtomSize() const = 0;
+	[[nodiscard]] virtual VkDeviceSize getBufferImageGranularity() const = 0;
+
+	[[nodiscard]] virtual bool supportsDedicatedAllocation() const = 0;
+	[[nodiscard]] virtual bool prefersDedicatedAllocation(VkBuffer buffer, VkImage image) const = 0;
+	[[nodiscard]] virtual bool supportsMemoryBudget() const = 0;
+	// Budget and usage of every heap, only valid when supportsMemoryBudget() is true
+	[[nodiscard]] virtual std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> getMemoryBudget() const = 0;
+
+	// Dedicated handles are VK_NULL_HANDLE for shared allocations
+	virtual VkResult allocateMemory(VkDeviceSize size, uint32_t memoryType, VkBuffer dedicatedBuffer, VkImage dedicatedImage, VkDeviceMemory* memory) = 0;
+	virtual void freeMemory(VkDeviceMemory memory) = 0;
+	virtual VkResult mapMemory(VkDeviceMemory memory, void** data) = 0;
+	virtual void unmapMemory(VkDeviceMemory memory) = 0;
+	virtual VkResult flushMemoryRange(const VkMappedMemoryRange& range) = 0;
+	virtual VkResult invalidateMemoryRange(const VkMappedMemoryRange& range) = 0;
+};
+
+class VulkanMemoryBackend final : public MemoryBackend
+{
+public:
+	explicit VulkanMemoryBackend(const VulkanDevice& device);
+
+	[[nodiscard]] VkPhysicalDeviceMemoryProperties getMemoryProperties() const override;
+	[[nodiscard]] VkDeviceSize getNonCoherentAtomSize() const override;
+	[[nodiscard]] VkDeviceSize getBufferImageGranularity() const override;
+
+	[[nodiscard]] bool supportsDedicatedAllocation() const override;
+	[[nodiscard]] bool prefersDedicatedAllocation(VkBuffer buffer, VkImage image) const override;
+	[[nodiscard]] bool supportsMemoryBudget() const override;
+	[[nodiscard]] std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> getMemoryBudget() const override;
+
+	VkResult allocateMemory(VkDeviceSize size, uint32_t memoryType, VkBuffer dedicatedBuffer, VkImage dedicatedImage, VkDeviceMemory* memory) override;
+	void freeMemory(VkDeviceMemory memory) override;
+	VkResult mapMemory(VkDeviceMemory memory, void** data) override;
+	void unmapMemory(VkDeviceMemory memory) override;
+	VkResult flushMemoryRange(const VkMappedMemoryRange& range) override;
+	VkResult invalidateMemoryRange(const VkMappedMemoryRange& range) override;
+
+private:
+	VkDevice m_device;
+	VkPhysicalDevice m_physicalDevice;
+	VkPhysicalDeviceLimits m_limits;
+
+	// Extension entry points, null when the device was created without the corresponding extensions
+	PFN_vkGetBufferMemoryRequirements2KHR m_vkGetBufferMemoryRequirements2 = nullptr;
+	PFN_vkGetImageMemoryRequirements2KHR m_vkGetImageMemoryRequirements2 = nullptr;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR m_vkGetPhysicalDeviceMemoryProperties2 = nullptr;
+};
+
+// Backend without a GPU: memory handles are made up and mapped memory is plain host memory. Allocations fail like they would
+// in a driver once their heap is full. Used to replay allocation traces and benchmark the allocator on any machine
+class FakeMemoryBackend final : public MemoryBackend
+{
+public:
+	struct Statistics
+	{
+		VkDeviceSize reservedSize = 0;
+		VkDeviceSize peakReservedSize = 0;
+		uint64_t allocations = 0;
+		uint64_t frees = 0;
+	};
+
+	explicit FakeMemoryBackend(const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize nonCoherentAtomSize = 64, VkDeviceSize bufferImageGranularity = 1);
+
+	// typeCount device local memory types sharing a single heap
+	[[nodiscard]] static VkPhysicalDeviceMemoryProperties makeMemoryProperties(uint32_t typeCount, VkDeviceSize heapSize);
+
+	[[nodiscard]] VkPhysicalDeviceMemoryProperties getMemoryProperties() const override;
+	[[nodiscard]] VkDeviceSize getNonCoherentAtomSize() const override;
+	[[nodiscard]] VkDeviceSize getBufferImageGranularity() const override;
+
+	[[nodiscard]] bool supportsDedicatedAllocation() const override;
+	[[nodiscard]] bool prefersDedicatedAllocation(VkBuffer buffer, VkImage image) const override;
+	[[nodiscard]] bool supportsMemoryBudget() const override;
+	[[nodiscard]] std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> getMemoryBudget() const override;
+
+	VkResult allocateMemory(VkDeviceSize size, uint32_t memoryType, VkBuffer dedicatedBuffer, VkImage dedicatedImage, VkDeviceMemory* memory) override;
+	void freeMemory(VkDeviceMemory memory) override;
+	VkResult mapMemory(VkDeviceMemory memory, void** data) override;
+	void unmapMemory(VkDeviceMemory memory) override;
+	VkResult flushMemoryRange(const VkMappedMemoryRange& range) override;
+	VkResult invalidateMemoryRange(const VkMappedMemoryRange& range) override;
+
+	[[nodiscard]] Statistics getStatistics() const;
+
+private:
+	struct Allocation
+	{
+		VkDeviceSize size;
+		uint32_t heap;
+		// Only created once the memory is mapped
+		std::unique_ptr<std::byte[]> hostData;
+	};
+
+	VkPhysicalDeviceMemoryProperties m_memoryProperties;
+	VkDeviceSize m_nonCoherentAtomSize;
+	VkDeviceSize m_bufferImageGranularity;
+
+	// The allocator calls its backend from any thread
+	mutable std::mutex m_mutex;
+	uint64_t m_nextHandle = 1;
+	std::unordered_map<VkDeviceMemory, Allocation> m_allocations;
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> m_heapUsage{};
+	Statistics m_statistics;
+};
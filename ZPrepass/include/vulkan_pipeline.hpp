@@ -5,14 +5,18 @@
 
 #include "vulkan_base.hpp"
 #include "vulkan_binding.hpp"
+#include "vulkan_handle.hpp"
 
 class VulkanDevice;
+class VulkanPipelineLayout;
+class VulkanRenderPass;
+class VulkanShader;
 
 struct VulkanPipelineBuilder
 {
 	explicit VulkanPipelineBuilder(VulkanDevice* device);
 
-	void addShaderStage(uint32_t shader);
+	void addShaderStage(Handle<VulkanShader> shader);
 	void resetShaderStages();
 
 	void setVertexInputState(const VkPipelineVertexInputStateCreateInfo& state);
@@ -58,7 +62,7 @@ private:
 
 	bool m_tesellationStateEnabled = false;
 
-	std::vector<uint32_t> m_shaderStages;
+	std::vector<Handle<VulkanShader>> m_shaderStages;
 	std::vector<VkVertexInputBindingDescription> m_vertexInputBindings;
 	std::vector<VkVertexInputAttributeDescription> m_vertexInputAttributes;
 	std::vector<VkViewport> m_viewports;
@@ -76,21 +80,23 @@ private:
 class VulkanPipeline : public VulkanBase
 {
 public:
-	[[nodiscard]] uint32_t getLayout() const;
-	[[nodiscard]] uint32_t getRenderPass() const;
+	[[nodiscard]] Handle<VulkanPipelineLayout> getLayout() const;
+	[[nodiscard]] Handle<VulkanRenderPass> getRenderPass() const;
 	[[nodiscard]] uint32_t getSubpass() const;
+	[[nodiscard]] bool hasDynamicState(VkDynamicState state) const;
 
 private:
 	void free();
 
 	VulkanPipeline() = default;
-	VulkanPipeline(VulkanDevice& device, VkPipeline handle, uint32_t layout, uint32_t renderPass, uint32_t subpass);
+	VulkanPipeline(VulkanDevice& device, VkPipeline handle, Handle<VulkanPipelineLayout> layout, Handle<VulkanRenderPass> renderPass, uint32_t subpass, std::vector<VkDynamicState> dynamicStates);
 
 	VkPipeline m_vkHandle;
 
-	uint32_t m_layout;
-	uint32_t m_renderPass;
+	Handle<VulkanPipelineLayout> m_layout;
+	Handle<VulkanRenderPass> m_renderPass;
 	uint32_t m_subpass;
+	std::vector<VkDynamicState> m_dynamicStates;
 
 	VulkanDevice* m_device;
 
@@ -103,11 +109,11 @@ class VulkanPipelineLayout : public VulkanBase
 private:
 	void free();
 
-	VulkanPipelineLayout(uint32_t device, VkPipelineLayout handle);
+	VulkanPipelineLayout(VulkanDevice& device, VkPipelineLayout handle);
 
 	VkPipelineLayout m_vkHandle = VK_NULL_HANDLE;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class VulkanCommandBuffer;
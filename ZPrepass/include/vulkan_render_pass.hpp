@@ -59,10 +59,10 @@ public:
 private:
 	void free();
 
-	VulkanRenderPass(uint32_t device, VkRenderPass renderPass);
+	VulkanRenderPass(VulkanDevice& device, VkRenderPass renderPass);
 
 	VkRenderPass m_vkHandle = VK_NULL_HANDLE;
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class VulkanCommandBuffer;
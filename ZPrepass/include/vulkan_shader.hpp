@@ -23,7 +23,7 @@ private:
 		std::string error;
 	};
 
-	VulkanShader(uint32_t device, VkShaderModule handle, VkShaderStageFlagBits stage);
+	VulkanShader(VulkanDevice& device, VkShaderModule handle, VkShaderStageFlagBits stage);
 
 	static std::string readFile(std::string_view p_filename);
 	static [[nodiscard]] Result compileFile(std::string_view p_source_name, shaderc_shader_kind p_kind, std::string_view p_source, bool p_optimize);
@@ -31,7 +31,7 @@ private:
 	VkShaderModule m_vkHandle = VK_NULL_HANDLE;
 	VkShaderStageFlagBits m_stage = VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class VulkanPipeline;
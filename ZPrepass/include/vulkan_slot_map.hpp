@@ -0,0 +1,210 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan_base.hpp"
+#include "vulkan_handle.hpp"
+
+// Generational storage for the objects owned by a VulkanDevice. A handle packs the slot of the object and the generation
+// of that slot, so a lookup is a single index and a handle that outlived its object is caught instead of aliasing whatever
+// took its slot. Slots live in fixed size pages that never move, references stay valid while other objects are inserted.
+// Insert may be called from any thread, it serializes on a mutex. Lookups and iteration take no lock, a handle only has to
+// reach the looking up thread through some synchronization (a join, a queue, ...) after its insert returned. Extract
+// destroys the object in place, so it must not run while another thread may still look it up or iterate.
+// Freed slots are reused oldest first and only once enough of them piled up, so a slot goes through its generations slowly.
+// A slot that used up its last generation is retired for good instead of wrapping around to generations old handles may hold
+template<typename T>
+class VulkanSlotMap
+{
+public:
+	static constexpr uint32_t INDEX_BITS = 20;
+	static constexpr uint32_t INDEX_MASK = (1U << INDEX_BITS) - 1;
+	static constexpr uint32_t GENERATION_MASK = UINT32_MAX >> INDEX_BITS;
+	// The last slot is never handed out, its ID with the last generation would be UINT32_MAX, which callers use as "no object"
+	static constexpr uint32_t MAX_SLOTS = INDEX_MASK;
+	static constexpr uint32_t PAGE_SIZE = 256;
+	static constexpr uint32_t PAGE_COUNT = (MAX_SLOTS + PAGE_SIZE - 1) / PAGE_SIZE;
+	static constexpr uint32_t MIN_FREE_SLOTS = 64;
+
+	explicit VulkanSlotMap(std::string name) : m_name(std::move(name)) {}
+	~VulkanSlotMap()
+	{
+		for (uint32_t page = 0; page < PAGE_COUNT; page++)
+			delete m_pages[page].load(std::memory_order_relaxed);
+	}
+
+	VulkanSlotMap(const VulkanSlotMap&) = delete;
+	VulkanSlotMap& operator=(const VulkanSlotMap&) = delete;
+
+	// Takes ownership of the object and sets its ID to the key of the slot it lands in
+	Handle<T> insert(T&& value)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		uint32_t index = m_slotCount.load(std::memory_order_relaxed);
+		if (m_freeSlots.size() >= MIN_FREE_SLOTS || (index >= MAX_SLOTS && !m_freeSlots.empty()))
+		{
+			index = m_freeSlots.front();
+			m_freeSlots.pop_front();
+		}
+		else
+		{
+			if (index >= MAX_SLOTS)
+				throw std::runtime_error("Too many live " + m_name + " objects");
+
+			if (index % PAGE_SIZE == 0)
+				m_pages[index / PAGE_SIZE].store(new Page{}, std::memory_order_release);
+			m_slotCount.store(index + 1, std::memory_order_release);
+		}
+
+		Slot& slot = getSlot(index);
+		slot.value.emplace(std::move(value));
+		const uint32_t id = makeID(index, slot.generation.load(std::memory_order_relaxed));
+		static_cast<VulkanBase&>(slot.value.value()).m_id = id;
+		slot.used.store(true, std::memory_order_release);
+		m_size.fetch_add(1, std::memory_order_relaxed);
+		return Handle<T>{id};
+	}
+
+	[[nodiscard]] T* find(const Handle<T> handle)
+	{
+		const uint32_t index = getIndex(handle.getID());
+		if (index >= m_slotCount.load(std::memory_order_acquire))
+			return nullptr;
+
+		Slot& slot = getSlot(index);
+		if (slot.generation.load(std::memory_order_acquire) != getGeneration(handle.getID()) || !slot.isUsed())
+			return nullptr;
+
+		return &slot.value.value();
+	}
+
+	[[nodiscard]] const T* find(const Handle<T> handle) const
+	{
+		return const_cast<VulkanSlotMap*>(this)->find(handle);
+	}
+
+	[[nodiscard]] T& get(const Handle<T> handle)
+	{
+		T* value = find(handle);
+		if (value == nullptr)
+			throw std::runtime_error(getLookupError(handle.getID()));
+
+		return *value;
+	}
+
+	[[nodiscard]] const T& get(const Handle<T> handle) const
+	{
+		return const_cast<VulkanSlotMap*>(this)->get(handle);
+	}
+
+	[[nodiscard]] bool contains(const Handle<T> handle) const
+	{
+		return find(handle) != nullptr;
+	}
+
+	// Moves the object out and retires its handle, unknown and stale handles give nothing
+	std::optional<T> extract(const Handle<T> handle)
+	{
+		std::scoped_lock lock(m_mutex);
+		if (find(handle) == nullptr)
+			return std::nullopt;
+
+		const uint32_t index = getIndex(handle.getID());
+		Slot& slot = getSlot(index);
+		slot.used.store(false, std::memory_order_release);
+		std::optional<T> value = std::move(slot.value);
+		slot.value.reset();
+		const uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+		if (generation < GENERATION_MASK)
+		{
+			slot.generation.store(generation + 1, std::memory_order_release);
+			m_freeSlots.push_back(index);
+		}
+		m_size.fetch_sub(1, std::memory_order_relaxed);
+		return value;
+	}
+
+	// Destroys the object and retires its handle, unknown and stale handles are ignored
+	bool erase(const Handle<T> handle)
+	{
+		return extract(handle).has_value();
+	}
+
+	void clear()
+	{
+		for (uint32_t index = 0; index < m_slotCount.load(std::memory_order_acquire); index++)
+		{
+			const Slot& slot = getSlot(index);
+			if (slot.isUsed())
+				erase(Handle<T>{makeID(index, slot.generation.load(std::memory_order_acquire))});
+		}
+	}
+
+	[[nodiscard]] uint32_t size() const { return m_size.load(std::memory_order_relaxed); }
+	[[nodiscard]] bool empty() const { return size() == 0; }
+
+	// Live objects in slot order, objects inserted by other threads meanwhile may or may not show up
+	[[nodiscard]] auto values()
+	{
+		return std::views::iota(0U, m_slotCount.load(std::memory_order_acquire))
+			| std::views::transform([this](const uint32_t index) -> Slot& { return getSlot(index); })
+			| std::views::filter(&Slot::isUsed) | std::views::transform(&Slot::get);
+	}
+
+	[[nodiscard]] auto values() const
+	{
+		return std::views::iota(0U, m_slotCount.load(std::memory_order_acquire))
+			| std::views::transform([this](const uint32_t index) -> const Slot& { return getSlot(index); })
+			| std::views::filter(&Slot::isUsed) | std::views::transform(&Slot::getConst);
+	}
+
+private:
+	struct Slot
+	{
+		std::optional<T> value;
+		// Starts at 1 so that no ID is ever 0
+		std::atomic<uint32_t> generation = 1;
+		// Set once the value is constructed, lock free readers check it before touching the value
+		std::atomic<bool> used = false;
+
+		[[nodiscard]] bool isUsed() const { return used.load(std::memory_order_acquire); }
+		[[nodiscard]] T& get() { return value.value(); }
+		[[nodiscard]] const T& getConst() const { return value.value(); }
+	};
+	using Page = std::array<Slot, PAGE_SIZE>;
+
+	[[nodiscard]] static uint32_t makeID(const uint32_t index, const uint32_t generation) { return generation << INDEX_BITS | index; }
+	[[nodiscard]] static uint32_t getIndex(const uint32_t id) { return id & INDEX_MASK; }
+	[[nodiscard]] static uint32_t getGeneration(const uint32_t id) { return id >> INDEX_BITS; }
+
+	// Only valid below m_slotCount, the page of a slot is published before the count that covers it
+	[[nodiscard]] Slot& getSlot(const uint32_t index) const
+	{
+		return (*m_pages[index / PAGE_SIZE].load(std::memory_order_acquire))[index % PAGE_SIZE];
+	}
+
+	[[nodiscard]] std::string getLookupError(const uint32_t id) const
+	{
+		const uint32_t index = getIndex(id);
+		if (index < m_slotCount.load(std::memory_order_acquire) && getSlot(index).generation.load(std::memory_order_acquire) != getGeneration(id))
+			return m_name + " " + std::to_string(id) + " is stale, it was freed and its slot reused";
+		return m_name + " not found";
+	}
+
+	std::string m_name;
+	std::unique_ptr<std::atomic<Page*>[]> m_pages = std::make_unique<std::atomic<Page*>[]>(PAGE_COUNT);
+	std::atomic<uint32_t> m_slotCount = 0;
+	std::atomic<uint32_t> m_size = 0;
+
+	std::mutex m_mutex;
+	std::deque<uint32_t> m_freeSlots;
+};
@@ -17,13 +17,15 @@ public:
 private:
 	void free();
 
-	VulkanFence(uint32_t device, VkFence fence, bool isSignaled);
+	VulkanFence(VulkanDevice& device, VkFence fence, bool isSignaled);
 
 	VkFence m_vkHandle = VK_NULL_HANDLE;
 
 	bool m_isSignaled = false;
+	// Device wide number of the submission this fence will signal, 0 once that submission is known to be done
+	uint64_t m_submission = 0;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class SDLWindow;
@@ -37,11 +39,11 @@ public:
 private:
 	void free();
 
-	VulkanSemaphore(uint32_t device, VkSemaphore semaphore);
+	VulkanSemaphore(VulkanDevice& device, VkSemaphore semaphore);
 
 	VkSemaphore m_vkHandle = VK_NULL_HANDLE;
 
-	uint32_t m_device;
+	VulkanDevice* m_device;
 
 	friend class VulkanDevice;
 	friend class SDLWindow;
@@ -0,0 +1,40 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads for fork join work such as recording command buffers in parallel. A job runs once on every worker
+// with the index of that worker, so each one can pick its share of the work and the resources it owns (command pools, ...)
+class WorkerPool
+{
+public:
+	explicit WorkerPool(uint32_t workerCount);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Blocks until every worker has finished the job, the first exception thrown by a worker is rethrown here
+	void run(const std::function<void(uint32_t)>& job);
+
+	[[nodiscard]] uint32_t getWorkerCount() const;
+
+private:
+	void workerLoop(uint32_t workerIndex);
+
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_jobReady;
+	std::condition_variable m_jobDone;
+	const std::function<void(uint32_t)>* m_job = nullptr;
+	// Bumped for every job so that a worker never runs the same job twice
+	uint64_t m_jobCounter = 0;
+	uint32_t m_pendingWorkers = 0;
+	std::exception_ptr m_exception;
+	bool m_stopping = false;
+};
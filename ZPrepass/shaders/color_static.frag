@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec3 fragPos;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) flat in vec3 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 diffuseFinal = fragColor * clamp(dot(vec3(1.0, 1.0, 0.0), normalize(fragNormal)) * 1.0, 0, 1);
+    outColor = vec4(fragColor * 0.05 + diffuseFinal, 1.0);
+}
\ No newline at end of file
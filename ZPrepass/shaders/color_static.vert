@@ -0,0 +1,22 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+
+// Per object data, advanced once per instance
+layout(location = 3) in mat4 inMvpMat;
+layout(location = 7) in vec3 inColor;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec3 fragPos;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) flat out vec3 fragColor;
+
+void main() {
+	gl_Position = inMvpMat * vec4(inPosition, 1.0);
+    fragTexCoord = inTexCoord;
+	fragPos = inPosition;
+	fragNormal = inNormal;
+	fragColor = inColor;
+}
\ No newline at end of file
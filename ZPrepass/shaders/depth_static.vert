@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+
+// Per object data, advanced once per instance
+layout(location = 3) in mat4 inMvpMat;
+
+void main() 
+{
+	gl_Position = inMvpMat * vec4(inPosition, 1.0);
+}
\ No newline at end of file
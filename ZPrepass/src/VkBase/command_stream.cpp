@@ -0,0 +1,153 @@
+#include "command_stream.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void CommandStream::beginPacket(const uint64_t sortKey)
+{
+	m_packets.push_back({sortKey, m_data.size(), m_data.size()});
+	m_isPacketOpen = true;
+}
+
+void CommandStream::cmdBindPipeline(const BindPoint bindPoint, const Handle<VulkanPipeline> pipeline)
+{
+	const BindPipeline command{bindPoint, pipeline};
+	beginCommand(CommandType::BIND_PIPELINE);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::cmdBindVertexBuffer(const Handle<VulkanBuffer> buffer, const uint64_t offset)
+{
+	constexpr uint32_t count = 1;
+	beginCommand(CommandType::BIND_VERTEX_BUFFERS);
+	write(&count, sizeof(count));
+	write(&buffer, sizeof(buffer));
+	write(&offset, sizeof(offset));
+}
+
+void CommandStream::cmdBindVertexBuffers(const std::vector<Handle<VulkanBuffer>>& buffers, const std::vector<uint64_t>& offsets)
+{
+	if (buffers.size() != offsets.size())
+		throw std::runtime_error("Every vertex buffer needs an offset");
+	if (buffers.size() > MAX_VERTEX_BUFFERS)
+		throw std::runtime_error("Command stream can not bind more than " + std::to_string(MAX_VERTEX_BUFFERS) + " vertex buffers");
+
+	const uint32_t count = static_cast<uint32_t>(buffers.size());
+	beginCommand(CommandType::BIND_VERTEX_BUFFERS);
+	write(&count, sizeof(count));
+	write(buffers.data(), count * sizeof(Handle<VulkanBuffer>));
+	write(offsets.data(), count * sizeof(uint64_t));
+}
+
+void CommandStream::cmdBindIndexBuffer(const Handle<VulkanBuffer> buffer, const uint64_t offset, const IndexType indexType)
+{
+	const BindIndexBuffer command{buffer, offset, indexType};
+	beginCommand(CommandType::BIND_INDEX_BUFFER);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::cmdSetViewport(const Viewport& viewport)
+{
+	const SetViewport command{viewport};
+	beginCommand(CommandType::SET_VIEWPORT);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::cmdSetScissor(const Rect scissor)
+{
+	const SetScissor command{scissor};
+	beginCommand(CommandType::SET_SCISSOR);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::cmdPushConstant(const Handle<VulkanPipelineLayout> layout, const ShaderStageFlags stageFlags, const uint32_t offset, const uint32_t size, const void* pValues)
+{
+	const PushConstant command{layout, stageFlags, offset, size};
+	beginCommand(CommandType::PUSH_CONSTANT);
+	write(&command, sizeof(command));
+	write(pValues, size);
+}
+
+void CommandStream::cmdDraw(const uint32_t vertexCount, const uint32_t firstVertex)
+{
+	const Draw command{vertexCount, firstVertex};
+	beginCommand(CommandType::DRAW);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::cmdDrawIndexed(const uint32_t indexCount, const uint32_t firstIndex, const int32_t vertexOffset)
+{
+	cmdDrawIndexedInstanced(indexCount, 1, firstIndex, vertexOffset, 0);
+}
+
+void CommandStream::cmdDrawIndexedInstanced(const uint32_t indexCount, const uint32_t instanceCount, const uint32_t firstIndex, const int32_t vertexOffset, const uint32_t firstInstance)
+{
+	const DrawIndexed command{indexCount, instanceCount, firstIndex, vertexOffset, firstInstance};
+	beginCommand(CommandType::DRAW_INDEXED);
+	write(&command, sizeof(command));
+}
+
+void CommandStream::sort()
+{
+	std::ranges::stable_sort(m_packets, {}, &Packet::sortKey);
+	m_isPacketOpen = false;
+}
+
+void CommandStream::merge(const CommandStream& other)
+{
+	const size_t base = m_data.size();
+	m_data.insert(m_data.end(), other.m_data.begin(), other.m_data.end());
+	for (const Packet& packet : other.m_packets)
+		m_packets.push_back({packet.sortKey, base + packet.begin, base + packet.end});
+	m_commandCount += other.m_commandCount;
+	m_isPacketOpen = false;
+}
+
+void CommandStream::clear()
+{
+	m_data.clear();
+	m_packets.clear();
+	m_commandCount = 0;
+	m_isPacketOpen = false;
+}
+
+bool CommandStream::isEmpty() const
+{
+	return m_commandCount == 0;
+}
+
+uint32_t CommandStream::getPacketCount() const
+{
+	return static_cast<uint32_t>(m_packets.size());
+}
+
+uint32_t CommandStream::getCommandCount() const
+{
+	return m_commandCount;
+}
+
+size_t CommandStream::getByteSize() const
+{
+	return m_data.size();
+}
+
+void CommandStream::beginCommand(const CommandType type)
+{
+	// Sorting, merging and clearing close the open packet since it may have moved, commands need a new beginPacket after them
+	if (!m_isPacketOpen)
+		throw std::runtime_error("Command stream has no packet to record into, call beginPacket first");
+
+	m_commandCount++;
+	write(&type, sizeof(type));
+}
+
+void CommandStream::write(const void* data, const size_t size)
+{
+	const size_t offset = m_data.size();
+	m_data.resize(offset + size);
+	if (size > 0)
+		std::memcpy(m_data.data() + offset, data, size);
+
+	m_packets.back().end = m_data.size();
+}
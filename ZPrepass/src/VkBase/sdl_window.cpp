@@ -104,14 +104,14 @@ void SDLWindow::createSwapchain(const uint32_t deviceID, const VkSurfaceFormatKH
 	_createSwapchain(deviceID, getSize().toExtent2D(), selectedFormat);
 }
 
-uint32_t SDLWindow::acquireNextImage(const uint32_t semaphoreID, const VulkanFence* fence) const
+uint32_t SDLWindow::acquireNextImage(const Handle<VulkanSemaphore> semaphoreHandle, const VulkanFence* fence) const
 {
 	if (m_swapchain.swapchain == nullptr)
 		throw std::runtime_error("Swapchain not created");
 
 	uint32_t imageIndex;
 	VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
-	const VulkanSemaphore& semaphore = device.getSemaphore(semaphoreID);
+	const VulkanSemaphore& semaphore = device.getSemaphore(semaphoreHandle);
 	const VkResult result = vkAcquireNextImageKHR(device.m_vkHandle, m_swapchain.swapchain, UINT64_MAX, semaphore.m_vkHandle, fence != nullptr ? fence->m_vkHandle : nullptr, &imageIndex);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
@@ -167,12 +167,12 @@ void SDLWindow::free()
 	m_SDLHandle = nullptr;
 }
 
-void SDLWindow::present(const VulkanQueue& queue, const uint32_t imageIndex, const uint32_t waitSemaphore) const
+void SDLWindow::present(const VulkanQueue& queue, const uint32_t imageIndex, const Handle<VulkanSemaphore> waitSemaphore) const
 {
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = waitSemaphore != UINT32_MAX ? 1 : 0;
-	presentInfo.pWaitSemaphores = &VulkanContext::getDevice(m_deviceID).getSemaphore(waitSemaphore).m_vkHandle;
+	presentInfo.waitSemaphoreCount = waitSemaphore.isNull() ? 0 : 1;
+	presentInfo.pWaitSemaphores = waitSemaphore.isNull() ? nullptr : &VulkanContext::getDevice(m_deviceID).getSemaphore(waitSemaphore).m_vkHandle;
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = &m_swapchain.swapchain;
 	presentInfo.pImageIndices = &imageIndex;
@@ -0,0 +1,308 @@
+#include "tlsf_allocator.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+TLSFAllocator::TLSFAllocator(const VkDeviceSize size)
+	: m_size(size)
+{
+	for (auto& heads : m_freeHeads)
+		heads.fill(NONE);
+
+	if (size == 0)
+		return;
+
+	insertFreeBlock(createBlock(0, size));
+	m_freeSize = size;
+}
+
+std::optional<VkDeviceSize> TLSFAllocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+	if (size == 0)
+		return std::nullopt;
+
+	const VkDeviceSize safeAlignment = alignment > 0 ? alignment : 1;
+	const auto alignUp = [safeAlignment](const VkDeviceSize offset) { return (offset + safeAlignment - 1) / safeAlignment * safeAlignment; };
+
+	// The head of the first suitable list usually fits as is, only fall back to reserving room for the worst case padding when it doesn't
+	uint32_t block = findSuitableBlock(size);
+	if (block != NONE && alignUp(m_blocks[block].offset) - m_blocks[block].offset + size > m_blocks[block].size)
+		block = NONE;
+	if (block == NONE && safeAlignment > 1)
+		block = findSuitableBlock(size + safeAlignment - 1);
+	if (block == NONE)
+		block = findFittingBlock(size, safeAlignment);
+	if (block == NONE)
+		return std::nullopt;
+
+	removeFreeBlock(block);
+
+	const VkDeviceSize alignedOffset = alignUp(m_blocks[block].offset);
+	const VkDeviceSize padding = alignedOffset - m_blocks[block].offset;
+	if (padding > 0)
+	{
+		const uint32_t front = createBlock(m_blocks[block].offset, padding);
+		const uint32_t prev = m_blocks[block].prevPhysical;
+		m_blocks[front].prevPhysical = prev;
+		m_blocks[front].nextPhysical = block;
+		if (prev != NONE)
+			m_blocks[prev].nextPhysical = front;
+
+		m_blocks[block].offset += padding;
+		m_blocks[block].size -= padding;
+		m_blocks[block].prevPhysical = front;
+		insertFreeBlock(front);
+	}
+
+	if (m_blocks[block].size > size)
+	{
+		const uint32_t back = createBlock(m_blocks[block].offset + size, m_blocks[block].size - size);
+		const uint32_t next = m_blocks[block].nextPhysical;
+		m_blocks[back].prevPhysical = block;
+		m_blocks[back].nextPhysical = next;
+		if (next != NONE)
+			m_blocks[next].prevPhysical = back;
+
+		m_blocks[block].nextPhysical = back;
+		m_blocks[block].size = size;
+		insertFreeBlock(back);
+	}
+
+	m_allocatedBlocks[alignedOffset] = block;
+	m_freeSize -= size;
+	return alignedOffset;
+}
+
+void TLSFAllocator::deallocate(const VkDeviceSize offset)
+{
+	const auto it = m_allocatedBlocks.find(offset);
+	if (it == m_allocatedBlocks.end())
+		throw std::runtime_error("Offset " + std::to_string(offset) + " was not allocated by this TLSF allocator");
+
+	uint32_t block = it->second;
+	m_allocatedBlocks.erase(it);
+	m_freeSize += m_blocks[block].size;
+
+	const uint32_t prev = m_blocks[block].prevPhysical;
+	if (prev != NONE && m_blocks[prev].isFree)
+	{
+		removeFreeBlock(prev);
+		mergeWithNext(prev);
+		block = prev;
+	}
+
+	const uint32_t next = m_blocks[block].nextPhysical;
+	if (next != NONE && m_blocks[next].isFree)
+	{
+		removeFreeBlock(next);
+		mergeWithNext(block);
+	}
+
+	insertFreeBlock(block);
+}
+
+VkDeviceSize TLSFAllocator::getSize() const
+{
+	return m_size;
+}
+
+VkDeviceSize TLSFAllocator::getFreeSize() const
+{
+	return m_freeSize;
+}
+
+VkDeviceSize TLSFAllocator::getLargestFreeSize() const
+{
+	if (m_flBitmap == 0)
+		return 0;
+
+	const uint32_t fl = 63 - std::countl_zero(m_flBitmap);
+	const uint32_t sl = 31 - std::countl_zero(m_slBitmaps[fl]);
+
+	VkDeviceSize largest = 0;
+	for (uint32_t block = m_freeHeads[fl][sl]; block != NONE; block = m_blocks[block].nextFree)
+	{
+		if (m_blocks[block].size > largest)
+			largest = m_blocks[block].size;
+	}
+	return largest;
+}
+
+uint32_t TLSFAllocator::getFreeRangeCount() const
+{
+	return m_freeCount;
+}
+
+std::vector<std::pair<VkDeviceSize, VkDeviceSize>> TLSFAllocator::getFreeRanges() const
+{
+	std::vector<std::pair<VkDeviceSize, VkDeviceSize>> ranges;
+	ranges.reserve(m_freeCount);
+	for (const Block& block : m_blocks)
+	{
+		if (block.isFree)
+			ranges.emplace_back(block.offset, block.size);
+	}
+	std::ranges::sort(ranges);
+	return ranges;
+}
+
+void TLSFAllocator::mapping(const VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < SL_INDEX_COUNT)
+	{
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+		return;
+	}
+
+	const uint32_t msb = static_cast<uint32_t>(std::bit_width(size)) - 1;
+	sl = static_cast<uint32_t>(size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+	fl = msb - SL_INDEX_COUNT_LOG2 + 1;
+}
+
+void TLSFAllocator::mappingSearch(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	// Round up to the next second level class so that any block found in it is big enough
+	if (size >= SL_INDEX_COUNT)
+		size += (1ULL << (std::bit_width(size) - 1 - SL_INDEX_COUNT_LOG2)) - 1;
+
+	mapping(size, fl, sl);
+}
+
+uint32_t TLSFAllocator::findSuitableBlock(const VkDeviceSize size) const
+{
+	uint32_t fl, sl;
+	mappingSearch(size, fl, sl);
+	if (fl >= FL_INDEX_COUNT)
+		return NONE;
+
+	uint32_t slMap = m_slBitmaps[fl] & (~0U << sl);
+	if (slMap == 0)
+	{
+		const uint64_t flMap = fl + 1 < 64 ? m_flBitmap & (~0ULL << (fl + 1)) : 0;
+		if (flMap == 0)
+			return NONE;
+
+		fl = static_cast<uint32_t>(std::countr_zero(flMap));
+		slMap = m_slBitmaps[fl];
+	}
+	sl = static_cast<uint32_t>(std::countr_zero(slMap));
+	return m_freeHeads[fl][sl];
+}
+
+uint32_t TLSFAllocator::findFittingBlock(const VkDeviceSize size, const VkDeviceSize alignment) const
+{
+	// The rounded up search skips the classes that may hold blocks barely big enough (e.g. a request for the whole range),
+	// walk those few lists before reporting that nothing fits
+	uint32_t firstFl, firstSl, lastFl, lastSl;
+	mapping(size, firstFl, firstSl);
+	mapping(size + alignment - 1, lastFl, lastSl);
+	lastFl = std::min(lastFl, FL_INDEX_COUNT - 1);
+
+	for (uint32_t fl = firstFl; fl <= lastFl; fl++)
+	{
+		uint32_t slMap = m_slBitmaps[fl];
+		if (fl == firstFl)
+			slMap &= ~0U << firstSl;
+		while (slMap != 0)
+		{
+			const uint32_t sl = static_cast<uint32_t>(std::countr_zero(slMap));
+			slMap &= slMap - 1;
+			for (uint32_t block = m_freeHeads[fl][sl]; block != NONE; block = m_blocks[block].nextFree)
+			{
+				const VkDeviceSize offset = m_blocks[block].offset;
+				if ((offset + alignment - 1) / alignment * alignment - offset + size <= m_blocks[block].size)
+					return block;
+			}
+		}
+	}
+	return NONE;
+}
+
+uint32_t TLSFAllocator::createBlock(const VkDeviceSize offset, const VkDeviceSize size)
+{
+	uint32_t block;
+	if (!m_unusedBlocks.empty())
+	{
+		block = m_unusedBlocks.back();
+		m_unusedBlocks.pop_back();
+	}
+	else
+	{
+		block = static_cast<uint32_t>(m_blocks.size());
+		m_blocks.emplace_back();
+	}
+
+	m_blocks[block] = {};
+	m_blocks[block].offset = offset;
+	m_blocks[block].size = size;
+	return block;
+}
+
+void TLSFAllocator::releaseBlock(const uint32_t block)
+{
+	m_blocks[block] = {};
+	m_unusedBlocks.push_back(block);
+}
+
+void TLSFAllocator::insertFreeBlock(const uint32_t block)
+{
+	uint32_t fl, sl;
+	mapping(m_blocks[block].size, fl, sl);
+
+	const uint32_t head = m_freeHeads[fl][sl];
+	m_blocks[block].isFree = true;
+	m_blocks[block].prevFree = NONE;
+	m_blocks[block].nextFree = head;
+	if (head != NONE)
+		m_blocks[head].prevFree = block;
+	m_freeHeads[fl][sl] = block;
+
+	m_flBitmap |= 1ULL << fl;
+	m_slBitmaps[fl] |= 1U << sl;
+	m_freeCount++;
+}
+
+void TLSFAllocator::removeFreeBlock(const uint32_t block)
+{
+	uint32_t fl, sl;
+	mapping(m_blocks[block].size, fl, sl);
+
+	const uint32_t prev = m_blocks[block].prevFree;
+	const uint32_t next = m_blocks[block].nextFree;
+	if (prev != NONE)
+		m_blocks[prev].nextFree = next;
+	if (next != NONE)
+		m_blocks[next].prevFree = prev;
+
+	if (m_freeHeads[fl][sl] == block)
+	{
+		m_freeHeads[fl][sl] = next;
+		if (next == NONE)
+		{
+			m_slBitmaps[fl] &= ~(1U << sl);
+			if (m_slBitmaps[fl] == 0)
+				m_flBitmap &= ~(1ULL << fl);
+		}
+	}
+
+	m_blocks[block].isFree = false;
+	m_blocks[block].prevFree = NONE;
+	m_blocks[block].nextFree = NONE;
+	m_freeCount--;
+}
+
+void TLSFAllocator::mergeWithNext(const uint32_t block)
+{
+	const uint32_t next = m_blocks[block].nextPhysical;
+	const uint32_t nextNext = m_blocks[next].nextPhysical;
+
+	m_blocks[block].size += m_blocks[next].size;
+	m_blocks[block].nextPhysical = nextNext;
+	if (nextNext != NONE)
+		m_blocks[nextNext].prevPhysical = block;
+
+	releaseBlock(next);
+}
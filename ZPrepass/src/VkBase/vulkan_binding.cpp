@@ -13,7 +13,12 @@ uint32_t VulkanBinding::getStride() const
 
 void VulkanBinding::addAttribDescription(VkFormat format, uint32_t offset)
 {
-	m_attributes.emplace_back(static_cast<uint32_t>(m_attributes.size()), format, offset);
+	m_attributes.emplace_back(m_attributes.empty() ? 0 : m_attributes.back().location + 1, format, offset);
+}
+
+void VulkanBinding::addAttribDescription(const uint32_t location, const VkFormat format, const uint32_t offset)
+{
+	m_attributes.emplace_back(location, format, offset);
 }
 
 VulkanBinding::AttributeData::AttributeData(const uint32_t location, const VkFormat format, const uint32_t offset)
@@ -3,13 +3,12 @@
 #include <stdexcept>
 
 #include "logger.hpp"
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 
 VkMemoryRequirements VulkanBuffer::getMemoryRequirements() const
 {
 	VkMemoryRequirements memoryRequirements;
-	vkGetBufferMemoryRequirements(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, &memoryRequirements);
+	vkGetBufferMemoryRequirements(m_device->m_vkHandle, m_vkHandle, &memoryRequirements);
 	return memoryRequirements;
 }
 
@@ -17,7 +16,7 @@ void VulkanBuffer::allocateFromIndex(const uint32_t memoryIndex)
 {
 	Logger::pushContext("Buffer memory");
 	const VkMemoryRequirements requirements = getMemoryRequirements();
-	setBoundMemory(VulkanContext::getDevice(m_device).m_memoryAllocator.allocate(requirements.size, requirements.alignment, memoryIndex));
+	setBoundMemory(m_device->m_memoryAllocator.allocate(requirements.size, requirements.alignment, memoryIndex, {m_vkHandle, VK_NULL_HANDLE}));
 	Logger::popContext();
 }
 
@@ -25,7 +24,7 @@ void VulkanBuffer::allocateFromFlags(const VulkanMemoryAllocator::MemoryProperty
 {
 	Logger::pushContext("Buffer memory");
 	const VkMemoryRequirements requirements = getMemoryRequirements();
-	setBoundMemory(VulkanContext::getDevice(m_device).m_memoryAllocator.searchAndAllocate(requirements.size, requirements.alignment, memoryProperties, requirements.memoryTypeBits));
+	setBoundMemory(m_device->m_memoryAllocator.searchAndAllocate(requirements.size, requirements.alignment, memoryProperties, requirements.memoryTypeBits, false, {m_vkHandle, VK_NULL_HANDLE}));
 	Logger::popContext();
 }
 
@@ -44,22 +43,50 @@ VkDeviceSize VulkanBuffer::getSize() const
 	return m_size;
 }
 
+VkBufferUsageFlags VulkanBuffer::getUsage() const
+{
+	return m_usage;
+}
+
+uint32_t VulkanBuffer::getVersion() const
+{
+	return m_version;
+}
+
 void* VulkanBuffer::map(const VkDeviceSize size, const VkDeviceSize offset)
 {
-	void* data;
-	vkMapMemory(VulkanContext::getDevice(m_device).m_vkHandle, VulkanContext::getDevice(m_device).getMemoryHandle(m_memoryRegion.chunk), m_memoryRegion.offset + offset, size, 0, &data);
-	m_mappedData = data;
-	return data;
+	if (m_memoryRegion.size == 0)
+		throw std::runtime_error("Buffer " + std::to_string(m_id) + " has no memory bound to it");
+
+	if (size != VK_WHOLE_SIZE && offset + size > m_memoryRegion.size)
+		throw std::runtime_error("Mapped range is out of the bounds of buffer " + std::to_string(m_id));
+
+	// The chunk is persistently mapped by the allocator, mapping a buffer only resolves a pointer into it
+	void* data = m_device->m_memoryAllocator.getMappedData(m_memoryRegion);
+	if (data == nullptr)
+		throw std::runtime_error("Buffer " + std::to_string(m_id) + " is not bound to host visible memory");
+
+	m_mappedData = static_cast<char*>(data) + offset;
+	return m_mappedData;
 }
 
 void VulkanBuffer::unmap()
 {
-	vkUnmapMemory(VulkanContext::getDevice(m_device).m_vkHandle, VulkanContext::getDevice(m_device).getMemoryHandle(m_memoryRegion.chunk));
 	m_mappedData = nullptr;
 }
 
-VulkanBuffer::VulkanBuffer(const uint32_t device, const VkBuffer vkHandle, const VkDeviceSize size)
-	: m_device(device), m_size(size), m_vkHandle(vkHandle)
+void VulkanBuffer::flush(const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	m_device->m_memoryAllocator.flush(m_memoryRegion, size, offset);
+}
+
+void VulkanBuffer::invalidate(const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	m_device->m_memoryAllocator.invalidate(m_memoryRegion, size, offset);
+}
+
+VulkanBuffer::VulkanBuffer(VulkanDevice& device, const VkBuffer vkHandle, const VkDeviceSize size, const VkBufferUsageFlags usage)
+	: m_device(&device), m_size(size), m_usage(usage), m_vkHandle(vkHandle)
 {
 	Logger::print("Created buffer " + std::to_string(m_id) + " with size " + std::to_string(m_size));
 }
@@ -73,18 +100,18 @@ void VulkanBuffer::setBoundMemory(const MemoryChunk::MemoryBlock& memoryRegion)
 	m_memoryRegion = memoryRegion;
 
 	Logger::print("Bound memory to buffer " + std::to_string(m_id) + " with size " + std::to_string(m_memoryRegion.size) + " and offset " + std::to_string(m_memoryRegion.offset));
-	vkBindBufferMemory(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, VulkanContext::getDevice(m_device).getMemoryHandle(m_memoryRegion.chunk), m_memoryRegion.offset);
+	vkBindBufferMemory(m_device->m_vkHandle, m_vkHandle, m_device->getMemoryHandle(m_memoryRegion), m_memoryRegion.offset);
 }
 
 void VulkanBuffer::free()
 {
 	Logger::print("Freeing buffer " + std::to_string(m_id));
-	vkDestroyBuffer(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+	vkDestroyBuffer(m_device->m_vkHandle, m_vkHandle, nullptr);
 	m_vkHandle = VK_NULL_HANDLE;
 
 	if (m_memoryRegion.size > 0)
 	{
-		VulkanContext::getDevice(m_device).m_memoryAllocator.deallocate(m_memoryRegion);
+		m_device->m_memoryAllocator.deallocate(m_memoryRegion);
 		m_memoryRegion = {};
 	}
 }
@@ -0,0 +1,105 @@
+#include "vulkan_buffer_suballocator.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "logger.hpp"
+#include "vulkan_device.hpp"
+
+VulkanBufferRange VulkanBufferSuballocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+	if (size == 0)
+		throw std::runtime_error("Cannot suballocate an empty range from buffer suballocator " + std::to_string(m_id));
+
+	// A multiple of both, e.g. a 12 byte vertex stride in a buffer that also needs 4 byte aligned index ranges
+	const VkDeviceSize safeAlignment = std::lcm(std::max(alignment, static_cast<VkDeviceSize>(1)), m_minAlignment);
+	for (Block& block : m_blocks)
+	{
+		if (const std::optional<VkDeviceSize> offset = block.allocator.allocate(size, safeAlignment))
+			return {block.buffer, offset.value(), size};
+	}
+
+	// Ranges bigger than a block get a backing buffer of their own instead of failing
+	Block& block = createBlock(std::max(size, m_blockSize));
+	const std::optional<VkDeviceSize> offset = block.allocator.allocate(size, safeAlignment);
+	if (!offset.has_value())
+		throw std::runtime_error("Buffer suballocator " + std::to_string(m_id) + " failed to allocate " + std::to_string(size) + " bytes in a new block");
+
+	return {block.buffer, offset.value(), size};
+}
+
+void VulkanBufferSuballocator::deallocate(const VulkanBufferRange& range)
+{
+	for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it)
+	{
+		if (it->buffer != range.buffer)
+			continue;
+
+		it->allocator.deallocate(range.offset);
+
+		// The first block is kept around so that a suballocator that empties and refills every frame does not churn buffers
+		if (it != m_blocks.begin() && it->allocator.getFreeSize() == it->allocator.getSize())
+		{
+			Logger::print("Releasing empty block (buffer " + std::to_string(it->buffer.getID()) + ") of buffer suballocator " + std::to_string(m_id));
+			m_device->freeBuffer(it->buffer);
+			m_blocks.erase(it);
+		}
+		return;
+	}
+	throw std::runtime_error("Buffer " + std::to_string(range.buffer.getID()) + " does not belong to buffer suballocator " + std::to_string(m_id));
+}
+
+VkBufferUsageFlags VulkanBufferSuballocator::getUsage() const
+{
+	return m_usage;
+}
+
+VkDeviceSize VulkanBufferSuballocator::getBlockSize() const
+{
+	return m_blockSize;
+}
+
+uint32_t VulkanBufferSuballocator::getBufferCount() const
+{
+	return static_cast<uint32_t>(m_blocks.size());
+}
+
+VkDeviceSize VulkanBufferSuballocator::getUsedSize() const
+{
+	VkDeviceSize usedSize = 0;
+	for (const Block& block : m_blocks)
+		usedSize += block.allocator.getSize() - block.allocator.getFreeSize();
+	return usedSize;
+}
+
+void VulkanBufferSuballocator::free()
+{
+	if (m_blocks.empty())
+		return;
+
+	Logger::print("Freeing buffer suballocator " + std::to_string(m_id));
+	VulkanDevice& device = *m_device;
+	for (const Block& block : m_blocks)
+		device.freeBuffer(block.buffer);
+	m_blocks.clear();
+}
+
+VulkanBufferSuballocator::VulkanBufferSuballocator(VulkanDevice& device, const VkDeviceSize blockSize, const VkBufferUsageFlags usage, const VulkanMemoryAllocator::MemoryPropertyPreferences memoryProperties, const VkDeviceSize minAlignment)
+	: m_blockSize(blockSize), m_usage(usage), m_memoryProperties(memoryProperties), m_minAlignment(minAlignment), m_device(&device)
+{
+	Logger::print("Created buffer suballocator " + std::to_string(m_id) + " with blocks of " + std::to_string(m_blockSize) + " bytes");
+}
+
+VulkanBufferSuballocator::Block& VulkanBufferSuballocator::createBlock(const VkDeviceSize size)
+{
+	Logger::pushContext("Buffer suballocator block");
+	VulkanDevice& device = *m_device;
+	const Handle<VulkanBuffer> bufferID = device.createBuffer(size, m_usage);
+	device.getBuffer(bufferID).allocateFromFlags(m_memoryProperties);
+	Logger::popContext();
+
+	m_blocks.push_back({bufferID, TLSFAllocator(size)});
+	return m_blocks.back();
+}
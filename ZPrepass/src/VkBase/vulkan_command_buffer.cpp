@@ -1,11 +1,13 @@
 #include "vulkan_command_buffer.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 
+#include "command_stream.hpp"
 #include "vulkan_buffer.hpp"
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 #include "vulkan_sync.hpp"
 #include "vulkan_framebuffer.hpp"
@@ -26,6 +28,38 @@ void VulkanCommandBuffer::beginRecording(const VkCommandBufferUsageFlags flags)
 
 	vkBeginCommandBuffer(m_vkHandle, &beginInfo);
 
+	// Nothing is bound at the start of a recording
+	m_state = {};
+	m_isRecording = true;
+}
+
+void VulkanCommandBuffer::beginRecording(const Handle<VulkanRenderPass> renderPass, const uint32_t subpass, const Handle<VulkanFramebuffer> framebuffer, const VkCommandBufferUsageFlags flags)
+{
+	if (m_isRecording)
+	{
+		throw std::runtime_error("Command buffer is already recording");
+	}
+
+	if (!m_isSecondary)
+	{
+		throw std::runtime_error("Only secondary command buffers can continue a render pass");
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_device->getRenderPass(renderPass).m_vkHandle;
+	inheritanceInfo.subpass = subpass;
+	inheritanceInfo.framebuffer = framebuffer.isNull() ? VK_NULL_HANDLE : m_device->getFramebuffer(framebuffer).m_vkHandle;
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(m_vkHandle, &beginInfo);
+
+	// Secondary command buffers inherit no state from the primary one
+	m_state = {};
 	m_isRecording = true;
 }
 
@@ -41,35 +75,67 @@ void VulkanCommandBuffer::endRecording()
 	m_isRecording = false;
 }
 
-void VulkanCommandBuffer::cmdCopyBuffer(const uint32_t source, const uint32_t destination, const std::vector<VkBufferCopy>& copyRegions) const
+void VulkanCommandBuffer::cmdCopyBuffer(const Handle<VulkanBuffer> source, const Handle<VulkanBuffer> destination, const std::vector<VkBufferCopy>& copyRegions) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 	
-	VulkanDevice& device = VulkanContext::getDevice(m_device);
+	VulkanDevice& device = *m_device;
 	vkCmdCopyBuffer(m_vkHandle, device.getBuffer(source).m_vkHandle, device.getBuffer(destination).m_vkHandle, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
 }
 
-void VulkanCommandBuffer::cmdPushConstant(const uint32_t layout, const VkShaderStageFlags stageFlags, const uint32_t offset, const uint32_t size, const void* pValues) const
+void VulkanCommandBuffer::cmdPushConstant(const Handle<VulkanPipelineLayout> layout, const VkShaderStageFlags stageFlags, const uint32_t offset, const uint32_t size, const void* pValues) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
-	vkCmdPushConstants(m_vkHandle, VulkanContext::getDevice(m_device).getPipelineLayout(layout).m_vkHandle, stageFlags, offset, size, pValues);
+	if (m_trackState && trackPushConstant(layout, stageFlags, offset, size, pValues))
+	{
+		m_stateStatistics.elidedPushConstants++;
+		return;
+	}
+
+	vkCmdPushConstants(m_vkHandle, m_device->getPipelineLayout(layout).m_vkHandle, stageFlags, offset, size, pValues);
 }
 
-void VulkanCommandBuffer::submit(const VulkanQueue& queue, const std::vector<std::pair<uint32_t, VkSemaphoreWaitFlags>>& waitSemaphoreData, const std::vector<uint32_t>& signalSemaphores, const uint32_t fence) const
+bool VulkanCommandBuffer::trackPushConstant(const Handle<VulkanPipelineLayout> layout, const VkShaderStageFlags stageFlags, const uint32_t offset, const uint32_t size, const void* pValues) const
+{
+	if (layout != m_state.pushConstantLayout)
+	{
+		m_state.pushConstantStages.fill(0);
+		m_state.pushConstantLayout = layout;
+	}
+
+	// Ranges reaching past the tracked bytes are always pushed, the part that is tracked is no longer known
+	if (offset + size > MAX_TRACKED_PUSH_CONSTANT_SIZE)
+	{
+		if (offset < MAX_TRACKED_PUSH_CONSTANT_SIZE)
+			std::fill(m_state.pushConstantStages.begin() + offset, m_state.pushConstantStages.end(), 0);
+		return false;
+	}
+
+	const bool isCurrent = std::all_of(m_state.pushConstantStages.begin() + offset, m_state.pushConstantStages.begin() + offset + size, [stageFlags](const VkShaderStageFlags stages) { return stages == stageFlags; })
+		&& std::memcmp(m_state.pushConstants.data() + offset, pValues, size) == 0;
+	if (isCurrent)
+		return true;
+
+	std::memcpy(m_state.pushConstants.data() + offset, pValues, size);
+	std::fill_n(m_state.pushConstantStages.begin() + offset, size, stageFlags);
+	return false;
+}
+
+void VulkanCommandBuffer::submit(const VulkanQueue& queue, const std::vector<std::pair<Handle<VulkanSemaphore>, VkSemaphoreWaitFlags>>& waitSemaphoreData, const std::vector<Handle<VulkanSemaphore>>& signalSemaphores, const Handle<VulkanFence> fence) const
 {
 	if (m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is still recording");
 	}
 
-	VulkanDevice& device = VulkanContext::getDevice(m_device);
+	VulkanDevice& device = *m_device;
 
 	std::vector<VkSemaphore> waitSemaphores{};
 	std::vector<VkPipelineStageFlags> waitStages{};
@@ -98,7 +164,15 @@ void VulkanCommandBuffer::submit(const VulkanQueue& queue, const std::vector<std
 	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphoresVk.size());
 	submitInfo.pSignalSemaphores = signalSemaphoresVk.data();
 
-	vkQueueSubmit(queue.m_vkHandle, 1, &submitInfo, fence != UINT32_MAX ? device.getFence(fence).m_vkHandle : VK_NULL_HANDLE);
+	VkFence vkFence = VK_NULL_HANDLE;
+	if (!fence.isNull())
+	{
+		VulkanFence& fenceObj = device.getFence(fence);
+		device.trackSubmission(fenceObj);
+		vkFence = fenceObj.m_vkHandle;
+	}
+
+	vkQueueSubmit(queue.m_vkHandle, 1, &submitInfo, vkFence);
 }
 
 void VulkanCommandBuffer::reset() const
@@ -108,22 +182,25 @@ void VulkanCommandBuffer::reset() const
 		throw std::runtime_error("Command buffer is still recording");
 	}
 
-	vkResetCommandBuffer(m_vkHandle, 0);
+	if (m_ownsPool)
+		vkResetCommandPool(m_device->m_vkHandle, m_pool, 0);
+	else
+		vkResetCommandBuffer(m_vkHandle, 0);
 }
 
-void VulkanCommandBuffer::cmdBeginRenderPass(const uint32_t renderPass, const uint32_t frameBuffer, const VkExtent2D extent, const std::vector<VkClearValue>& clearValues) const
+void VulkanCommandBuffer::cmdBeginRenderPass(const Handle<VulkanRenderPass> renderPass, const Handle<VulkanFramebuffer> frameBuffer, const VkExtent2D extent, const std::vector<VkClearValue>& clearValues, const VkSubpassContents contents) const
 {
 	VkRenderPassBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	beginInfo.renderPass = VulkanContext::getDevice(m_device).getRenderPass(renderPass).m_vkHandle;
-	beginInfo.framebuffer = VulkanContext::getDevice(m_device).getFramebuffer(frameBuffer).m_vkHandle;
+	beginInfo.renderPass = m_device->getRenderPass(renderPass).m_vkHandle;
+	beginInfo.framebuffer = m_device->getFramebuffer(frameBuffer).m_vkHandle;
 	beginInfo.renderArea.offset = { 0, 0 };
 	beginInfo.renderArea.extent = extent;
 
     beginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	beginInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(m_vkHandle, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(m_vkHandle, &beginInfo, contents);
 }
 
 void VulkanCommandBuffer::cmdEndRenderPass() const
@@ -131,24 +208,79 @@ void VulkanCommandBuffer::cmdEndRenderPass() const
 	vkCmdEndRenderPass(m_vkHandle);
 }
 
-void VulkanCommandBuffer::cmdBindPipeline(const VkPipelineBindPoint bindPoint, const uint32_t pipelineID) const
+void VulkanCommandBuffer::cmdBindPipeline(const VkPipelineBindPoint bindPoint, const Handle<VulkanPipeline> pipeline) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
-	vkCmdBindPipeline(m_vkHandle, bindPoint, VulkanContext::getDevice(m_device).getPipeline(pipelineID).m_vkHandle);
+	const VulkanPipeline& pipelineObj = m_device->getPipeline(pipeline);
+	if (m_trackState && bindPoint < m_state.pipelines.size())
+	{
+		if (m_state.pipelines[bindPoint] == pipelineObj.m_vkHandle)
+		{
+			m_stateStatistics.elidedPipelineBinds++;
+			return;
+		}
+		m_state.pipelines[bindPoint] = pipelineObj.m_vkHandle;
+
+		// Viewport and scissor baked into the pipeline overwrite the dynamic values
+		if (!pipelineObj.hasDynamicState(VK_DYNAMIC_STATE_VIEWPORT))
+			m_state.viewport.reset();
+		if (!pipelineObj.hasDynamicState(VK_DYNAMIC_STATE_SCISSOR))
+			m_state.scissor.reset();
+
+		// Push constants only survive the bind for the layout they were pushed with
+		if (pipelineObj.m_layout != m_state.pushConstantLayout)
+		{
+			m_state.pushConstantStages.fill(0);
+			m_state.pushConstantLayout = pipelineObj.m_layout;
+		}
+	}
+
+	vkCmdBindPipeline(m_vkHandle, bindPoint, pipelineObj.m_vkHandle);
 }
 
-void VulkanCommandBuffer::cmdNextSubpass() const
+void VulkanCommandBuffer::cmdNextSubpass(const VkSubpassContents contents) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
-	vkCmdNextSubpass(m_vkHandle, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdNextSubpass(m_vkHandle, contents);
+}
+
+void VulkanCommandBuffer::cmdExecuteCommands(const std::vector<std::pair<Handle<VulkanCommandBuffer>, uint32_t>>& commandBuffers) const
+{
+	if (!m_isRecording)
+	{
+		throw std::runtime_error("Command buffer is not recording");
+	}
+
+	if (m_isSecondary)
+	{
+		throw std::runtime_error("Secondary command buffers can't execute other command buffers");
+	}
+
+	std::vector<VkCommandBuffer> vkCommandBuffers;
+	vkCommandBuffers.reserve(commandBuffers.size());
+	for (const auto& [handle, threadID] : commandBuffers)
+	{
+		const VulkanCommandBuffer& commandBuffer = m_device->getCommandBuffer(handle, threadID);
+		if (!commandBuffer.m_isSecondary)
+		{
+			throw std::runtime_error("Only secondary command buffers can be executed by another command buffer");
+		}
+		vkCommandBuffers.push_back(commandBuffer.m_vkHandle);
+	}
+
+	if (!vkCommandBuffers.empty())
+		vkCmdExecuteCommands(m_vkHandle, static_cast<uint32_t>(vkCommandBuffers.size()), vkCommandBuffers.data());
+
+	// Whatever the secondary buffers bound is now the state of this one
+	m_state = {};
 }
 
 void VulkanCommandBuffer::cmdPipelineBarrier(const VkPipelineStageFlags srcStageMask, const VkPipelineStageFlags dstStageMask, const VkDependencyFlags dependencyFlags, 
@@ -164,17 +296,34 @@ void VulkanCommandBuffer::cmdPipelineBarrier(const VkPipelineStageFlags srcStage
 	vkCmdPipelineBarrier(m_vkHandle, srcStageMask, dstStageMask, dependencyFlags, static_cast<uint32_t>(memoryBarriers.size()), memoryBarriers.data(), static_cast<uint32_t>(bufferMemoryBarriers.size()), bufferMemoryBarriers.data(), static_cast<uint32_t>(imageMemoryBarriers.size()), imageMemoryBarriers.data());
 }
 
-void VulkanCommandBuffer::cmdBindVertexBuffer(const uint32_t buffer, const VkDeviceSize offset) const
+void VulkanCommandBuffer::cmdBindVertexBuffer(const Handle<VulkanBuffer> buffer, const VkDeviceSize offset) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
-	vkCmdBindVertexBuffers(m_vkHandle, 0, 1, &VulkanContext::getDevice(m_device).getBuffer(buffer).m_vkHandle, &offset);
+	const VkBuffer vkBuffer = m_device->getBuffer(buffer).m_vkHandle;
+	if (m_trackState)
+	{
+		if (m_state.vertexBuffers[0] == vkBuffer && m_state.vertexOffsets[0] == offset)
+		{
+			m_stateStatistics.elidedVertexBufferBinds++;
+			return;
+		}
+		m_state.vertexBuffers[0] = vkBuffer;
+		m_state.vertexOffsets[0] = offset;
+	}
+
+	vkCmdBindVertexBuffers(m_vkHandle, 0, 1, &vkBuffer, &offset);
+}
+
+void VulkanCommandBuffer::cmdBindVertexBuffer(const VulkanBufferRange& range) const
+{
+	cmdBindVertexBuffer(range.buffer, range.offset);
 }
 
-void VulkanCommandBuffer::cmdBindVertexBuffers(const std::vector<uint32_t>& bufferIDs, const std::vector<VkDeviceSize>& offsets) const
+void VulkanCommandBuffer::cmdBindVertexBuffers(const std::vector<Handle<VulkanBuffer>>& buffers, const std::vector<VkDeviceSize>& offsets) const
 {
 	if (!m_isRecording)
 	{
@@ -182,22 +331,56 @@ void VulkanCommandBuffer::cmdBindVertexBuffers(const std::vector<uint32_t>& buff
 	}
 
 	std::vector<VkBuffer> vkBuffers;
-	vkBuffers.reserve(bufferIDs.size());
-	for (const auto& buffer : bufferIDs)
+	vkBuffers.reserve(buffers.size());
+	for (const auto& buffer : buffers)
 	{
-		vkBuffers.push_back(VulkanContext::getDevice(m_device).getBuffer(buffer).m_vkHandle);
+		vkBuffers.push_back(m_device->getBuffer(buffer).m_vkHandle);
 	}
+
+	if (m_trackState && vkBuffers.size() <= MAX_TRACKED_VERTEX_BINDINGS)
+	{
+		if (std::equal(vkBuffers.begin(), vkBuffers.end(), m_state.vertexBuffers.begin()) && std::equal(offsets.begin(), offsets.begin() + static_cast<std::ptrdiff_t>(vkBuffers.size()), m_state.vertexOffsets.begin()))
+		{
+			m_stateStatistics.elidedVertexBufferBinds++;
+			return;
+		}
+		std::ranges::copy(vkBuffers, m_state.vertexBuffers.begin());
+		std::copy_n(offsets.begin(), vkBuffers.size(), m_state.vertexOffsets.begin());
+	}
+	else if (m_trackState)
+	{
+		m_state.vertexBuffers.fill(VK_NULL_HANDLE);
+	}
+
 	vkCmdBindVertexBuffers(m_vkHandle, 0, static_cast<uint32_t>(vkBuffers.size()), vkBuffers.data(), offsets.data());
 }
 
-void VulkanCommandBuffer::cmdBindIndexBuffer(const uint32_t bufferID, const VkDeviceSize offset, const VkIndexType indexType) const
+void VulkanCommandBuffer::cmdBindIndexBuffer(const Handle<VulkanBuffer> buffer, const VkDeviceSize offset, const VkIndexType indexType) const
 {
 	if (!m_isRecording)
 	{
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
-	vkCmdBindIndexBuffer(m_vkHandle, VulkanContext::getDevice(m_device).getBuffer(bufferID).m_vkHandle, offset, indexType);
+	const VkBuffer vkBuffer = m_device->getBuffer(buffer).m_vkHandle;
+	if (m_trackState)
+	{
+		if (m_state.indexBuffer == vkBuffer && m_state.indexOffset == offset && m_state.indexType == indexType)
+		{
+			m_stateStatistics.elidedIndexBufferBinds++;
+			return;
+		}
+		m_state.indexBuffer = vkBuffer;
+		m_state.indexOffset = offset;
+		m_state.indexType = indexType;
+	}
+
+	vkCmdBindIndexBuffer(m_vkHandle, vkBuffer, offset, indexType);
+}
+
+void VulkanCommandBuffer::cmdBindIndexBuffer(const VulkanBufferRange& range, const VkIndexType indexType) const
+{
+	cmdBindIndexBuffer(range.buffer, range.offset, indexType);
 }
 
 void VulkanCommandBuffer::cmdSetViewport(const VkViewport& viewport) const
@@ -207,6 +390,16 @@ void VulkanCommandBuffer::cmdSetViewport(const VkViewport& viewport) const
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
+	if (m_trackState)
+	{
+		if (m_state.viewport.has_value() && std::memcmp(&m_state.viewport.value(), &viewport, sizeof(VkViewport)) == 0)
+		{
+			m_stateStatistics.elidedViewports++;
+			return;
+		}
+		m_state.viewport = viewport;
+	}
+
 	vkCmdSetViewport(m_vkHandle, 0, 1, &viewport);
 }
 
@@ -217,6 +410,16 @@ void VulkanCommandBuffer::cmdSetScissor(const VkRect2D scissor) const
 		throw std::runtime_error("Command buffer is not recording");
 	}
 
+	if (m_trackState)
+	{
+		if (m_state.scissor.has_value() && std::memcmp(&m_state.scissor.value(), &scissor, sizeof(VkRect2D)) == 0)
+		{
+			m_stateStatistics.elidedScissors++;
+			return;
+		}
+		m_state.scissor = scissor;
+	}
+
 	vkCmdSetScissor(m_vkHandle, 0, 1, &scissor);
 }
 
@@ -239,7 +442,89 @@ void VulkanCommandBuffer::cmdDrawIndexed(const uint32_t indexCount, const uint32
 	vkCmdDrawIndexed(m_vkHandle, indexCount, 1, firstIndex, vertexOffset, 0);
 }
 
-VulkanCommandBuffer::VulkanCommandBuffer(uint32_t device, const VkCommandBuffer commandBuffer, const bool isSecondary, const uint32_t familyIndex, const uint32_t threadID)
-	: m_vkHandle(commandBuffer), m_isSecondary(isSecondary), m_familyIndex(familyIndex), m_threadID(threadID), m_device(device)
+void VulkanCommandBuffer::cmdDrawIndexedInstanced(const uint32_t indexCount, const uint32_t instanceCount, const uint32_t firstIndex, const int32_t vertexOffset, const uint32_t firstInstance) const
+{
+	if (!m_isRecording)
+	{
+		throw std::runtime_error("Command buffer is not recording");
+	}
+	vkCmdDrawIndexed(m_vkHandle, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+
+void VulkanCommandBuffer::cmdReplay(const CommandStream& stream) const
+{
+	// Stage flags are passed through as they are
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::VERTEX_STAGE) == VK_SHADER_STAGE_VERTEX_BIT);
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::TESSELLATION_CONTROL_STAGE) == VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT);
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::TESSELLATION_EVALUATION_STAGE) == VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT);
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::GEOMETRY_STAGE) == VK_SHADER_STAGE_GEOMETRY_BIT);
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::FRAGMENT_STAGE) == VK_SHADER_STAGE_FRAGMENT_BIT);
+	static_assert(static_cast<VkShaderStageFlags>(CommandStream::COMPUTE_STAGE) == VK_SHADER_STAGE_COMPUTE_BIT);
+
+	// Vertex buffer binds go through vectors, reused for the whole stream
+	std::vector<Handle<VulkanBuffer>> vertexBuffers;
+	std::vector<VkDeviceSize> vertexOffsets;
+
+	struct Replayer
+	{
+		const VulkanCommandBuffer& commandBuffer;
+		std::vector<Handle<VulkanBuffer>>& vertexBuffers;
+		std::vector<VkDeviceSize>& vertexOffsets;
+
+		void operator()(const CommandStream::BindPipeline& command) const
+		{
+			commandBuffer.cmdBindPipeline(command.bindPoint == CommandStream::BindPoint::COMPUTE ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipeline);
+		}
+
+		void operator()(const CommandStream::BindIndexBuffer& command) const
+		{
+			commandBuffer.cmdBindIndexBuffer(command.buffer, command.offset, command.indexType == CommandStream::IndexType::UINT16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+		}
+
+		void operator()(const CommandStream::SetViewport& command) const
+		{
+			const CommandStream::Viewport& viewport = command.viewport;
+			commandBuffer.cmdSetViewport({viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth});
+		}
+
+		void operator()(const CommandStream::SetScissor& command) const
+		{
+			const CommandStream::Rect& scissor = command.scissor;
+			commandBuffer.cmdSetScissor({{scissor.x, scissor.y}, {scissor.width, scissor.height}});
+		}
+
+		void operator()(const CommandStream::PushConstant& command, const void* pValues) const { commandBuffer.cmdPushConstant(command.layout, command.stageFlags, command.offset, command.size, pValues); }
+		void operator()(const CommandStream::Draw& command) const { commandBuffer.cmdDraw(command.vertexCount, command.firstVertex); }
+		void operator()(const CommandStream::DrawIndexed& command) const { commandBuffer.cmdDrawIndexedInstanced(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance); }
+
+		void operator()(const CommandStream::BindVertexBuffers& command) const
+		{
+			if (command.count == 1)
+			{
+				commandBuffer.cmdBindVertexBuffer(command.buffers[0], command.offsets[0]);
+				return;
+			}
+			vertexBuffers.assign(command.buffers.begin(), command.buffers.begin() + command.count);
+			vertexOffsets.assign(command.offsets.begin(), command.offsets.begin() + command.count);
+			commandBuffer.cmdBindVertexBuffers(vertexBuffers, vertexOffsets);
+		}
+	};
+
+	stream.forEachCommand(Replayer{*this, vertexBuffers, vertexOffsets});
+}
+
+void VulkanCommandBuffer::setStateTracking(const bool enabled)
+{
+	m_trackState = enabled;
+	m_state = {};
+}
+
+VulkanCommandBuffer::StateStatistics VulkanCommandBuffer::getStateStatistics() const
+{
+	return m_stateStatistics;
+}
+
+VulkanCommandBuffer::VulkanCommandBuffer(VulkanDevice& device, const VkCommandBuffer commandBuffer, const VkCommandPool pool, const bool isSecondary, const uint32_t familyIndex, const uint32_t threadID, const bool ownsPool)
+	: m_vkHandle(commandBuffer), m_pool(pool), m_isSecondary(isSecondary), m_ownsPool(ownsPool), m_familyIndex(familyIndex), m_threadID(threadID), m_device(&device)
 {
 }
@@ -1,5 +1,6 @@
 #include "vulkan_context.hpp"
 
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 
@@ -62,6 +63,22 @@ std::vector<VulkanGPU> VulkanContext::getGPUs()
 	return gpus;
 }
 
+bool VulkanContext::isInstanceExtensionSupported(const char* extension)
+{
+	uint32_t extensionCount;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+	for (const VkExtensionProperties& availableExtension : extensions)
+	{
+		if (strcmp(availableExtension.extensionName, extension) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 uint32_t VulkanContext::createDevice(const VulkanGPU gpu, const QueueFamilySelector& queues, const std::vector<const char*>& extensions, const VkPhysicalDeviceFeatures& features)
 {
 	VkDeviceCreateInfo deviceCreateInfo{};
@@ -110,17 +127,17 @@ uint32_t VulkanContext::createDevice(const VulkanGPU gpu, const QueueFamilySelec
 		throw std::runtime_error(std::string("Failed to create logical device, error: ") + string_VkResult(res));
 	}
 
-	m_devices.push_back({gpu, device});
-	return m_devices.back().getID();
+	m_devices.push_back(std::unique_ptr<VulkanDevice>(new VulkanDevice(gpu, device, extensions)));
+	return m_devices.back()->getID();
 }
 
 VulkanDevice& VulkanContext::getDevice(const uint32_t index)
 {
-	for (auto& device : m_devices)
+	for (const auto& device : m_devices)
 	{
-		if (device.getID() == index)
+		if (device->getID() == index)
 		{
-			return device;
+			return *device;
 		}
 	}
 
@@ -131,7 +148,7 @@ void VulkanContext::freeDevice(const uint32_t index)
 {
 	for (auto it = m_devices.begin(); it != m_devices.end(); ++it)
 	{
-		if (it->getID() == index)
+		if ((*it)->getID() == index)
 		{
 			m_devices.erase(it);
 			break;
@@ -146,9 +163,9 @@ void VulkanContext::freeDevice(const VulkanDevice& device)
 
 void VulkanContext::free()
 {
-	for (auto& device : m_devices)
+	for (const auto& device : m_devices)
 	{
-		device.free();
+		device->free();
 	}
 	m_devices.clear();
 
@@ -1,7 +1,10 @@
 #include "vulkan_device.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 #include <ranges>
+#include <set>
 #include <stdexcept>
 
 #include "logger.hpp"
@@ -23,83 +26,66 @@ const VulkanMemoryAllocator& VulkanDevice::getMemoryAllocator() const
 	return m_memoryAllocator;
 }
 
-uint32_t VulkanDevice::getStagingBufferSemaphore() const
+Handle<VulkanSemaphore> VulkanDevice::getStagingBufferSemaphore() const
 {
 	return m_stagingSemaphore;
 }
 
-void VulkanDevice::configureOneTimeQueue(const QueueSelection queue)
+bool VulkanDevice::isExtensionEnabled(const std::string& extension) const
 {
-	m_oneTimeQueue = queue;
+	return m_enabledExtensions.contains(extension);
 }
 
-void VulkanDevice::initializeOneTimeCommandPool(const uint32_t threadID)
+void VulkanDevice::configureOneTimeQueue(const QueueSelection queue)
 {
-	if (!m_threadCommandInfos.contains(threadID))
-	{
-		m_threadCommandInfos[threadID] = {};
-	}
-	ThreadCommandInfo& threadInfo = m_threadCommandInfos[threadID];
-
-	if (threadInfo.oneTimePool != VK_NULL_HANDLE) return;
-	
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = m_oneTimeQueue.familyIndex;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	if (vkCreateCommandPool(m_vkHandle, &poolInfo, nullptr, &threadInfo.oneTimePool) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create command pool");
-	}
+	m_oneTimeQueue = queue;
 }
 
 void VulkanDevice::initializeCommandPool(const QueueFamily& family, const uint32_t threadID, const bool createSecondary)
 {
-	if (!m_threadCommandInfos.contains(threadID))
-	{
-		m_threadCommandInfos[threadID] = {};
-	}
+	ThreadCommandInfo::CommandPoolInfo& poolInfo = getThreadCommandInfo(threadID).commandPools[family.index];
 
-	ThreadCommandInfo& threadInfo = m_threadCommandInfos[threadID];
-	if (!threadInfo.commandPools.contains(family.index))
-	{
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = family.index;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	VkCommandPoolCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	createInfo.queueFamilyIndex = family.index;
+	createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-		if (vkCreateCommandPool(m_vkHandle, &poolInfo, nullptr, &threadInfo.commandPools[family.index].pool) != VK_SUCCESS)
+	if (poolInfo.pool == VK_NULL_HANDLE)
+	{
+		if (vkCreateCommandPool(m_vkHandle, &createInfo, nullptr, &poolInfo.pool) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create command pool");
 		}
 		Logger::print("Created main command pool for thread " + std::to_string(threadID) + " and family " + std::to_string(family.index));
+	}
 
-		if (createSecondary)
+	// The secondary pool may be requested long after the main one, e.g. once a thread starts recording in parallel
+	if (createSecondary && poolInfo.secondaryPool == VK_NULL_HANDLE)
+	{
+		if (vkCreateCommandPool(m_vkHandle, &createInfo, nullptr, &poolInfo.secondaryPool) != VK_SUCCESS)
 		{
-			if (vkCreateCommandPool(m_vkHandle, &poolInfo, nullptr, &threadInfo.commandPools[family.index].secondaryPool) != VK_SUCCESS)
-			{
-				throw std::runtime_error("Failed to create secondary command pool");
-			}
-			Logger::print("Created secondary command pool for thread " + std::to_string(threadID) + " and family " + std::to_string(family.index));
+			throw std::runtime_error("Failed to create secondary command pool");
 		}
+		Logger::print("Created secondary command pool for thread " + std::to_string(threadID) + " and family " + std::to_string(family.index));
 	}
 }
 
-uint32_t VulkanDevice::createCommandBuffer(const QueueFamily& family, const uint32_t threadID, const bool isSecondary)
+Handle<VulkanCommandBuffer> VulkanDevice::createCommandBuffer(const QueueFamily& family, const uint32_t threadID, const bool isSecondary)
 {
 	initializeCommandPool(family, threadID, isSecondary);
 
+	ThreadCommandInfo::CommandPoolInfo& poolInfo = getThreadCommandInfo(threadID).commandPools[family.index];
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	if (isSecondary)
 	{
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-		allocInfo.commandPool = m_threadCommandInfos[threadID].commandPools[family.index].secondaryPool;
+		allocInfo.commandPool = poolInfo.secondaryPool;
 	}
 	else
 	{
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = m_threadCommandInfos[threadID].commandPools[family.index].pool;
+		allocInfo.commandPool = poolInfo.pool;
 	}
 	allocInfo.commandBufferCount = 1;
 
@@ -110,78 +96,178 @@ uint32_t VulkanDevice::createCommandBuffer(const QueueFamily& family, const uint
 	}
 	Logger::print("Allocated command buffer for thread " + std::to_string(threadID) + " and family " + std::to_string(family.index));
 
-	if (!m_commandBuffers.contains(threadID))
+	return getThreadCommandBuffers(threadID).insert({*this, commandBuffer, allocInfo.commandPool, isSecondary, family.index, threadID});
+}
+
+Handle<VulkanCommandBuffer> VulkanDevice::createRecordOnceCommandBuffer(const QueueFamily& family, const uint32_t threadID)
+{
+	// No reset flag, the driver does not have to keep per buffer reset state for a pool that is only ever reset as a whole
+	VkCommandPoolCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	createInfo.queueFamilyIndex = family.index;
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(m_vkHandle, &createInfo, nullptr, &pool) != VK_SUCCESS)
 	{
-		m_commandBuffers[threadID] = {};
+		throw std::runtime_error("Failed to create record once command pool");
 	}
 
-	m_commandBuffers[threadID].push_back({m_id, commandBuffer, isSecondary, family.index, threadID});
-	return m_commandBuffers[threadID].back().getID();
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(m_vkHandle, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		vkDestroyCommandPool(m_vkHandle, pool, nullptr);
+		throw std::runtime_error("Failed to allocate command buffer");
+	}
+	Logger::print("Allocated record once command buffer for thread " + std::to_string(threadID) + " and family " + std::to_string(family.index));
+
+	return getThreadCommandBuffers(threadID).insert({*this, commandBuffer, pool, false, family.index, threadID, true});
 }
 
-uint32_t VulkanDevice::createOneTimeCommandBuffer(uint32_t threadID)
+Handle<VulkanCommandBuffer> VulkanDevice::getOrCreateCommandBuffer(const QueueFamily& family, const uint32_t threadID, const uint32_t frameIndex, const bool isSecondary)
 {
-	initializeOneTimeCommandPool(threadID);
+	ThreadCommandInfo::FramePoolInfo& poolInfo = getThreadCommandInfo(threadID).framePools[{family.index, frameIndex}];
+	if (poolInfo.pool == VK_NULL_HANDLE)
+	{
+		// No reset bit, buffers of the pool are only ever reset all at once
+		VkCommandPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		createInfo.queueFamilyIndex = family.index;
+		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(m_vkHandle, &createInfo, nullptr, &poolInfo.pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create frame command pool");
+		}
+		Logger::print("Created frame command pool for thread " + std::to_string(threadID) + ", family " + std::to_string(family.index) + " and frame " + std::to_string(frameIndex));
+	}
+
+	std::vector<Handle<VulkanCommandBuffer>>& buffers = isSecondary ? poolInfo.secondaryBuffers : poolInfo.primaryBuffers;
+	uint32_t& usedBuffers = isSecondary ? poolInfo.usedSecondaryBuffers : poolInfo.usedPrimaryBuffers;
+	if (usedBuffers < buffers.size())
+		return buffers[usedBuffers++];
 
 	VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = m_threadCommandInfos[threadID].oneTimePool;
-    allocInfo.commandBufferCount = 1;
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = isSecondary ? VK_COMMAND_BUFFER_LEVEL_SECONDARY : VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = poolInfo.pool;
+	allocInfo.commandBufferCount = 1;
 
 	VkCommandBuffer commandBuffer;
 	if (vkAllocateCommandBuffers(m_vkHandle, &allocInfo, &commandBuffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to allocate command buffer");
 	}
-	Logger::print("Allocated one time command buffer for thread " + std::to_string(threadID));
 
-	if (!m_commandBuffers.contains(threadID))
+	buffers.push_back(getThreadCommandBuffers(threadID).insert({*this, commandBuffer, poolInfo.pool, isSecondary, family.index, threadID}));
+	usedBuffers++;
+	return buffers.back();
+}
+
+void VulkanDevice::resetFrameCommandPools(const uint32_t threadID, const uint32_t frameIndex)
+{
+	VulkanSlotMap<VulkanCommandBuffer>& commandBuffers = getThreadCommandBuffers(threadID);
+	for (auto& [key, poolInfo] : getThreadCommandInfo(threadID).framePools)
 	{
-		m_commandBuffers[threadID] = {};
-	}
+		if (key.second != frameIndex || poolInfo.usedPrimaryBuffers + poolInfo.usedSecondaryBuffers == 0)
+			continue;
 
-	m_commandBuffers[threadID].push_back({m_id, commandBuffer, false, m_oneTimeQueue.familyIndex, threadID});
-	return m_commandBuffers[threadID].back().getID();
+		vkResetCommandPool(m_vkHandle, poolInfo.pool, 0);
+
+		// A buffer abandoned mid recording is back to the initial state as well
+		for (uint32_t i = 0; i < poolInfo.usedPrimaryBuffers; i++)
+			commandBuffers.get(poolInfo.primaryBuffers[i]).m_isRecording = false;
+		for (uint32_t i = 0; i < poolInfo.usedSecondaryBuffers; i++)
+			commandBuffers.get(poolInfo.secondaryBuffers[i]).m_isRecording = false;
+
+		poolInfo.usedPrimaryBuffers = 0;
+		poolInfo.usedSecondaryBuffers = 0;
+	}
 }
 
-uint32_t VulkanDevice::getOrCreateCommandBuffer(const QueueFamily& family, const uint32_t threadID, const bool isSecondary)
+VulkanCommandBuffer& VulkanDevice::getCommandBuffer(const Handle<VulkanCommandBuffer> handle, const uint32_t threadID)
 {
-	for (const VulkanCommandBuffer& buffer : m_commandBuffers[threadID])
-		if (buffer.m_familyIndex == family.index && buffer.m_threadID == threadID && buffer.m_isSecondary == isSecondary)
-			return buffer.getID();
+	return getThreadCommandBuffers(threadID).get(handle);
+}
 
-	return createCommandBuffer(family, threadID, isSecondary);
+VulkanSlotMap<VulkanCommandBuffer>& VulkanDevice::getThreadCommandBuffers(const uint32_t threadID)
+{
+	std::scoped_lock lock(m_commandPoolMutex);
+	return m_commandBuffers.try_emplace(threadID, "Command buffer").first->second;
 }
 
-VulkanCommandBuffer& VulkanDevice::getCommandBuffer(const uint32_t id, const uint32_t threadID)
+VulkanCommandBuffer& VulkanDevice::getImmediateCommandBuffer(const uint32_t familyIndex, const uint32_t threadID)
 {
-	for (VulkanCommandBuffer& buffer : m_commandBuffers[threadID])
-		if (buffer.m_id == id)
-			return buffer;
+	ThreadCommandInfo::ImmediatePoolInfo& poolInfo = getThreadCommandInfo(threadID).immediatePools[familyIndex];
+	if (poolInfo.pool == VK_NULL_HANDLE)
+	{
+		// Holds a single short lived buffer, the whole pool is reset instead of the buffer
+		VkCommandPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		createInfo.queueFamilyIndex = familyIndex;
+		createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(m_vkHandle, &createInfo, nullptr, &poolInfo.pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create immediate command pool");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = poolInfo.pool;
+		allocInfo.commandBufferCount = 1;
 
-	throw std::runtime_error("Command buffer not found");
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_vkHandle, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate command buffer");
+		}
+		Logger::print("Created immediate command pool for thread " + std::to_string(threadID) + " and family " + std::to_string(familyIndex));
+
+		poolInfo.buffer = getThreadCommandBuffers(threadID).insert({*this, commandBuffer, poolInfo.pool, false, familyIndex, threadID});
+		return getCommandBuffer(poolInfo.buffer, threadID);
+	}
+
+	// Every user waits for its submission to finish, the buffer is never pending here
+	VulkanCommandBuffer& commandBuffer = getCommandBuffer(poolInfo.buffer, threadID);
+	if (commandBuffer.m_isRecording)
+	{
+		throw std::runtime_error("Immediate command buffer is still recording");
+	}
+	vkResetCommandPool(m_vkHandle, poolInfo.pool, 0);
+	return commandBuffer;
+}
+
+VulkanDevice::ThreadCommandInfo& VulkanDevice::getThreadCommandInfo(const uint32_t threadID)
+{
+	// Only the map itself is shared, the pools inside belong to the thread that owns the ID
+	std::scoped_lock lock(m_commandPoolMutex);
+	return m_threadCommandInfos[threadID];
 }
 
 void VulkanDevice::freeCommandBuffer(const VulkanCommandBuffer& commandBuffer, const uint32_t threadID)
 {
-	freeCommandBuffer(commandBuffer.m_id, threadID);
+	freeCommandBuffer(Handle{commandBuffer}, threadID);
 }
 
-void VulkanDevice::freeCommandBuffer(const uint32_t id, const uint32_t threadID)
+void VulkanDevice::freeCommandBuffer(const Handle<VulkanCommandBuffer> handle, const uint32_t threadID)
 {
-	for (auto it = m_commandBuffers[threadID].begin(); it != m_commandBuffers[threadID].end(); ++it)
+	VulkanSlotMap<VulkanCommandBuffer>& commandBuffers = getThreadCommandBuffers(threadID);
+	if (const VulkanCommandBuffer* commandBuffer = commandBuffers.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			vkFreeCommandBuffers(m_vkHandle, m_threadCommandInfos[it->m_threadID].commandPools[it->m_familyIndex].pool, 1, &it->m_vkHandle);
-			m_commandBuffers[threadID].erase(it);
-			break;
-		}
+		if (commandBuffer->m_ownsPool)
+			vkDestroyCommandPool(m_vkHandle, commandBuffer->m_pool, nullptr);
+		else
+			vkFreeCommandBuffers(m_vkHandle, commandBuffer->m_pool, 1, &commandBuffer->m_vkHandle);
+		commandBuffers.erase(handle);
 	}
 }
 
-uint32_t VulkanDevice::createFramebuffer(const VkExtent3D size, const VulkanRenderPass& renderPass, const std::vector<VkImageView>& attachments)
+Handle<VulkanFramebuffer> VulkanDevice::createFramebuffer(const VkExtent3D size, const VulkanRenderPass& renderPass, const std::vector<VkImageView>& attachments)
 {
 	VkFramebufferCreateInfo framebufferInfo{};
 	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -198,42 +284,25 @@ uint32_t VulkanDevice::createFramebuffer(const VkExtent3D size, const VulkanRend
 		throw std::runtime_error("Failed to create framebuffer");
 	}
 
-	m_framebuffers.push_back({m_id, framebuffer});
-	return m_framebuffers.back().getID();
+	return m_framebuffers.insert({*this, framebuffer});
 }
 
-VulkanFramebuffer& VulkanDevice::getFramebuffer(const uint32_t id)
+VulkanFramebuffer& VulkanDevice::getFramebuffer(const Handle<VulkanFramebuffer> handle)
 {
-	for (auto& framebuffer : m_framebuffers)
-	{
-		if (framebuffer.getID() == id)
-		{
-			return framebuffer;
-		}
-	}
-
-	throw std::runtime_error("Framebuffer not found");
+	return m_framebuffers.get(handle);
 }
 
-void VulkanDevice::freeFramebuffer(const uint32_t id)
+void VulkanDevice::freeFramebuffer(const Handle<VulkanFramebuffer> handle)
 {
-	for (auto it = m_framebuffers.begin(); it != m_framebuffers.end(); ++it)
-	{
-		if (it->getID() == id)
-		{
-			it->free();
-			m_framebuffers.erase(it);
-			break;
-		}
-	}
+	deferFree(m_framebuffers, handle);
 }
 
 void VulkanDevice::freeFramebuffer(const VulkanFramebuffer& framebuffer)
 {
-	freeFramebuffer(framebuffer.getID());
+	freeFramebuffer(Handle{framebuffer});
 }
 
-uint32_t VulkanDevice::createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage)
+Handle<VulkanBuffer> VulkanDevice::createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage)
 {
 	
 	VkBufferCreateInfo bufferInfo{};
@@ -249,43 +318,149 @@ uint32_t VulkanDevice::createBuffer(const VkDeviceSize size, const VkBufferUsage
 		throw std::runtime_error("Failed to create buffer");
 	}
 
-	m_buffers.push_back({m_id, buffer, size});
+	const Handle<VulkanBuffer> handle = m_buffers.insert({*this, buffer, size, usage});
+
+	Logger::print("Created buffer with id " + std::to_string(handle.getID()) + " and size " + std::to_string(size));
+	return handle;
+}
+
+VulkanBuffer& VulkanDevice::getBuffer(const Handle<VulkanBuffer> handle)
+{
+	return m_buffers.get(handle);
+}
 
-	Logger::print("Created buffer with id " + std::to_string(m_buffers.back().getID()) + " and size " + std::to_string(m_buffers.back().getSize()));
-	return m_buffers.back().getID();
+void VulkanDevice::freeBuffer(const Handle<VulkanBuffer> handle)
+{
+	deferFree(m_buffers, handle);
 }
 
-VulkanBuffer& VulkanDevice::getBuffer(const uint32_t id)
+void VulkanDevice::freeBuffer(const VulkanBuffer& buffer)
 {
-	for (auto& buffer : m_buffers)
+	freeBuffer(Handle{buffer});
+}
+
+Handle<VulkanFrameAllocator> VulkanDevice::createFrameAllocator(const VkDeviceSize frameSize, const uint32_t frameCount, const VkBufferUsageFlags usage)
+{
+	if (frameSize == 0 || frameCount == 0)
+		throw std::runtime_error("Frame allocator needs a non zero frame size and frame count");
+
+	// Every region has to start at an offset that is valid for any kind of binding the buffer may be used for
+	const VkPhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
+	const VkDeviceSize regionAlignment = std::max({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, limits.minTexelBufferOffsetAlignment, limits.nonCoherentAtomSize, static_cast<VkDeviceSize>(1)});
+	const VkDeviceSize frameStride = (frameSize + regionAlignment - 1) / regionAlignment * regionAlignment;
+
+	Logger::pushContext("Frame allocator");
+	const Handle<VulkanBuffer> bufferID = createBuffer(frameStride * frameCount, usage);
+	VulkanBuffer& buffer = getBuffer(bufferID);
+	buffer.allocateFromFlags({VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, true});
+	void* mappedData = buffer.map(buffer.getSize(), 0);
+	Logger::popContext();
+
+	return m_frameAllocators.insert({*this, bufferID, frameSize, frameStride, frameCount, mappedData});
+}
+
+VulkanFrameAllocator& VulkanDevice::getFrameAllocator(const Handle<VulkanFrameAllocator> handle)
+{
+	return m_frameAllocators.get(handle);
+}
+
+void VulkanDevice::freeFrameAllocator(const Handle<VulkanFrameAllocator> handle)
+{
+	if (VulkanFrameAllocator* allocator = m_frameAllocators.find(handle))
 	{
-		if (buffer.m_id == id)
-		{
-			return buffer;
-		}
+		allocator->free();
+		m_frameAllocators.erase(handle);
 	}
-	throw std::runtime_error("Buffer not found");
 }
 
-void VulkanDevice::freeBuffer(const uint32_t id)
+void VulkanDevice::freeFrameAllocator(const VulkanFrameAllocator& allocator)
 {
-	for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it)
+	freeFrameAllocator(Handle{allocator});
+}
+
+Handle<VulkanFrameRing> VulkanDevice::createFrameRing(const QueueFamily& family, const uint32_t threadID, const uint32_t frameCount, const VkDeviceSize transientFrameSize, const VkBufferUsageFlags transientUsage)
+{
+	if (frameCount == 0 || frameCount > VulkanFrameRing::MAX_FRAMES_IN_FLIGHT)
+		throw std::runtime_error("Frame ring needs between 1 and " + std::to_string(VulkanFrameRing::MAX_FRAMES_IN_FLIGHT) + " frames in flight, " + std::to_string(frameCount) + " requested");
+
+	Logger::pushContext("Frame ring");
+	std::vector<VulkanFrameRing::FrameContext> frames(frameCount);
+	for (VulkanFrameRing::FrameContext& frame : frames)
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_buffers.erase(it);
-			break;
-		}
+		frame.imageAvailableSemaphore = createSemaphore();
+		frame.renderFinishedSemaphore = createSemaphore();
+		// Signaled so that the first wait on every frame returns right away
+		frame.inFlightFence = createFence(true);
 	}
+
+	Handle<VulkanFrameAllocator> transientAllocator{};
+	if (transientFrameSize > 0)
+		transientAllocator = createFrameAllocator(transientFrameSize, frameCount, transientUsage);
+	Logger::popContext();
+
+	return m_frameRings.insert({*this, std::move(frames), transientAllocator, family, threadID});
 }
 
-void VulkanDevice::freeBuffer(const VulkanBuffer& buffer)
+VulkanFrameRing& VulkanDevice::getFrameRing(const Handle<VulkanFrameRing> handle)
 {
-	freeBuffer(buffer.m_id);
+	return m_frameRings.get(handle);
 }
 
-uint32_t VulkanDevice::createImage(const VkImageType type, const VkFormat format, const VkExtent3D extent, const VkImageUsageFlags usage, const VkImageCreateFlags flags)
+void VulkanDevice::freeFrameRing(const Handle<VulkanFrameRing> handle)
+{
+	if (VulkanFrameRing* ring = m_frameRings.find(handle))
+	{
+		ring->free();
+		m_frameRings.erase(handle);
+	}
+}
+
+void VulkanDevice::freeFrameRing(const VulkanFrameRing& ring)
+{
+	freeFrameRing(Handle{ring});
+}
+
+Handle<VulkanBufferSuballocator> VulkanDevice::createBufferSuballocator(const VkDeviceSize blockSize, const VkBufferUsageFlags usage, const VulkanMemoryAllocator::MemoryPropertyPreferences memoryProperties)
+{
+	if (blockSize == 0)
+		throw std::runtime_error("Buffer suballocator needs a non zero block size");
+
+	// Ranges have to start at offsets that are valid for every kind of binding the backing buffers allow
+	const VkPhysicalDeviceLimits limits = m_physicalDevice.getProperties().limits;
+	VkDeviceSize minAlignment = 1;
+	const auto requireAlignment = [&minAlignment](const VkDeviceSize alignment) { minAlignment = std::lcm(minAlignment, std::max(alignment, static_cast<VkDeviceSize>(1))); };
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		requireAlignment(limits.minUniformBufferOffsetAlignment);
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		requireAlignment(limits.minStorageBufferOffsetAlignment);
+	if (usage & (VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT))
+		requireAlignment(limits.minTexelBufferOffsetAlignment);
+	if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+		requireAlignment(sizeof(uint32_t));
+
+	return m_bufferSuballocators.insert({*this, blockSize, usage, memoryProperties, minAlignment});
+}
+
+VulkanBufferSuballocator& VulkanDevice::getBufferSuballocator(const Handle<VulkanBufferSuballocator> handle)
+{
+	return m_bufferSuballocators.get(handle);
+}
+
+void VulkanDevice::freeBufferSuballocator(const Handle<VulkanBufferSuballocator> handle)
+{
+	if (VulkanBufferSuballocator* suballocator = m_bufferSuballocators.find(handle))
+	{
+		suballocator->free();
+		m_bufferSuballocators.erase(handle);
+	}
+}
+
+void VulkanDevice::freeBufferSuballocator(const VulkanBufferSuballocator& suballocator)
+{
+	freeBufferSuballocator(Handle{suballocator});
+}
+
+Handle<VulkanImage> VulkanDevice::createImage(const VkImageType type, const VkFormat format, const VkExtent3D extent, const VkImageUsageFlags usage, const VkImageCreateFlags flags)
 {
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -309,45 +484,29 @@ uint32_t VulkanDevice::createImage(const VkImageType type, const VkFormat format
 		throw std::runtime_error("Failed to create image");
 	}
 
-	m_images.push_back({m_id, image, extent, type, VK_IMAGE_LAYOUT_UNDEFINED});
-	Logger::print("Created image with id " + std::to_string(m_images.back().getID()));
-	return m_images.back().getID();
+	const Handle<VulkanImage> handle = m_images.insert({*this, image, extent, type, VK_IMAGE_LAYOUT_UNDEFINED});
+	Logger::print("Created image with id " + std::to_string(handle.getID()));
+	return handle;
 }
 
-VulkanImage& VulkanDevice::getImage(const uint32_t id)
+VulkanImage& VulkanDevice::getImage(const Handle<VulkanImage> handle)
 {
-	for (VulkanImage& image : m_images)
-	{
-		if (image.m_id == id)
-		{
-			return image;
-		}
-	}
-
-	throw std::runtime_error("Image not found");
+	return m_images.get(handle);
 }
 
-void VulkanDevice::freeImage(const uint32_t id)
+void VulkanDevice::freeImage(const Handle<VulkanImage> handle)
 {
-	for (auto it = m_images.begin(); it != m_images.end(); ++it)
-	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_images.erase(it);
-			break;
-		}
-	}
+	deferFree(m_images, handle);
 }
 
 void VulkanDevice::freeImage(const VulkanImage& image)
 {
-	freeImage(image.m_id);
+	freeImage(Handle{image});
 }
 
 void VulkanDevice::configureStagingBuffer(const VkDeviceSize size, const QueueSelection& queue, const bool forceAllowStagingMemory)
 {
-	if (m_stagingBufferInfo.stagingBuffer != UINT32_MAX)
+	if (!m_stagingBufferInfo.stagingBuffer.isNull())
 	{
 		throw std::runtime_error("Staging buffer already configured! Reconfiguration is not implemented yet TvT");
 	}
@@ -381,24 +540,27 @@ void VulkanDevice::unmapStagingBuffer()
 	getBuffer(m_stagingBufferInfo.stagingBuffer).unmap();
 }
 
-void VulkanDevice::dumpStagingBuffer(const uint32_t buffer, const VkDeviceSize size, const VkDeviceSize offset, const uint32_t threadID)
+void VulkanDevice::dumpStagingBuffer(const Handle<VulkanBuffer> buffer, const VkDeviceSize size, const VkDeviceSize offset, const uint32_t threadID)
 {
 	dumpStagingBuffer(buffer, {{offset, 0, size}}, threadID);
 }
 
-void VulkanDevice::dumpStagingBuffer(const uint32_t buffer, const std::vector<VkBufferCopy>& regions, const uint32_t threadID)
+void VulkanDevice::dumpStagingBuffer(const Handle<VulkanBuffer> buffer, const std::vector<VkBufferCopy>& regions, const uint32_t threadID)
 {
 	VulkanBuffer& stagingBuffer = getBuffer(m_stagingBufferInfo.stagingBuffer);
 	if (stagingBuffer.m_vkHandle == VK_NULL_HANDLE)
 		throw std::runtime_error("Staging buffer not configured");
 
+	// The upload would land in storage that is about to be replaced by a copy made before it
+	completeRelocations(true);
+
 	if (stagingBuffer.isMemoryMapped())
 	{
+		stagingBuffer.flush();
 		stagingBuffer.unmap();
 	}
 
-	const QueueFamily transferQueueFamily = m_physicalDevice.getQueueFamilies().getQueueFamily(m_stagingBufferInfo.queue.familyIndex);
-	VulkanCommandBuffer& commandBuffer = getCommandBuffer(createCommandBuffer(transferQueueFamily, threadID, false), threadID);
+	VulkanCommandBuffer& commandBuffer = getImmediateCommandBuffer(m_stagingBufferInfo.queue.familyIndex, threadID);
 
 	commandBuffer.beginRecording(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 	commandBuffer.cmdCopyBuffer(m_stagingBufferInfo.stagingBuffer, buffer, regions);
@@ -407,7 +569,6 @@ void VulkanDevice::dumpStagingBuffer(const uint32_t buffer, const std::vector<Vk
 	commandBuffer.submit(queue, {}, {m_stagingSemaphore});
 	
 	queue.waitIdle();
-	freeCommandBuffer(commandBuffer, threadID);
 }
 
 void VulkanDevice::disallowMemoryType(const uint32_t type)
@@ -420,7 +581,243 @@ void VulkanDevice::allowMemoryType(const uint32_t type)
 	m_memoryAllocator.unhideMemoryType(type);
 }
 
-uint32_t VulkanDevice::createRenderPass(const VulkanRenderPassBuilder& builder, const VkRenderPassCreateFlags flags)
+void VulkanDevice::setMemoryTypeAllocationStrategy(const uint32_t type, const MemoryChunk::AllocationStrategy strategy)
+{
+	m_memoryAllocator.setAllocationStrategy(type, strategy);
+}
+
+void VulkanDevice::configureMemoryChunkPolicy(const VulkanMemoryAllocator::ChunkPolicy& policy)
+{
+	m_memoryAllocator.setChunkPolicy(policy);
+}
+
+VkDeviceSize VulkanDevice::trimMemory()
+{
+	return m_memoryAllocator.trim();
+}
+
+void VulkanDevice::startAllocationCapture(const std::string& filename)
+{
+	m_memoryAllocator.startCapture(filename);
+}
+
+void VulkanDevice::stopAllocationCapture()
+{
+	m_memoryAllocator.stopCapture();
+}
+
+VkDeviceSize VulkanDevice::defragmentMemory(const VkDeviceSize byteBudget, const uint32_t threadID, const float maxOccupancy)
+{
+	Logger::pushContext("Memory compaction");
+	completeRelocations(false);
+	if (!m_relocationBatch.relocations.empty())
+	{
+		Logger::print("Previous compaction is still in flight");
+		Logger::popContext();
+		return 0;
+	}
+
+	std::vector<Relocation>& relocations = m_relocationBatch.relocations;
+	std::set<uint32_t> evacuatedChunks;
+	std::set<uint32_t> destinationChunks;
+	VkDeviceSize movedSize = 0;
+
+	// What lives in each chunk, gathered in one pass over the resources instead of one per candidate
+	struct ChunkResidents
+	{
+		bool isMovable = true;
+		std::vector<VulkanBuffer*> buffers;
+		VkDeviceSize size = 0;
+	};
+	std::unordered_map<uint32_t, ChunkResidents> chunkResidents;
+
+	// Images are pinned and mapped buffers would leave dangling pointers behind, so a chunk holding any of them stays where it is
+	for (const VulkanImage& image : m_images.values())
+	{
+		if (image.m_memoryRegion.size != 0)
+			chunkResidents[image.m_memoryRegion.chunk].isMovable = false;
+	}
+
+	// Neither are resources waiting for destruction, the chunk would be released under them
+	{
+		std::scoped_lock lock(m_deferredFreeMutex);
+		for (const DeferredFree& deferredFree : m_deferredFrees)
+		{
+			if (const VulkanBuffer* buffer = std::get_if<VulkanBuffer>(&deferredFree.resource); buffer != nullptr && buffer->m_memoryRegion.size != 0)
+				chunkResidents[buffer->m_memoryRegion.chunk].isMovable = false;
+			else if (const VulkanImage* image = std::get_if<VulkanImage>(&deferredFree.resource); image != nullptr && image->m_memoryRegion.size != 0)
+				chunkResidents[image->m_memoryRegion.chunk].isMovable = false;
+			else if (const RetiredBufferStorage* storage = std::get_if<RetiredBufferStorage>(&deferredFree.resource))
+				chunkResidents[storage->memoryRegion.chunk].isMovable = false;
+		}
+	}
+
+	for (VulkanBuffer& buffer : m_buffers.values())
+	{
+		if (buffer.m_memoryRegion.size == 0)
+			continue;
+
+		// The copy runs alongside the frames, a buffer the GPU writes to could change after it was copied
+		constexpr VkBufferUsageFlags gpuWrittenUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT;
+		ChunkResidents& residents = chunkResidents[buffer.m_memoryRegion.chunk];
+		residents.isMovable &= !buffer.isMemoryMapped() && (buffer.m_usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) && !(buffer.m_usage & gpuWrittenUsage);
+		residents.buffers.push_back(&buffer);
+		residents.size += buffer.m_memoryRegion.size;
+	}
+
+	for (const uint32_t chunkID : m_memoryAllocator.getDefragmentationCandidates(maxOccupancy))
+	{
+		if (destinationChunks.contains(chunkID))
+			continue;
+
+		const auto found = chunkResidents.find(chunkID);
+		if (found == chunkResidents.end() || !found->second.isMovable || found->second.buffers.empty())
+			continue;
+		const std::vector<VulkanBuffer*>& residents = found->second.buffers;
+		const VkDeviceSize residentSize = found->second.size;
+		if (movedSize + residentSize > byteBudget)
+			break;
+
+		// Reserve every destination before copying anything, a chunk is only worth moving if it ends up completely empty
+		evacuatedChunks.insert(chunkID);
+		const size_t firstRelocation = relocations.size();
+		const uint32_t memoryType = residents.front()->m_memoryRegion.memoryType;
+		bool isMovable = true;
+		for (VulkanBuffer* buffer : residents)
+		{
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.size = buffer->m_size;
+			bufferInfo.usage = buffer->m_usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			VkBuffer newHandle;
+			if (vkCreateBuffer(m_vkHandle, &bufferInfo, nullptr, &newHandle) != VK_SUCCESS)
+			{
+				isMovable = false;
+				break;
+			}
+
+			VkMemoryRequirements requirements;
+			vkGetBufferMemoryRequirements(m_vkHandle, newHandle, &requirements);
+			const MemoryChunk::MemoryBlock region = m_memoryAllocator.allocateInExistingChunk(requirements.size, requirements.alignment, memoryType, evacuatedChunks);
+			if (region.size == 0)
+			{
+				vkDestroyBuffer(m_vkHandle, newHandle, nullptr);
+				isMovable = false;
+				break;
+			}
+			relocations.push_back({Handle{*buffer}, newHandle, region});
+		}
+
+		if (!isMovable)
+		{
+			for (size_t i = firstRelocation; i < relocations.size(); i++)
+			{
+				vkDestroyBuffer(m_vkHandle, relocations[i].newHandle, nullptr);
+				m_memoryAllocator.deallocateUncached(relocations[i].newRegion);
+			}
+			relocations.resize(firstRelocation);
+			evacuatedChunks.erase(chunkID);
+			continue;
+		}
+
+		for (size_t i = firstRelocation; i < relocations.size(); i++)
+		{
+			destinationChunks.insert(relocations[i].newRegion.chunk);
+			vkBindBufferMemory(m_vkHandle, relocations[i].newHandle, getMemoryHandle(relocations[i].newRegion), relocations[i].newRegion.offset);
+		}
+		movedSize += residentSize;
+	}
+
+	if (relocations.empty())
+	{
+		Logger::print("Nothing to compact");
+		Logger::popContext();
+		return 0;
+	}
+
+	// The previous batch is done, so its command buffer is not pending anymore. It only has to be replaced if the thread changed
+	if (!m_relocationBatch.commandBuffer.isNull() && m_relocationBatch.threadID != threadID)
+	{
+		freeCommandBuffer(m_relocationBatch.commandBuffer, m_relocationBatch.threadID);
+		m_relocationBatch.commandBuffer = {};
+	}
+	if (m_relocationBatch.commandBuffer.isNull())
+	{
+		m_relocationBatch.commandBuffer = createCommandBuffer(m_physicalDevice.getQueueFamilies().getQueueFamily(m_oneTimeQueue.familyIndex), threadID, false);
+		m_relocationBatch.threadID = threadID;
+	}
+	if (m_relocationBatch.fence.isNull())
+		m_relocationBatch.fence = createFence(false);
+	else
+		getFence(m_relocationBatch.fence).reset();
+
+	// Work in flight may still read the old buffers, which is fine for a copy that only reads them as well
+	VulkanCommandBuffer& commandBuffer = getCommandBuffer(m_relocationBatch.commandBuffer, threadID);
+	commandBuffer.reset();
+	commandBuffer.beginRecording(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	for (const Relocation& relocation : relocations)
+	{
+		const VulkanBuffer& buffer = getBuffer(relocation.buffer);
+		const VkBufferCopy region{0, 0, buffer.m_size};
+		vkCmdCopyBuffer(commandBuffer.m_vkHandle, buffer.m_vkHandle, relocation.newHandle, 1, &region);
+	}
+	commandBuffer.endRecording();
+	commandBuffer.submit(getQueue(m_oneTimeQueue), {}, {}, m_relocationBatch.fence);
+
+	Logger::print("Moving " + std::to_string(movedSize) + " bytes out of " + std::to_string(evacuatedChunks.size()) + " chunk(s)");
+	Logger::popContext();
+	return movedSize;
+}
+
+void VulkanDevice::completeRelocations(const bool wait)
+{
+	if (m_relocationBatch.relocations.empty())
+		return;
+
+	VulkanFence& fence = getFence(m_relocationBatch.fence);
+	if (wait)
+		fence.wait();
+	else if (vkGetFenceStatus(m_vkHandle, fence.m_vkHandle) != VK_SUCCESS)
+		return;
+
+	Logger::pushContext("Memory compaction");
+	for (const Relocation& relocation : m_relocationBatch.relocations)
+	{
+		// Freed while its copy was in flight, nothing but the copy ever saw the new storage
+		VulkanBuffer* buffer = m_buffers.find(relocation.buffer);
+		if (buffer == nullptr)
+		{
+			vkDestroyBuffer(m_vkHandle, relocation.newHandle, nullptr);
+			m_memoryAllocator.deallocateUncached(relocation.newRegion);
+			continue;
+		}
+
+		// Submitted work recorded with the old handle may still be running, the old storage goes once it is done
+		{
+			std::scoped_lock lock(m_deferredFreeMutex);
+			m_deferredFrees.push_back({m_submissionCounter, RetiredBufferStorage{this, buffer->m_vkHandle, buffer->m_memoryRegion}});
+		}
+
+		buffer->m_vkHandle = relocation.newHandle;
+		buffer->m_memoryRegion = relocation.newRegion;
+		buffer->m_version++;
+		Logger::print("Moved buffer " + std::to_string(buffer->m_id) + " to chunk " + std::to_string(relocation.newRegion.chunk) + " at offset " + std::to_string(relocation.newRegion.offset));
+	}
+	m_relocationBatch.relocations.clear();
+	Logger::popContext();
+}
+
+void VulkanDevice::RetiredBufferStorage::free()
+{
+	vkDestroyBuffer(device->m_vkHandle, vkHandle, nullptr);
+	// Through the thread cache the block would keep the evacuated chunk alive
+	device->m_memoryAllocator.deallocateUncached(memoryRegion);
+	device->m_memoryAllocator.releaseEmptyChunk(memoryRegion.chunk);
+}
+
+Handle<VulkanRenderPass> VulkanDevice::createRenderPass(const VulkanRenderPassBuilder& builder, const VkRenderPassCreateFlags flags)
 {
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -455,44 +852,32 @@ uint32_t VulkanDevice::createRenderPass(const VulkanRenderPassBuilder& builder,
 		throw std::runtime_error("Failed to create render pass");
 	}
 
-	
-	m_renderPasses.push_back({m_id, renderPass});
-	Logger::print("Created renderpass with id " + std::to_string(m_renderPasses.back().getID()) + ", " + std::to_string(builder.m_attachments.size()) + " attachment(s) and " + std::to_string(builder.m_subpasses.size()) + " subpass(es)");
-	
-	return m_renderPasses.back().getID();
+	const Handle<VulkanRenderPass> handle = m_renderPasses.insert({*this, renderPass});
+	Logger::print("Created renderpass with id " + std::to_string(handle.getID()) + ", " + std::to_string(builder.m_attachments.size()) + " attachment(s) and " + std::to_string(builder.m_subpasses.size()) + " subpass(es)");
+
+	return handle;
 }
 
-VulkanRenderPass& VulkanDevice::getRenderPass(const uint32_t id)
+VulkanRenderPass& VulkanDevice::getRenderPass(const Handle<VulkanRenderPass> handle)
 {
-	for (auto& renderPass : m_renderPasses)
-	{
-		if (renderPass.m_id == id)
-		{
-			return renderPass;
-		}
-	}
-	throw std::runtime_error("Render pass not found");
+	return m_renderPasses.get(handle);
 }
 
-void VulkanDevice::freeRenderPass(const uint32_t id)
+void VulkanDevice::freeRenderPass(const Handle<VulkanRenderPass> handle)
 {
-	for (auto it = m_renderPasses.begin(); it != m_renderPasses.end(); ++it)
+	if (VulkanRenderPass* renderPass = m_renderPasses.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_renderPasses.erase(it);
-			break;
-		}
+		renderPass->free();
+		m_renderPasses.erase(handle);
 	}
 }
 
 void VulkanDevice::freeRenderPass(const VulkanRenderPass& renderPass)
 {
-	freeRenderPass(renderPass.m_id);
+	freeRenderPass(Handle{renderPass});
 }
 
-uint32_t VulkanDevice::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+Handle<VulkanPipelineLayout> VulkanDevice::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorSetLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
 {
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -507,101 +892,67 @@ uint32_t VulkanDevice::createPipelineLayout(const std::vector<VkDescriptorSetLay
 		throw std::runtime_error("Failed to create pipeline layout");
 	}
 
-	m_pipelineLayouts.push_back({m_id, layout});
-	return m_pipelineLayouts.back().getID();
+	return m_pipelineLayouts.insert({*this, layout});
 }
 
-VulkanPipelineLayout& VulkanDevice::getPipelineLayout(const uint32_t id)
+VulkanPipelineLayout& VulkanDevice::getPipelineLayout(const Handle<VulkanPipelineLayout> handle)
 {
-	for (VulkanPipelineLayout& layout : m_pipelineLayouts)
-	{
-		if (layout.m_id == id)
-		{
-			return layout;
-		}
-	}
-	throw std::runtime_error("Pipeline layout not found");
+	return m_pipelineLayouts.get(handle);
 }
 
-void VulkanDevice::freePipelineLayout(const uint32_t id)
+void VulkanDevice::freePipelineLayout(const Handle<VulkanPipelineLayout> handle)
 {
-	for (auto it = m_pipelineLayouts.begin(); it != m_pipelineLayouts.end(); ++it)
+	if (VulkanPipelineLayout* layout = m_pipelineLayouts.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_pipelineLayouts.erase(it);
-			break;
-		}
+		layout->free();
+		m_pipelineLayouts.erase(handle);
 	}
 }
 
 void VulkanDevice::freePipelineLayout(const VulkanPipelineLayout& layout)
 {
-	freePipelineLayout(layout.m_id);
+	freePipelineLayout(Handle{layout});
 }
 
-VulkanPipeline& VulkanDevice::getPipeline(const uint32_t id)
+VulkanPipeline& VulkanDevice::getPipeline(const Handle<VulkanPipeline> handle)
 {
-	for (VulkanPipeline& pipeline : m_pipelines)
-	{
-		if (pipeline.m_id == id)
-		{
-			return pipeline;
-		}
-	}
-	throw std::runtime_error("Pipeline not found");
+	return m_pipelines.get(handle);
 }
 
-void VulkanDevice::freePipeline(const uint32_t id)
+void VulkanDevice::freePipeline(const Handle<VulkanPipeline> handle)
 {
-	for (auto it = m_pipelines.begin(); it != m_pipelines.end(); ++it)
+	if (VulkanPipeline* pipeline = m_pipelines.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_pipelines.erase(it);
-			break;
-		}
+		pipeline->free();
+		m_pipelines.erase(handle);
 	}
 }
 
 void VulkanDevice::freePipeline(const VulkanPipeline& pipeline)
 {
-	freePipeline(pipeline.m_id);
+	freePipeline(Handle{pipeline});
 }
 
-VulkanSemaphore& VulkanDevice::getSemaphore(const uint32_t id)
+VulkanSemaphore& VulkanDevice::getSemaphore(const Handle<VulkanSemaphore> handle)
 {
-	for (VulkanSemaphore& semaphore : m_semaphores)
-	{
-		if (semaphore.m_id == id)
-		{
-			return semaphore;
-		}
-	}
-	throw std::runtime_error("Semaphore not found");
+	return m_semaphores.get(handle);
 }
 
-void VulkanDevice::freeSemaphore(uint32_t id)
+void VulkanDevice::freeSemaphore(const Handle<VulkanSemaphore> handle)
 {
-	for (auto it = m_semaphores.begin(); it != m_semaphores.end(); ++it)
+	if (VulkanSemaphore* semaphore = m_semaphores.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_semaphores.erase(it);
-			break;
-		}
+		semaphore->free();
+		m_semaphores.erase(handle);
 	}
 }
 
 void VulkanDevice::freeSemaphore(VulkanSemaphore& semaphore)
 {
-	freeSemaphore(semaphore.m_id);
+	freeSemaphore(Handle{semaphore});
 }
 
-uint32_t VulkanDevice::createShader(const std::string& filename, const VkShaderStageFlagBits stage)
+Handle<VulkanShader> VulkanDevice::createShader(const std::string& filename, const VkShaderStageFlagBits stage)
 {
 	const VulkanShader::Result result = VulkanShader::compileFile(filename, VulkanShader::getKindFromStage(stage), VulkanShader::readFile(filename), true);
 
@@ -621,49 +972,37 @@ uint32_t VulkanDevice::createShader(const std::string& filename, const VkShaderS
 		throw std::runtime_error("failed to create shader module!");
 	}
 
-	m_shaders.push_back({m_id, shader, stage});
-	return m_shaders.back().getID();
+	return m_shaders.insert({*this, shader, stage});
 }
 
-VulkanShader& VulkanDevice::getShader(const uint32_t id)
+VulkanShader& VulkanDevice::getShader(const Handle<VulkanShader> handle)
 {
-	for (auto& shader : m_shaders)
-	{
-		if (shader.m_id == id)
-		{
-			return shader;
-		}
-	}
-	throw std::runtime_error("Shader not found");
+	return m_shaders.get(handle);
 }
 
-void VulkanDevice::freeShader(const uint32_t id)
+void VulkanDevice::freeShader(const Handle<VulkanShader> handle)
 {
-	for (auto it = m_shaders.begin(); it != m_shaders.end(); ++it)
+	if (const VulkanShader* shader = m_shaders.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			vkDestroyShaderModule(m_vkHandle, it->m_vkHandle, nullptr);
-			m_shaders.erase(it);
-			break;
-		}
+		vkDestroyShaderModule(m_vkHandle, shader->m_vkHandle, nullptr);
+		m_shaders.erase(handle);
 	}
 }
 
 void VulkanDevice::freeShader(const VulkanShader& shader)
 {
-	freeShader(shader.m_id);
+	freeShader(Handle{shader});
 }
 
 void VulkanDevice::freeAllShaders()
 {
-	for (const VulkanShader& shader : m_shaders)
+	for (const VulkanShader& shader : m_shaders.values())
 		vkDestroyShaderModule(m_vkHandle, shader.m_vkHandle, nullptr);
 
 	m_shaders.clear();
 }
 
-uint32_t VulkanDevice::createSemaphore()
+Handle<VulkanSemaphore> VulkanDevice::createSemaphore()
 {
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -674,11 +1013,10 @@ uint32_t VulkanDevice::createSemaphore()
 		throw std::runtime_error("Failed to create semaphore");
 	}
 
-	m_semaphores.push_back({m_id, semaphore});
-	return m_semaphores.back().getID();
+	return m_semaphores.insert({*this, semaphore});
 }
 
-uint32_t VulkanDevice::createFence(const bool signaled)
+Handle<VulkanFence> VulkanDevice::createFence(const bool signaled)
 {
 	VkFenceCreateInfo fenceInfo{};
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -690,38 +1028,26 @@ uint32_t VulkanDevice::createFence(const bool signaled)
 		throw std::runtime_error("Failed to create fence");
 	}
 
-	m_fences.push_back({m_id, fence, signaled});
-	return m_fences.back().getID();
+	return m_fences.insert({*this, fence, signaled});
 }
 
-VulkanFence& VulkanDevice::getFence(const uint32_t id)
+VulkanFence& VulkanDevice::getFence(const Handle<VulkanFence> handle)
 {
-	for (VulkanFence& fence : m_fences)
-	{
-		if (fence.m_id == id)
-		{
-			return fence;
-		}
-	}
-	throw std::runtime_error("Fence not found");
+	return m_fences.get(handle);
 }
 
-void VulkanDevice::freeFence(const uint32_t id)
+void VulkanDevice::freeFence(const Handle<VulkanFence> handle)
 {
-	for (auto it = m_fences.begin(); it != m_fences.end(); ++it)
+	if (VulkanFence* fence = m_fences.find(handle))
 	{
-		if (it->m_id == id)
-		{
-			it->free();
-			m_fences.erase(it);
-			break;
-		}
+		fence->free();
+		m_fences.erase(handle);
 	}
 }
 
 void VulkanDevice::freeFence(const VulkanFence& fence)
 {
-	freeFence(fence.m_id);
+	freeFence(Handle{fence});
 }
 
 void VulkanDevice::waitIdle() const
@@ -729,7 +1055,58 @@ void VulkanDevice::waitIdle() const
 	vkDeviceWaitIdle(m_vkHandle);
 }
 
-uint32_t VulkanDevice::createPipeline(const VulkanPipelineBuilder& builder, const uint32_t pipelineLayout, const uint32_t renderPass, const uint32_t subpass)
+void VulkanDevice::releaseDeferredResources()
+{
+	completeRelocations(false);
+	m_memoryAllocator.refreshBudget();
+
+	std::scoped_lock lock(m_deferredFreeMutex);
+	if (m_deferredFrees.empty())
+		return;
+
+	// Frees are queued in submission order, so everything up to the first one still in use can go
+	const uint64_t completedSubmission = getCompletedSubmission();
+	while (!m_deferredFrees.empty() && m_deferredFrees.front().submission <= completedSubmission)
+	{
+		std::visit([](auto& resource) { resource.free(); }, m_deferredFrees.front().resource);
+		m_deferredFrees.pop_front();
+	}
+}
+
+template<typename T>
+void VulkanDevice::deferFree(VulkanSlotMap<T>& resources, const Handle<T> handle)
+{
+	// The handle goes stale right away, only the Vulkan object and its memory outlive the call
+	if (std::optional<T> resource = resources.extract(handle))
+	{
+		std::scoped_lock lock(m_deferredFreeMutex);
+		m_deferredFrees.push_back({m_submissionCounter, std::move(resource.value())});
+	}
+}
+
+void VulkanDevice::trackSubmission(VulkanFence& fence)
+{
+	std::scoped_lock lock(m_deferredFreeMutex);
+	fence.m_submission = ++m_submissionCounter;
+}
+
+uint64_t VulkanDevice::getCompletedSubmission()
+{
+	uint64_t completedSubmission = m_submissionCounter;
+	for (VulkanFence& fence : m_fences.values())
+	{
+		if (fence.m_submission == 0)
+			continue;
+
+		if (vkGetFenceStatus(m_vkHandle, fence.m_vkHandle) == VK_SUCCESS)
+			fence.m_submission = 0;
+		else
+			completedSubmission = std::min(completedSubmission, fence.m_submission - 1);
+	}
+	return completedSubmission;
+}
+
+Handle<VulkanPipeline> VulkanDevice::createPipeline(const VulkanPipelineBuilder& builder, const Handle<VulkanPipelineLayout> pipelineLayout, const Handle<VulkanRenderPass> renderPass, const uint32_t subpass)
 {
 	const std::vector<VkPipelineShaderStageCreateInfo> shaderModules = builder.createShaderStages();
 
@@ -757,15 +1134,23 @@ uint32_t VulkanDevice::createPipeline(const VulkanPipelineBuilder& builder, cons
 	}
 	Logger::print("Created pipeline with handle " + std::to_string(reinterpret_cast<uint64_t>(pipeline)));
 
-	m_pipelines.push_back({*this, pipeline, pipelineLayout, renderPass, subpass});
-	return m_pipelines.back().getID();
+	const VkPipelineDynamicStateCreateInfo& dynamicState = builder.m_dynamicState;
+	std::vector<VkDynamicState> dynamicStates(dynamicState.pDynamicStates, dynamicState.pDynamicStates + dynamicState.dynamicStateCount);
+	return m_pipelines.insert({*this, pipeline, pipelineLayout, renderPass, subpass, std::move(dynamicStates)});
 }
 
 void VulkanDevice::free()
 {
+	completeRelocations(true);
+
 	for (const auto& commandBuffers : m_commandBuffers | std::views::values)
-		for (const VulkanCommandBuffer& buffer : commandBuffers)
-			vkFreeCommandBuffers(m_vkHandle, m_threadCommandInfos[buffer.m_threadID].commandPools[buffer.m_familyIndex].pool, 1, &buffer.m_vkHandle);
+		for (const VulkanCommandBuffer& buffer : commandBuffers.values())
+		{
+			if (buffer.m_ownsPool)
+				vkDestroyCommandPool(m_vkHandle, buffer.m_pool, nullptr);
+			else
+				vkFreeCommandBuffers(m_vkHandle, buffer.m_pool, 1, &buffer.m_vkHandle);
+		}
 
 	for (const ThreadCommandInfo& threadInfo : m_threadCommandInfos | std::views::values)
 	{
@@ -777,23 +1162,39 @@ void VulkanDevice::free()
 			if (commandPoolInfo.secondaryPool != VK_NULL_HANDLE)
 				vkDestroyCommandPool(m_vkHandle, commandPoolInfo.secondaryPool, nullptr);
 		}
+
+		for (const ThreadCommandInfo::FramePoolInfo& framePoolInfo : threadInfo.framePools | std::views::values)
+			vkDestroyCommandPool(m_vkHandle, framePoolInfo.pool, nullptr);
+
+		for (const ThreadCommandInfo::ImmediatePoolInfo& immediatePoolInfo : threadInfo.immediatePools | std::views::values)
+			vkDestroyCommandPool(m_vkHandle, immediatePoolInfo.pool, nullptr);
 	}
 
 	m_threadCommandInfos.clear();
 
-	for (VulkanBuffer& buffer : m_buffers)
+	// The device is idle by now, nothing queued for destruction can still be in use
+	for (DeferredFree& deferredFree : m_deferredFrees)
+		std::visit([](auto& resource) { resource.free(); }, deferredFree.resource);
+	m_deferredFrees.clear();
+
+	// The objects of the rings and the backing buffers are released with the rest of their kind
+	m_frameRings.clear();
+	m_frameAllocators.clear();
+	m_bufferSuballocators.clear();
+
+	for (VulkanBuffer& buffer : m_buffers.values())
 		buffer.free();
 	m_buffers.clear();
 
 	m_stagingBufferInfo = {};
 
-	for (VulkanImage& image : m_images)
+	for (VulkanImage& image : m_images.values())
 		image.free();
 	m_images.clear();
 
 	m_memoryAllocator.free();
 
-	for (VulkanRenderPass& renderPass : m_renderPasses)
+	for (VulkanRenderPass& renderPass : m_renderPasses.values())
 		renderPass.free();
 	m_renderPasses.clear();
 
@@ -801,27 +1202,27 @@ void VulkanDevice::free()
 	//	vkDestroyDescriptorSetLayout(m_vkHandle, layout, nullptr);
 	//m_descriptorSetLayouts.clear();
 
-	for (VulkanPipelineLayout& pipelineLayout : m_pipelineLayouts)
+	for (VulkanPipelineLayout& pipelineLayout : m_pipelineLayouts.values())
 		pipelineLayout.free();
 	m_pipelineLayouts.clear();
 
-	for (VulkanShader& shader : m_shaders)
+	for (VulkanShader& shader : m_shaders.values())
 		shader.free();
 	m_shaders.clear();
 
-	for (VulkanPipeline& pipeline : m_pipelines)
+	for (VulkanPipeline& pipeline : m_pipelines.values())
 		pipeline.free();
 	m_pipelines.clear();
 
-	for (VulkanSemaphore& semaphore : m_semaphores)
+	for (VulkanSemaphore& semaphore : m_semaphores.values())
 		semaphore.free();
 	m_semaphores.clear();
 
-	for (VulkanFramebuffer& framebuffer : m_framebuffers)
+	for (VulkanFramebuffer& framebuffer : m_framebuffers.values())
 		framebuffer.free();
 	m_framebuffers.clear();
 
-	for (VulkanFence& fence : m_fences)
+	for (VulkanFence& fence : m_fences.values())
 		fence.free();
 	m_fences.clear();
 
@@ -829,21 +1230,13 @@ void VulkanDevice::free()
 	m_vkHandle = VK_NULL_HANDLE;
 }
 
-VkDeviceMemory VulkanDevice::getMemoryHandle(const uint32_t chunkID) const
+VkDeviceMemory VulkanDevice::getMemoryHandle(const MemoryChunk::MemoryBlock& block) const
 {
-	for (const auto& chunk : m_memoryAllocator.m_memoryChunks)
-	{
-		if (chunk.getID() == chunkID)
-		{
-			return chunk.m_memory;
-		}
-	}
-
-	throw std::runtime_error("Memory chunk not found");
+	return m_memoryAllocator.getMemoryHandle(block);
 }
 
-VulkanDevice::VulkanDevice(const VulkanGPU pDevice, const VkDevice device)
-	: m_vkHandle(device), m_physicalDevice(pDevice), m_memoryAllocator(*this), m_stagingSemaphore(createSemaphore())
+VulkanDevice::VulkanDevice(const VulkanGPU pDevice, const VkDevice device, const std::vector<const char*>& extensions)
+	: m_vkHandle(device), m_physicalDevice(pDevice), m_enabledExtensions(extensions.begin(), extensions.end()), m_memoryAllocator(*this), m_stagingSemaphore(createSemaphore())
 {
 
 }
@@ -0,0 +1,83 @@
+#include "vulkan_frame_allocator.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "logger.hpp"
+#include "vulkan_device.hpp"
+
+void VulkanFrameAllocator::beginFrame(const uint32_t frameIndex, const Handle<VulkanFence> fence)
+{
+	if (frameIndex >= m_frameCount)
+		throw std::runtime_error("Frame index " + std::to_string(frameIndex) + " out of range for frame allocator " + std::to_string(m_id));
+
+	// The fence protects the last submission that read from this region, it must not have been reset yet
+	if (!fence.isNull())
+		m_device->getFence(fence).wait();
+
+	m_currentFrame = frameIndex;
+	m_head = 0;
+}
+
+VulkanFrameAllocator::Allocation VulkanFrameAllocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+	const VkDeviceSize safeAlignment = alignment > 0 ? alignment : 1;
+	const VkDeviceSize regionStart = m_currentFrame * m_frameStride;
+	const VkDeviceSize offset = (regionStart + m_head + safeAlignment - 1) / safeAlignment * safeAlignment;
+
+	if (size == 0 || offset + size > regionStart + m_frameSize)
+		return {};
+
+	m_head = offset + size - regionStart;
+	return {m_buffer, offset, size, static_cast<char*>(m_mappedData) + offset};
+}
+
+VulkanFrameAllocator::Allocation VulkanFrameAllocator::push(const void* data, const VkDeviceSize size, const VkDeviceSize alignment)
+{
+	const Allocation allocation = allocate(size, alignment);
+	if (allocation.size == 0)
+		throw std::runtime_error("Frame allocator " + std::to_string(m_id) + " ran out of space (" + std::to_string(m_head) + "/" + std::to_string(m_frameSize) + " bytes used, " + std::to_string(size) + " requested)");
+
+	memcpy(allocation.data, data, size);
+	return allocation;
+}
+
+Handle<VulkanBuffer> VulkanFrameAllocator::getBuffer() const
+{
+	return m_buffer;
+}
+
+uint32_t VulkanFrameAllocator::getFrameCount() const
+{
+	return m_frameCount;
+}
+
+VkDeviceSize VulkanFrameAllocator::getFrameSize() const
+{
+	return m_frameSize;
+}
+
+VkDeviceSize VulkanFrameAllocator::getUsedSize() const
+{
+	return m_head;
+}
+
+void VulkanFrameAllocator::free()
+{
+	if (m_buffer.isNull())
+		return;
+
+	Logger::print("Freeing frame allocator " + std::to_string(m_id));
+	VulkanDevice& device = *m_device;
+	device.getBuffer(m_buffer).unmap();
+	device.freeBuffer(m_buffer);
+	m_buffer = {};
+	m_mappedData = nullptr;
+}
+
+VulkanFrameAllocator::VulkanFrameAllocator(VulkanDevice& device, const Handle<VulkanBuffer> buffer, const VkDeviceSize frameSize, const VkDeviceSize frameStride, const uint32_t frameCount, void* mappedData)
+	: m_buffer(buffer), m_frameSize(frameSize), m_frameStride(frameStride), m_frameCount(frameCount), m_mappedData(mappedData), m_device(&device)
+{
+	Logger::print("Created frame allocator " + std::to_string(m_id) + " with " + std::to_string(m_frameCount) + " frame(s) of " + std::to_string(m_frameSize) + " bytes");
+}
@@ -0,0 +1,107 @@
+#include "vulkan_frame_ring.hpp"
+
+#include <string>
+#include <utility>
+
+#include "logger.hpp"
+#include "vulkan_device.hpp"
+
+const VulkanFrameRing::FrameContext& VulkanFrameRing::beginFrame()
+{
+	// The first frame of each slot starts from the signaled fence it was created with
+	if (m_frameNumber > 0)
+		m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
+	m_frameNumber++;
+
+	FrameContext& frame = m_frames[m_frameIndex];
+	m_device->getFence(frame.inFlightFence).wait();
+
+	// The pool hands the same buffer back after the reset, nothing is allocated once every frame has been through once
+	m_device->resetFrameCommandPools(m_threadID, m_frameIndex);
+	frame.commandBuffer = m_device->getOrCreateCommandBuffer(m_family, m_threadID, m_frameIndex, false);
+
+	// Already waited on the fence, the allocator does not have to do it again
+	if (!m_transientAllocator.isNull())
+		m_device->getFrameAllocator(m_transientAllocator).beginFrame(m_frameIndex, {});
+
+	return frame;
+}
+
+void VulkanFrameRing::waitForImage(const uint32_t imageIndex)
+{
+	if (imageIndex >= m_imageFences.size())
+		m_imageFences.resize(imageIndex + 1);
+
+	const Handle<VulkanFence> currentFence = m_frames[m_frameIndex].inFlightFence;
+	if (!m_imageFences[imageIndex].isNull() && m_imageFences[imageIndex] != currentFence)
+		m_device->getFence(m_imageFences[imageIndex]).wait();
+
+	m_imageFences[imageIndex] = currentFence;
+}
+
+void VulkanFrameRing::submit(const VulkanQueue& queue, const VkPipelineStageFlags waitStage, const Handle<VulkanCommandBuffer> commandBuffer) const
+{
+	const FrameContext& frame = m_frames[m_frameIndex];
+
+	// Only reset right before submitting, a frame that is skipped keeps its fence signaled for the next time around
+	m_device->getFence(frame.inFlightFence).reset();
+	m_device->getCommandBuffer(commandBuffer.isNull() ? frame.commandBuffer : commandBuffer, m_threadID).submit(queue, {{frame.imageAvailableSemaphore, waitStage}}, {frame.renderFinishedSemaphore}, frame.inFlightFence);
+}
+
+const VulkanFrameRing::FrameContext& VulkanFrameRing::getCurrentFrame() const
+{
+	return m_frames[m_frameIndex];
+}
+
+uint32_t VulkanFrameRing::getFrameIndex() const
+{
+	return m_frameIndex;
+}
+
+uint32_t VulkanFrameRing::getFrameCount() const
+{
+	return static_cast<uint32_t>(m_frames.size());
+}
+
+uint64_t VulkanFrameRing::getFrameNumber() const
+{
+	return m_frameNumber;
+}
+
+uint32_t VulkanFrameRing::getThreadID() const
+{
+	return m_threadID;
+}
+
+Handle<VulkanFrameAllocator> VulkanFrameRing::getTransientAllocator() const
+{
+	return m_transientAllocator;
+}
+
+void VulkanFrameRing::free()
+{
+	if (m_frames.empty())
+		return;
+
+	Logger::print("Freeing frame ring " + std::to_string(m_id));
+	VulkanDevice& device = *m_device;
+	for (const FrameContext& frame : m_frames)
+	{
+		// The command buffer belongs to the frame pool of the thread, it is handed out again by the next ring using the pool
+		device.getFence(frame.inFlightFence).wait();
+		device.freeSemaphore(frame.imageAvailableSemaphore);
+		device.freeSemaphore(frame.renderFinishedSemaphore);
+		device.freeFence(frame.inFlightFence);
+	}
+	m_frames.clear();
+	m_imageFences.clear();
+
+	device.freeFrameAllocator(m_transientAllocator);
+	m_transientAllocator = {};
+}
+
+VulkanFrameRing::VulkanFrameRing(VulkanDevice& device, std::vector<FrameContext> frames, const Handle<VulkanFrameAllocator> transientAllocator, const QueueFamily& family, const uint32_t threadID)
+	: m_frames(std::move(frames)), m_transientAllocator(transientAllocator), m_family(family), m_threadID(threadID), m_device(&device)
+{
+	Logger::print("Created frame ring " + std::to_string(m_id) + " with " + std::to_string(m_frames.size()) + " frame(s) in flight");
+}
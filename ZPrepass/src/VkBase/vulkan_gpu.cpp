@@ -1,5 +1,6 @@
 #include "vulkan_gpu.hpp"
 
+#include <cstring>
 #include <stdexcept>
 
 #include "sdl_window.hpp"
@@ -101,6 +102,22 @@ VkFormat VulkanGPU::findSupportedFormat(const std::vector<VkFormat>& candidates,
 	throw std::runtime_error("Failed to find supported format");
 }
 
+bool VulkanGPU::isExtensionSupported(const char* extension) const
+{
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(m_vkHandle, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(m_vkHandle, nullptr, &extensionCount, extensions.data());
+	for (const VkExtensionProperties& availableExtension : extensions)
+	{
+		if (strcmp(availableExtension.extensionName, extension) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 VulkanGPU::VulkanGPU(const VkPhysicalDevice physicalDevice)
 	: m_vkHandle(physicalDevice)
 {
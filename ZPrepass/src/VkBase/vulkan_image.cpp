@@ -4,13 +4,12 @@
 
 #include "logger.hpp"
 #include "vulkan_command_buffer.hpp"
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 
 VkMemoryRequirements VulkanImage::getMemoryRequirements() const
 {
 	VkMemoryRequirements requirements;
-	vkGetImageMemoryRequirements(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, &requirements);
+	vkGetImageMemoryRequirements(m_device->m_vkHandle, m_vkHandle, &requirements);
 	return requirements;
 }
 
@@ -18,7 +17,7 @@ void VulkanImage::allocateFromIndex(const uint32_t memoryIndex)
 {
 	Logger::pushContext("Image memory");
 	const VkMemoryRequirements requirements = getMemoryRequirements();
-	setBoundMemory(VulkanContext::getDevice(m_device).m_memoryAllocator.allocate(requirements.size, requirements.alignment, memoryIndex));
+	setBoundMemory(m_device->m_memoryAllocator.allocate(requirements.size, requirements.alignment, memoryIndex, {VK_NULL_HANDLE, m_vkHandle}));
 	Logger::popContext();
 }
 
@@ -26,7 +25,7 @@ void VulkanImage::allocateFromFlags(const VulkanMemoryAllocator::MemoryPropertyP
 {
 	Logger::pushContext("Image memory");
 	const VkMemoryRequirements requirements = getMemoryRequirements();
-	setBoundMemory(VulkanContext::getDevice(m_device).m_memoryAllocator.searchAndAllocate(requirements.size, requirements.alignment, memoryProperties, requirements.memoryTypeBits));
+	setBoundMemory(m_device->m_memoryAllocator.searchAndAllocate(requirements.size, requirements.alignment, memoryProperties, requirements.memoryTypeBits, false, {VK_NULL_HANDLE, m_vkHandle}));
 	Logger::popContext();
 }
 
@@ -65,7 +64,7 @@ VkImageView VulkanImage::createImageView(const VkFormat format, const VkImageAsp
 	createInfo.subresourceRange.layerCount = 1;
 
 	VkImageView imageView;
-	if (vkCreateImageView(VulkanContext::getDevice(m_device).m_vkHandle, &createInfo, nullptr, &imageView) != VK_SUCCESS)
+	if (vkCreateImageView(m_device->m_vkHandle, &createInfo, nullptr, &imageView) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create image view!");
 	}
@@ -76,14 +75,14 @@ VkImageView VulkanImage::createImageView(const VkFormat format, const VkImageAsp
 
 void VulkanImage::freeImageView(const VkImageView imageView)
 {
-	vkDestroyImageView(VulkanContext::getDevice(m_device).m_vkHandle, imageView, nullptr);
+	vkDestroyImageView(m_device->m_vkHandle, imageView, nullptr);
 	std::erase(m_imageViews, imageView);
 }
 
 void VulkanImage::transitionLayout(const VkImageLayout layout, const VkImageAspectFlags aspectFlags, const uint32_t srcQueueFamily, const uint32_t dstQueueFamily, const uint32_t threadID)
 {
-	VulkanDevice& device = VulkanContext::getDevice(m_device);
-	VulkanCommandBuffer& commandBuffer = device.getCommandBuffer(device.createOneTimeCommandBuffer(threadID), threadID);
+	VulkanDevice& device = *m_device;
+	VulkanCommandBuffer& commandBuffer = device.getImmediateCommandBuffer(device.m_oneTimeQueue.familyIndex, threadID);
 
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -126,11 +125,10 @@ void VulkanImage::transitionLayout(const VkImageLayout layout, const VkImageAspe
 	m_layout = layout;
 
 	queue.waitIdle();
-	device.freeCommandBuffer(commandBuffer, threadID);
 }
 
-VulkanImage::VulkanImage(const uint32_t device, const VkImage vkHandle, const VkExtent3D size, const VkImageType type, const VkImageLayout layout)
-	: m_size(size), m_type(type), m_layout(layout), m_vkHandle(vkHandle), m_device(device)
+VulkanImage::VulkanImage(VulkanDevice& device, const VkImage vkHandle, const VkExtent3D size, const VkImageType type, const VkImageLayout layout)
+	: m_size(size), m_type(type), m_layout(layout), m_vkHandle(vkHandle), m_device(&device)
 {
 
 }
@@ -144,12 +142,12 @@ void VulkanImage::setBoundMemory(const MemoryChunk::MemoryBlock& memoryRegion)
 	m_memoryRegion = memoryRegion;
 
 	Logger::print("Bound memory to image " + std::to_string(m_id) + " with size " + std::to_string(m_memoryRegion.size) + " and offset " + std::to_string(m_memoryRegion.offset));
-	vkBindImageMemory(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, VulkanContext::getDevice(m_device).getMemoryHandle(m_memoryRegion.chunk), m_memoryRegion.offset);
+	vkBindImageMemory(m_device->m_vkHandle, m_vkHandle, m_device->getMemoryHandle(m_memoryRegion), m_memoryRegion.offset);
 }
 
 void VulkanImage::free()
 {
-	VulkanDevice& device = VulkanContext::getDevice(m_device);
+	VulkanDevice& device = *m_device;
 
 	for (const VkImageView imageView : m_imageViews)
 	{
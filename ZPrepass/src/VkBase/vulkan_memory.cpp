@@ -1,8 +1,10 @@
 #include "vulkan_memory.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <ranges>
 #include <stdexcept>
+#include <unordered_map>
 #include <vulkan/vk_enum_string_helper.h>
 #include <vulkan/vulkan_core.h>
 
@@ -70,9 +72,10 @@ bool MemoryStructure::doesMemoryContainProperties(const uint32_t type, const VkM
 	return (m_memoryProperties.memoryTypes[type].propertyFlags & property) == property;
 }
 
-MemoryStructure::MemoryStructure(const VulkanGPU gpu)
+MemoryStructure::MemoryStructure(const VkPhysicalDeviceMemoryProperties& memoryProperties)
+	: m_memoryProperties(memoryProperties)
 {
-	vkGetPhysicalDeviceMemoryProperties(gpu.m_vkHandle, &m_memoryProperties);
+
 }
 
 VkDeviceSize MemoryChunk::getSize() const
@@ -87,66 +90,65 @@ uint32_t MemoryChunk::getMemoryType() const
 
 bool MemoryChunk::isEmpty() const
 {
-	VkDeviceSize freeSize = 0;
-	for (const auto& size : m_unallocatedData | std::views::values)
-	{
-		freeSize += size;
-	}
-	return freeSize == m_size;
+	return m_unallocatedSize == m_size;
 }
 
 MemoryChunk::MemoryBlock MemoryChunk::allocate(const VkDeviceSize newSize, const VkDeviceSize alignment)
 {
-	VkDeviceSize best = m_size;
-	VkDeviceSize bestAlignOffset = 0;
-	if (newSize > m_unallocatedData[m_biggestChunk])
-		return {0, 0, m_id};
-
-	for (const auto& [offset, size] : m_unallocatedData)
+	if (m_strategy == TLSF)
 	{
-		if (size < newSize) continue;
+		const std::optional<VkDeviceSize> offset = m_tlsf.allocate(newSize, alignment);
+		if (!offset.has_value())
+			return makeBlock(0, 0);
 
-		const VkDeviceSize alignedOffset = offset > 0 ? offset + (alignment - (offset % alignment)) : 0;
-		const VkDeviceSize offsetDifference = alignedOffset - offset;
+		Logger::print("Allocated block of size " + std::to_string(newSize) + " at offset " + std::to_string(offset.value()) + " of memory type " + std::to_string(m_memoryType) + " (TLSF)");
+		m_unallocatedSize -= newSize;
+		m_allocationCount++;
+		return makeBlock(newSize, offset.value());
+	}
+
+	if (newSize > getBiggestChunkSize())
+		return makeBlock(0, 0);
 
-		if (size + offsetDifference < newSize) continue;
+	const VkDeviceSize safeAlignment = alignment > 0 ? alignment : 1;
 
-		if (best == m_size || m_unallocatedData[best] > size)
+	// Only ranges smaller than newSize + alignment - 1 can be too small once their offset is aligned, those are checked
+	// from the smallest up. If none fits, the smallest range past that size is the best fit and always has room
+	const auto guaranteedIt = m_unallocatedBySize.lower_bound({newSize + safeAlignment - 1, 0});
+	auto bestIt = guaranteedIt;
+	for (auto it = m_unallocatedBySize.lower_bound({newSize, 0}); it != guaranteedIt; ++it)
+	{
+		const auto& [size, offset] = *it;
+		const VkDeviceSize alignedOffset = (offset + safeAlignment - 1) / safeAlignment * safeAlignment;
+		if (size >= newSize + (alignedOffset - offset))
 		{
-			best = offset;
-			bestAlignOffset = offsetDifference;
+			bestIt = it;
+			break;
 		}
 	}
 
-	if (best == m_size)
-		return {0, 0, m_id};
+	if (bestIt == m_unallocatedBySize.end())
+		return makeBlock(0, 0);
 
-	const VkDeviceSize bestSize = m_unallocatedData[best];
-	m_unallocatedData.erase(best);
+	const auto [bestSize, best] = *bestIt;
+	const VkDeviceSize bestAlignOffset = (best + safeAlignment - 1) / safeAlignment * safeAlignment - best;
+	removeUnallocatedRange(best);
 	if (bestAlignOffset != 0)
 	{
-		m_unallocatedData[best] = bestAlignOffset;
-		best += bestAlignOffset;
+		addUnallocatedRange(best, bestAlignOffset);
 	}
+	const VkDeviceSize allocatedOffset = best + bestAlignOffset;
 	if (bestSize - bestAlignOffset != newSize)
 	{
-		m_unallocatedData[best + newSize] = (bestSize - bestAlignOffset) - newSize;
+		addUnallocatedRange(allocatedOffset + newSize, (bestSize - bestAlignOffset) - newSize);
 	}
 
-	Logger::print("Allocated block of size " + std::to_string(newSize) + " at offset " + std::to_string(best) + " of memory type " + std::to_string(m_memoryType));
-
-	if (m_biggestChunk == best)
-	{
-		for (const auto& [offset, size] : m_unallocatedData)
-		{
-			if (!m_unallocatedData.contains(m_biggestChunk) || size > m_unallocatedData[m_biggestChunk])
-				m_biggestChunk = offset;
-		}
-	}
+	Logger::print("Allocated block of size " + std::to_string(newSize) + " at offset " + std::to_string(allocatedOffset) + " of memory type " + std::to_string(m_memoryType));
 
 	m_unallocatedSize -= newSize;
+	m_allocationCount++;
 
-	return {newSize, best, m_id};
+	return makeBlock(newSize, allocatedOffset);
 }
 
 void MemoryChunk::deallocate(const MemoryBlock& block)
@@ -154,17 +156,30 @@ void MemoryChunk::deallocate(const MemoryBlock& block)
 	if (block.chunk != m_id)
 		throw std::runtime_error("Block does not belong to this chunk!");
 
-	m_unallocatedData[block.offset] = block.size;
+	if (m_strategy == TLSF)
+	{
+		m_tlsf.deallocate(block.offset);
+		Logger::print("Deallocated block of size " + std::to_string(block.size) + " at offset " + std::to_string(block.offset) + " of memory type " + std::to_string(m_memoryType) + " (TLSF)");
+		m_unallocatedSize += block.size;
+		m_allocationCount--;
+		return;
+	}
+
+	addUnallocatedRange(block.offset, block.size);
 	Logger::print("Deallocated block of size " + std::to_string(block.size) + " at offset " + std::to_string(block.offset) + " of memory type " + std::to_string(m_memoryType));
 
 	m_unallocatedSize += block.size;
+	m_allocationCount--;
 
-	defragment();
+	defragment(block.offset);
 }
 
 VkDeviceSize MemoryChunk::getBiggestChunkSize() const
 {
-	return m_unallocatedData.empty() ? 0 : m_unallocatedData.at(m_biggestChunk);
+	if (m_strategy == TLSF)
+		return m_tlsf.getLargestFreeSize();
+
+	return m_unallocatedBySize.empty() ? 0 : m_unallocatedBySize.rbegin()->first;
 }
 
 VkDeviceSize MemoryChunk::getRemainingSize() const
@@ -172,203 +187,1141 @@ VkDeviceSize MemoryChunk::getRemainingSize() const
 	return m_unallocatedSize;
 }
 
-MemoryChunk::MemoryChunk(const VkDeviceSize size, const uint32_t memoryType, const VkDeviceMemory vkHandle)
-	: m_size(size), m_memoryType(memoryType), m_memory(vkHandle), m_unallocatedSize(size)
+VkDeviceSize MemoryChunk::getUsedSize() const
+{
+	return m_size - m_unallocatedSize;
+}
+
+uint32_t MemoryChunk::getAllocationCount() const
 {
-	m_unallocatedData[0] = size;
+	return m_allocationCount;
 }
 
-void MemoryChunk::defragment()
+uint32_t MemoryChunk::getFreeRangeCount() const
 {
-	if (m_unallocatedSize == m_size)
+	if (m_strategy == TLSF)
+		return m_tlsf.getFreeRangeCount();
+
+	return static_cast<uint32_t>(m_unallocatedData.size());
+}
+
+std::vector<std::pair<VkDeviceSize, VkDeviceSize>> MemoryChunk::getFreeRanges() const
+{
+	if (m_strategy == TLSF)
+		return m_tlsf.getFreeRanges();
+
+	return {m_unallocatedData.begin(), m_unallocatedData.end()};
+}
+
+MemoryChunk::AllocationStrategy MemoryChunk::getAllocationStrategy() const
+{
+	return m_strategy;
+}
+
+MemoryChunk::ResourceKind MemoryChunk::getResourceKind() const
+{
+	return m_resourceKind;
+}
+
+bool MemoryChunk::isMapped() const
+{
+	return m_mappedData != nullptr;
+}
+
+bool MemoryChunk::isDedicated() const
+{
+	return m_dedicated;
+}
+
+void* MemoryChunk::getMappedData() const
+{
+	return m_mappedData;
+}
+
+MemoryChunk::MemoryChunk(const VkDeviceSize size, const uint32_t memoryType, const VkDeviceMemory vkHandle, const AllocationStrategy strategy, void* mappedData, const bool dedicated, const ResourceKind resourceKind)
+	: m_size(size), m_memoryType(memoryType), m_memory(vkHandle), m_mappedData(mappedData), m_dedicated(dedicated), m_resourceKind(resourceKind), m_strategy(strategy), m_unallocatedSize(size)
+{
+	if (m_strategy == TLSF)
+		m_tlsf = TLSFAllocator(size);
+	else
+		addUnallocatedRange(0, size);
+}
+
+void MemoryChunk::defragment(const VkDeviceSize offset)
+{
+	if (m_unallocatedSize == m_size && m_unallocatedData.size() == 1)
 	{
 		Logger::print("No need to defragment empty memory chunk " + std::to_string(m_id));
 		return;
 	}
 	Logger::pushContext("Memory defragmentation");
-	Logger::print("Defragmenting memory chunk " + std::to_string(m_id));
+	Logger::print("Defragmenting memory chunk " + std::to_string(m_id) + " around offset " + std::to_string(offset));
 	uint32_t mergeCount = 0;
-	for (auto it = m_unallocatedData.begin(); it != m_unallocatedData.end();)
+
+	auto it = m_unallocatedData.find(offset);
+	if (it != m_unallocatedData.begin())
 	{
-		auto next = std::next(it);
-		if (next == m_unallocatedData.end())
+		const auto prev = std::prev(it);
+		if (prev->first + prev->second == it->first)
+			it = prev;
+	}
+
+	auto next = std::next(it);
+	while (next != m_unallocatedData.end() && it->first + it->second == next->first)
+	{
+		const VkDeviceSize mergedOffset = it->first;
+		const VkDeviceSize mergedSize = it->second + next->second;
+		const VkDeviceSize nextOffset = next->first;
+
+		removeUnallocatedRange(nextOffset);
+		removeUnallocatedRange(mergedOffset);
+		addUnallocatedRange(mergedOffset, mergedSize);
+
+		Logger::print("Merged blocks at offsets " + std::to_string(mergedOffset) + " and " + std::to_string(nextOffset) + ", new size: " + std::to_string(mergedSize));
+		mergeCount++;
+
+		it = m_unallocatedData.find(mergedOffset);
+		next = std::next(it);
+	}
+	Logger::print("Defragmented " + std::to_string(mergeCount) + " blocks");
+	Logger::popContext();
+}
+
+MemoryChunk::MemoryBlock MemoryChunk::makeBlock(const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	return {size, offset, m_id, m_slot, m_generation, m_memoryType, m_resourceKind, m_dedicated};
+}
+
+void MemoryChunk::addUnallocatedRange(const VkDeviceSize offset, const VkDeviceSize size)
+{
+	m_unallocatedData[offset] = size;
+	m_unallocatedBySize.insert({size, offset});
+}
+
+void MemoryChunk::removeUnallocatedRange(const VkDeviceSize offset)
+{
+	const auto it = m_unallocatedData.find(offset);
+	if (it == m_unallocatedData.end())
+		return;
+
+	m_unallocatedBySize.erase({it->second, it->first});
+	m_unallocatedData.erase(it);
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(std::unique_ptr<MemoryBackend> backend, const VkDeviceSize defaultChunkSize)
+	: m_backend(std::move(backend)), m_memoryStructure(m_backend->getMemoryProperties()), m_chunkSize(defaultChunkSize)
+{
+	m_nonCoherentAtomSize = std::max(m_backend->getNonCoherentAtomSize(), static_cast<VkDeviceSize>(1));
+	m_bufferImageGranularity = std::max(m_backend->getBufferImageGranularity(), static_cast<VkDeviceSize>(1));
+	for (uint32_t i = 0; i < m_memoryStructure.m_memoryProperties.memoryHeapCount; i++)
+		m_sync->heapBudgets[i] = m_memoryStructure.m_memoryProperties.memoryHeaps[i].size;
+	refreshBudget();
+
+	Logger::print(std::string("Dedicated allocations ") + (isDedicatedAllocationSupported() ? "enabled" : "disabled") + ", memory budget queries " + (isMemoryBudgetSupported() ? "enabled" : "disabled"));
+	if (separatesResourceKinds())
+		Logger::print("Buffer image granularity is " + std::to_string(m_bufferImageGranularity) + " bytes, buffers and images will be kept in separate chunks");
+}
+
+VulkanMemoryAllocator::VulkanMemoryAllocator(const VulkanDevice& device, const VkDeviceSize defaultChunkSize)
+	: VulkanMemoryAllocator(std::make_unique<VulkanMemoryBackend>(device), defaultChunkSize)
+{
+
+}
+
+void VulkanMemoryAllocator::free()
+{
+	stopCapture();
+
+	// Whatever is still parked in the thread caches goes away with the chunks
+	{
+		std::scoped_lock cacheLock(m_sync->threadCacheMutex);
+		for (const std::shared_ptr<ThreadCache>& cache : m_sync->threadCaches)
 		{
-			break;
+			std::scoped_lock lock(cache->mutex);
+			cache->blocks.clear();
 		}
-		if (next != m_unallocatedData.end() && it->first + it->second == next->first)
+	}
+
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	for (const MemoryChunk& memoryBlock : getChunks())
+	{
+		if (memoryBlock.isMapped())
+			m_backend->unmapMemory(memoryBlock.m_memory);
+		m_backend->freeMemory(memoryBlock.m_memory);
+	}
+	m_chunkSlots.clear();
+	m_freeChunkSlots.clear();
+
+	for (TypeUsage& typeUsage : m_sync->typeUsages)
+	{
+		std::scoped_lock lock(typeUsage.mutex);
+		typeUsage.usage = {};
+		typeUsage.largestFreeRangeSum = 0;
+		typeUsage.largestFreeRanges.clear();
+	}
+}
+
+MemoryChunk::MemoryBlock VulkanMemoryAllocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t memoryType, const DedicatedResource& resource)
+{
+	std::optional<MemoryChunk::MemoryBlock> block;
+	if (!prefersDedicatedAllocation(resource))
+		block = takeCachedBlock(size, alignment, 1U << memoryType, getResourceKind(resource));
+	if (!block.has_value())
+		block = tryAllocate(size, alignment, memoryType, resource);
+	if (block->size == 0)
+		throw std::runtime_error(getAllocationFailureMessage(size, memoryType));
+
+	m_sync->allocationCount++;
+	captureAllocation(block.value(), alignment);
+	return block.value();
+}
+
+MemoryChunk::MemoryBlock VulkanMemoryAllocator::searchAndAllocate(const VkDeviceSize size, const VkDeviceSize alignment, const MemoryPropertyPreferences properties, const uint32_t typeFilter, const bool includeHidden, const DedicatedResource& resource)
+{
+	struct Candidate
+	{
+		uint32_t type;
+		bool hasUndesired;
+		bool hasPreferred;
+		bool hasSuitableChunk;
+		VkDeviceSize remainingSize;
+	};
+
+	const MemoryChunk::ResourceKind resourceKind = getResourceKind(resource);
+	const std::vector<uint32_t> types = m_memoryStructure.getMemoryTypes(properties.desiredProperties, typeFilter);
+
+	// A recycled block is only a match when it does not rank below another candidate, i.e. its type has no undesired properties
+	// and no type is preferred over the others
+	if (properties.preferredProperties == 0 && !prefersDedicatedAllocation(resource))
+	{
+		uint32_t typeMask = 0;
+		for (const uint32_t type : types)
 		{
-			
-			it->second += next->second;
-			if (next->first == m_biggestChunk || it->second > m_unallocatedData[m_biggestChunk])
-				m_biggestChunk = it->first;
+			if ((includeHidden || !isMemoryTypeHidden(type)) && !m_memoryStructure.doesMemoryContainProperties(type, properties.undesiredProperties))
+				typeMask |= 1U << type;
+		}
 
-			Logger::print("Merged blocks at offsets " + std::to_string(it->first) + " and " + std::to_string(next->first) + ", new size: " + std::to_string(it->second));
-			mergeCount++;
+		const std::optional<MemoryChunk::MemoryBlock> block = takeCachedBlock(size, alignment, typeMask, resourceKind);
+		if (block.has_value())
+		{
+			m_sync->allocationCount++;
+			captureAllocation(block.value(), alignment);
+			return block.value();
+		}
+	}
 
-			m_unallocatedData.erase(next);
+	std::vector<Candidate> candidates;
+	for (const uint32_t type : types)
+	{
+		if (!includeHidden && isMemoryTypeHidden(type))
+			continue;
 
+		const bool doesMemoryHaveUndesired = m_memoryStructure.doesMemoryContainProperties(type, properties.undesiredProperties);
+		if (!properties.allowUndesired && doesMemoryHaveUndesired)
+			continue;
+
+		const bool doesMemoryHavePreferred = properties.preferredProperties != 0 && m_memoryStructure.doesMemoryContainProperties(type, properties.preferredProperties);
+		candidates.push_back({type, doesMemoryHaveUndesired, doesMemoryHavePreferred, suitableChunkExists(type, size, resourceKind), getRemainingSize(m_memoryStructure.m_memoryProperties.memoryTypes[type].heapIndex)});
+	}
+
+	if (candidates.empty())
+		throw std::runtime_error("No memory type matches the requested properties for an allocation of " + compactBytes(size));
+
+	// Types without undesired properties first, then the ones with the preferred properties, then the ones that can serve the
+	// request from an existing chunk, then the emptiest heaps
+	std::ranges::stable_sort(candidates, [](const Candidate& a, const Candidate& b)
+	{
+		if (a.hasUndesired != b.hasUndesired)
+			return !a.hasUndesired;
+		if (a.hasPreferred != b.hasPreferred)
+			return a.hasPreferred;
+		if (a.hasSuitableChunk != b.hasSuitableChunk)
+			return a.hasSuitableChunk;
+		return a.remainingSize > b.remainingSize;
+	});
+
+	if (properties.preferredProperties != 0 && !candidates.front().hasPreferred)
+		Logger::print("No memory type with the preferred properties " + string_VkMemoryPropertyFlags(properties.preferredProperties) + " is available, falling back to regular memory");
+
+	for (const Candidate& candidate : candidates)
+	{
+		const MemoryChunk::MemoryBlock block = tryAllocate(size, alignment, candidate.type, resource);
+		if (block.size != 0)
+		{
+			m_sync->allocationCount++;
+			captureAllocation(block, alignment);
+			return block;
+		}
+
+		Logger::print("Memory type " + std::to_string(candidate.type) + " could not serve " + compactBytes(size) + ", falling back to the next candidate");
+	}
+
+	throw std::runtime_error(getAllocationFailureMessage(size, candidates.front().type));
+}
+
+void VulkanMemoryAllocator::deallocate(const MemoryChunk::MemoryBlock& block)
+{
+	m_sync->deallocationCount++;
+	captureDeallocation(block);
+	if (!cacheBlock(block))
+		releaseBlock(block);
+}
+
+void VulkanMemoryAllocator::deallocateUncached(const MemoryChunk::MemoryBlock& block)
+{
+	m_sync->deallocationCount++;
+	captureDeallocation(block);
+	releaseBlock(block);
+}
+
+VkDeviceSize VulkanMemoryAllocator::trim()
+{
+	flushThreadCaches();
+	const VkDeviceSize releasedSize = evictEmptyChunks(UINT32_MAX);
+	Logger::print("Trimmed " + compactBytes(releasedSize) + " of retained memory");
+	return releasedSize;
+}
+
+void* VulkanMemoryAllocator::getMappedData(const MemoryChunk::MemoryBlock& block) const
+{
+	std::shared_lock listLock(m_sync->chunkListMutex);
+	const MemoryChunk& chunk = getChunk(block);
+	if (!chunk.isMapped())
+		return nullptr;
+
+	return static_cast<char*>(chunk.m_mappedData) + block.offset;
+}
+
+void VulkanMemoryAllocator::flush(const MemoryChunk::MemoryBlock& block, const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	const std::optional<VkMappedMemoryRange> range = getNonCoherentRange(block, size, offset);
+	if (range.has_value() && m_backend->flushMemoryRange(range.value()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to flush mapped memory range");
+}
+
+void VulkanMemoryAllocator::invalidate(const MemoryChunk::MemoryBlock& block, const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	const std::optional<VkMappedMemoryRange> range = getNonCoherentRange(block, size, offset);
+	if (range.has_value() && m_backend->invalidateMemoryRange(range.value()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to invalidate mapped memory range");
+}
+
+void VulkanMemoryAllocator::hideMemoryType(const uint32_t type)
+{
+	Logger::print("Hiding memory type " + std::to_string(type));
+	m_hiddenTypes.insert(type);
+}
+
+void VulkanMemoryAllocator::unhideMemoryType(const uint32_t type)
+{
+	Logger::print("Unhiding memory type " + std::to_string(type));
+	m_hiddenTypes.erase(type);
+}
+
+void VulkanMemoryAllocator::setAllocationStrategy(const uint32_t memoryType, const MemoryChunk::AllocationStrategy strategy)
+{
+	Logger::print("Memory type " + std::to_string(memoryType) + " will use the " + (strategy == MemoryChunk::TLSF ? "TLSF" : "best fit") + " strategy for new chunks");
+	m_allocationStrategies[memoryType] = strategy;
+}
+
+MemoryChunk::AllocationStrategy VulkanMemoryAllocator::getAllocationStrategy(const uint32_t memoryType) const
+{
+	const auto it = m_allocationStrategies.find(memoryType);
+	return it != m_allocationStrategies.end() ? it->second : MemoryChunk::BEST_FIT;
+}
+
+void VulkanMemoryAllocator::setChunkPolicy(const ChunkPolicy& policy)
+{
+	m_chunkPolicy = policy;
+	m_chunkPolicy.growthFactor = std::max(m_chunkPolicy.growthFactor, 1.0f);
+	m_chunkPolicy.maxChunkSize = std::max(m_chunkPolicy.maxChunkSize, m_chunkSize);
+	for (uint32_t type = 0; type < m_memoryStructure.m_memoryProperties.memoryTypeCount; type++)
+	{
+		std::scoped_lock typeLock(m_sync->typeMutexes[type]);
+		releaseExpiredChunks(type);
+	}
+}
+
+const VulkanMemoryAllocator::ChunkPolicy& VulkanMemoryAllocator::getChunkPolicy() const
+{
+	return m_chunkPolicy;
+}
+
+VulkanMemoryAllocator::ChunkStatistics VulkanMemoryAllocator::getChunkStatistics() const
+{
+	ChunkStatistics statistics{m_sync->driverAllocations, m_sync->driverFrees, m_sync->avoidedAllocations};
+
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	for (const MemoryChunk& chunk : getChunks())
+	{
+		if (chunk.isEmpty())
+			statistics.retainedChunks++;
+	}
+	return statistics;
+}
+
+VulkanMemoryAllocator::MemoryStatistics VulkanMemoryAllocator::getStatistics() const
+{
+	const VkPhysicalDeviceMemoryProperties& properties = m_memoryStructure.m_memoryProperties;
+	MemoryStatistics statistics{};
+
+	// Fragmentation is measured inside each chunk, free space split across chunks does not count
+	std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapLargestFreeSums{};
+	VkDeviceSize totalLargestFreeSum = 0;
+	for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+	{
+		TypeUsage& typeUsage = m_sync->typeUsages[i];
+		VkDeviceSize largestFreeRangeSum;
+		{
+			std::scoped_lock lock(typeUsage.mutex);
+			statistics.types[i] = typeUsage.usage;
+			statistics.types[i].largestFreeRange = typeUsage.largestFreeRanges.empty() ? 0 : *typeUsage.largestFreeRanges.rbegin();
+			largestFreeRangeSum = typeUsage.largestFreeRangeSum;
 		}
-		else
+
+		const uint32_t heap = properties.memoryTypes[i].heapIndex;
+		addUsage(statistics.heaps[heap], statistics.types[i]);
+		addUsage(statistics.total, statistics.types[i]);
+		heapLargestFreeSums[heap] += largestFreeRangeSum;
+		totalLargestFreeSum += largestFreeRangeSum;
+		computeFragmentation(statistics.types[i], largestFreeRangeSum);
+	}
+	for (uint32_t i = 0; i < properties.memoryHeapCount; i++)
+		computeFragmentation(statistics.heaps[i], heapLargestFreeSums[i]);
+	computeFragmentation(statistics.total, totalLargestFreeSum);
+
+	statistics.allocations = m_sync->allocationCount;
+	statistics.deallocations = m_sync->deallocationCount;
+
+	std::scoped_lock statisticsLock(m_sync->statisticsMutex);
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const float elapsedSeconds = std::chrono::duration<float>(now - m_lastStatisticsSample.time).count();
+	if (elapsedSeconds > 0.0f)
+	{
+		statistics.allocationsPerSecond = static_cast<float>(statistics.allocations - m_lastStatisticsSample.allocations) / elapsedSeconds;
+		statistics.deallocationsPerSecond = static_cast<float>(statistics.deallocations - m_lastStatisticsSample.deallocations) / elapsedSeconds;
+	}
+	m_lastStatisticsSample = {now, statistics.allocations, statistics.deallocations};
+	return statistics;
+}
+
+std::string VulkanMemoryAllocator::toJson() const
+{
+	const VkPhysicalDeviceMemoryProperties& properties = m_memoryStructure.m_memoryProperties;
+	const MemoryStatistics statistics = getStatistics();
+	const auto usageToJson = [](const MemoryUsage& usage)
+	{
+		return "\"reserved\":" + std::to_string(usage.reservedSize) + ",\"used\":" + std::to_string(usage.usedSize) + ",\"largestFreeRange\":" + std::to_string(usage.largestFreeRange)
+			+ ",\"chunks\":" + std::to_string(usage.chunkCount) + ",\"allocations\":" + std::to_string(usage.allocationCount) + ",\"freeRanges\":" + std::to_string(usage.freeRangeCount)
+			+ ",\"fragmentation\":" + std::to_string(usage.fragmentation);
+	};
+
+	std::string json = "{\"allocations\":" + std::to_string(statistics.allocations) + ",\"deallocations\":" + std::to_string(statistics.deallocations)
+		+ ",\"allocationsPerSecond\":" + std::to_string(statistics.allocationsPerSecond) + ",\"deallocationsPerSecond\":" + std::to_string(statistics.deallocationsPerSecond)
+		+ ",\"total\":{" + usageToJson(statistics.total) + "},\"heaps\":[";
+	for (uint32_t i = 0; i < properties.memoryHeapCount; i++)
+	{
+		const std::optional<VkDeviceSize> budget = getHeapBudget(i);
+		json += std::string(i > 0 ? "," : "") + "{\"index\":" + std::to_string(i) + ",\"size\":" + std::to_string(properties.memoryHeaps[i].size)
+			+ ",\"budget\":" + (budget.has_value() ? std::to_string(budget.value()) : "null") + "," + usageToJson(statistics.heaps[i]) + "}";
+	}
+	json += "],\"types\":[";
+	for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+	{
+		json += std::string(i > 0 ? "," : "") + "{\"index\":" + std::to_string(i) + ",\"heap\":" + std::to_string(properties.memoryTypes[i].heapIndex)
+			+ ",\"flags\":" + std::to_string(properties.memoryTypes[i].propertyFlags) + "," + usageToJson(statistics.types[i]) + "}";
+	}
+
+	// Block map of every chunk, the used ranges are the gaps between the free ones
+	json += "],\"chunks\":[";
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	bool firstChunk = true;
+	for (const MemoryChunk& chunk : getChunks())
+	{
+		json += std::string(firstChunk ? "" : ",") + "{\"id\":" + std::to_string(chunk.getID()) + ",\"type\":" + std::to_string(chunk.m_memoryType) + ",\"size\":" + std::to_string(chunk.m_size)
+			+ ",\"strategy\":\"" + (chunk.m_strategy == MemoryChunk::TLSF ? "tlsf" : "best_fit") + "\",\"dedicated\":" + (chunk.m_dedicated ? "true" : "false")
+			+ ",\"kind\":\"" + (chunk.m_resourceKind == MemoryChunk::OPTIMAL ? "optimal" : "linear") + "\",\"mapped\":" + (chunk.isMapped() ? "true" : "false") + ",\"allocations\":" + std::to_string(chunk.m_allocationCount) + ",\"free\":[";
+		bool first = true;
+		for (const auto& [offset, size] : chunk.getFreeRanges())
 		{
-			++it;
+			json += std::string(first ? "" : ",") + "[" + std::to_string(offset) + "," + std::to_string(size) + "]";
+			first = false;
 		}
+		json += "]}";
+		firstChunk = false;
 	}
-	Logger::print("Defragmented " + std::to_string(mergeCount) + " blocks");
-	Logger::popContext();
+	json += "]}";
+	return json;
 }
 
-VulkanMemoryAllocator::VulkanMemoryAllocator(const VulkanDevice& device, const VkDeviceSize defaultChunkSize)
-	: m_memoryStructure(device.getGPU()), m_chunkSize(defaultChunkSize), m_device(device.getID())
+void VulkanMemoryAllocator::startCapture(const std::string& filename)
 {
+	std::scoped_lock lock(m_sync->captureMutex);
+	m_sync->captureFile = std::ofstream(filename, std::ios::trunc);
+	if (!m_sync->captureFile.is_open())
+		throw std::runtime_error("Failed to open allocation trace " + filename);
 
+	m_sync->capturedIDs.clear();
+	m_sync->nextCapturedID = 0;
+	m_sync->isCapturing = true;
+	Logger::print("Capturing allocations to " + filename);
 }
 
-void VulkanMemoryAllocator::free()
+void VulkanMemoryAllocator::stopCapture()
+{
+	std::scoped_lock lock(m_sync->captureMutex);
+	if (!m_sync->isCapturing)
+		return;
+
+	m_sync->isCapturing = false;
+	m_sync->captureFile.close();
+	m_sync->capturedIDs.clear();
+	Logger::print("Stopped capturing allocations");
+}
+
+const MemoryStructure& VulkanMemoryAllocator::getMemoryStructure() const
+{
+	return m_memoryStructure;
+}
+
+VkDeviceSize VulkanMemoryAllocator::getRemainingSize(const uint32_t heap) const
+{
+	std::scoped_lock lock(m_sync->budgetMutex);
+	const VkDeviceSize budget = m_sync->heapBudgets[heap];
+	const VkDeviceSize usage = m_sync->heapUsages[heap];
+	return budget > usage ? budget - usage : 0;
+}
+
+std::optional<VkDeviceSize> VulkanMemoryAllocator::getHeapBudget(const uint32_t heap) const
 {
-	for (const MemoryChunk& memoryBlock : m_memoryChunks)
+	if (!isMemoryBudgetSupported())
+		return std::nullopt;
+	return getRemainingSize(heap);
+}
+
+void VulkanMemoryAllocator::refreshBudget()
+{
+	const std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> budgetProperties = m_backend->getMemoryBudget();
+	if (!budgetProperties.has_value())
+		return;
+
+	// The budget already accounts for what other processes use, the usage is that of this process alone
+	std::scoped_lock lock(m_sync->budgetMutex);
+	for (uint32_t i = 0; i < m_memoryStructure.m_memoryProperties.memoryHeapCount; i++)
 	{
-		vkFreeMemory(VulkanContext::getDevice(m_device).m_vkHandle, memoryBlock.m_memory, nullptr);
+		m_sync->heapBudgets[i] = budgetProperties->heapBudget[i];
+		m_sync->heapUsages[i] = budgetProperties->heapUsage[i];
 	}
-	m_memoryChunks.clear();
 }
 
-MemoryChunk::MemoryBlock VulkanMemoryAllocator::allocate(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t memoryType)
+bool VulkanMemoryAllocator::isDedicatedAllocationSupported() const
 {
-	VkDeviceSize chunkSize = m_chunkSize;
-	if (size < m_chunkSize)
+	return m_backend->supportsDedicatedAllocation();
+}
+
+bool VulkanMemoryAllocator::isMemoryBudgetSupported() const
+{
+	return m_backend->supportsMemoryBudget();
+}
+
+bool VulkanMemoryAllocator::suitableChunkExists(const uint32_t memoryType, const VkDeviceSize size, const MemoryChunk::ResourceKind resourceKind) const
+{
+	std::scoped_lock typeLock(m_sync->typeMutexes[memoryType]);
+	std::shared_lock listLock(m_sync->chunkListMutex);
+	for (const MemoryChunk& chunk : getChunks())
 	{
-		for (auto& memoryChunk : m_memoryChunks)
+		if (chunk.m_memoryType == memoryType && !chunk.isDedicated() && canHostResourceKind(chunk, resourceKind) && chunk.getBiggestChunkSize() >= size)
 		{
-			if (memoryChunk.m_memoryType == memoryType)
+			return true;
+		}
+	}
+	return false;
+}
+
+bool VulkanMemoryAllocator::separatesResourceKinds() const
+{
+	return m_bufferImageGranularity > 1;
+}
+
+bool VulkanMemoryAllocator::isMemoryTypeHidden(const unsigned value) const
+{
+	return m_hiddenTypes.contains(value);
+}
+
+MemoryChunk::MemoryBlock VulkanMemoryAllocator::tryAllocate(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t memoryType, const DedicatedResource& resource)
+{
+	// Held for the whole call, only the chunk list lock is taken and released around each step
+	std::unique_lock typeLock(m_sync->typeMutexes[memoryType]);
+	releaseExpiredChunks(memoryType);
+
+	const MemoryChunk::ResourceKind resourceKind = getResourceKind(resource);
+	if (prefersDedicatedAllocation(resource))
+	{
+		const VkDeviceMemory memory = allocateDeviceMemory(size, memoryType, &resource);
+		if (memory == VK_NULL_HANDLE)
+			return {};
+
+		std::unique_lock listLock(m_sync->chunkListMutex);
+		MemoryChunk& chunk = createChunk(size, memoryType, memory, true, resourceKind);
+		const MemoryChunk::MemoryBlock block = chunk.allocate(size, alignment);
+		reportChunkUsage(chunk);
+		return block;
+	}
+
+	{
+		std::shared_lock listLock(m_sync->chunkListMutex);
+		for (MemoryChunk& memoryChunk : getChunks())
+		{
+			if (memoryChunk.m_memoryType == memoryType && !memoryChunk.isDedicated() && canHostResourceKind(memoryChunk, resourceKind))
 			{
+				// An empty chunk holds no resource, it can switch to the kind it is now serving
+				const bool wasRetained = memoryChunk.isEmpty();
+				if (wasRetained)
+					memoryChunk.m_resourceKind = resourceKind;
+
 				const MemoryChunk::MemoryBlock block = memoryChunk.allocate(size, alignment);
-				if (block.size != 0) return block;
+				if (block.size != 0)
+				{
+					reportChunkUsage(memoryChunk);
+					if (wasRetained)
+					{
+						m_sync->avoidedAllocations++;
+						Logger::print("Reused retained empty chunk " + std::to_string(memoryChunk.getID()));
+					}
+					return block;
+				}
 			}
 		}
 	}
-	else
+
+	const VkDeviceSize growthSize = getNextChunkSize(memoryType);
+	VkDeviceSize chunkSize = std::max(growthSize, size);
+
+	VkDeviceMemory memory = allocateDeviceMemory(chunkSize, memoryType, nullptr);
+	if (memory == VK_NULL_HANDLE && chunkSize > size)
 	{
+		// A grown chunk may not fit anymore, the request itself still might
+		Logger::print("Could not allocate chunk of size " + compactBytes(chunkSize) + ", retrying with the requested size");
 		chunkSize = size;
+		memory = allocateDeviceMemory(chunkSize, memoryType, nullptr);
 	}
-	
+	if (memory == VK_NULL_HANDLE)
+		return {};
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = chunkSize;
-	allocInfo.memoryTypeIndex = memoryType;
-
-	VkDeviceMemory memory;
-	if (vkAllocateMemory(VulkanContext::getDevice(m_device).m_vkHandle, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+	if (chunkSize == growthSize)
 	{
-		throw std::runtime_error("Failed to allocate memory");
+		const VkDeviceSize grownSize = static_cast<VkDeviceSize>(static_cast<double>(growthSize) * m_chunkPolicy.growthFactor);
+		m_nextChunkSizes[memoryType] = std::max(growthSize, std::min(grownSize, m_chunkPolicy.maxChunkSize));
 	}
 
-	m_memoryChunks.push_back(MemoryChunk(chunkSize, memoryType, memory));
-	Logger::print("Allocated chunk of size " + compactBytes(chunkSize) + " of memory type " + std::to_string(memoryType) + " (ID: " + std::to_string(m_memoryChunks.back().getID()) + ")");
-	return m_memoryChunks.back().allocate(size, alignment);
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	MemoryChunk& chunk = createChunk(chunkSize, memoryType, memory, false, resourceKind);
+	const MemoryChunk::MemoryBlock block = chunk.allocate(size, alignment);
+	reportChunkUsage(chunk);
+	return block;
+}
+
+void VulkanMemoryAllocator::captureAllocation(const MemoryChunk::MemoryBlock& block, const VkDeviceSize alignment)
+{
+	if (!m_sync->isCapturing.load(std::memory_order_relaxed))
+		return;
+
+	std::scoped_lock lock(m_sync->captureMutex);
+	if (!m_sync->isCapturing)
+		return;
+
+	const uint64_t id = m_sync->nextCapturedID++;
+	m_sync->capturedIDs[{block.chunk, block.offset}] = id;
+	m_sync->captureFile << "a " << id << ' ' << block.size << ' ' << std::max(alignment, static_cast<VkDeviceSize>(1)) << ' ' << block.memoryType << '\n';
+}
+
+void VulkanMemoryAllocator::captureDeallocation(const MemoryChunk::MemoryBlock& block)
+{
+	if (!m_sync->isCapturing.load(std::memory_order_relaxed))
+		return;
+
+	std::scoped_lock lock(m_sync->captureMutex);
+	// Blocks allocated before the capture started have no id, their frees are left out
+	const auto it = m_sync->capturedIDs.find({block.chunk, block.offset});
+	if (!m_sync->isCapturing || it == m_sync->capturedIDs.end())
+		return;
+
+	m_sync->captureFile << "f " << it->second << '\n';
+	m_sync->capturedIDs.erase(it);
 }
 
-MemoryChunk::MemoryBlock VulkanMemoryAllocator::searchAndAllocate(const VkDeviceSize size, const VkDeviceSize alignment, const MemoryPropertyPreferences properties, const uint32_t typeFilter, const bool includeHidden)
+VulkanMemoryAllocator::ThreadCache& VulkanMemoryAllocator::getThreadCache()
 {
-	const std::vector<uint32_t> memoryType = m_memoryStructure.getMemoryTypes(properties.desiredProperties, typeFilter);
-	uint32_t bestType = 0;
-	VkDeviceSize bestSize = 0;
-	bool doesBestHaveUndesired = false;
-	for (const auto& type : memoryType)
+	// Keyed by allocator so that a thread working with several devices keeps their blocks apart. The allocator keeps a reference
+	// to every cache as well, so that blocks parked by a thread that has since exited can still be flushed
+	thread_local std::unordered_map<uint64_t, std::shared_ptr<ThreadCache>> caches;
+	std::shared_ptr<ThreadCache>& cache = caches[m_instanceID];
+	if (cache == nullptr)
 	{
-		if (!includeHidden && m_hiddenTypes.contains(type))
-			continue;
+		cache = std::make_shared<ThreadCache>();
+		std::scoped_lock lock(m_sync->threadCacheMutex);
+		m_sync->threadCaches.push_back(cache);
+	}
+	return *cache;
+}
 
-		const bool doesMemoryHaveUndesired = m_memoryStructure.doesMemoryContainProperties(type, properties.undesiredProperties);
-		if (!properties.allowUndesired && doesMemoryHaveUndesired)
-			continue;
+std::optional<MemoryChunk::MemoryBlock> VulkanMemoryAllocator::takeCachedBlock(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t typeMask, const MemoryChunk::ResourceKind resourceKind)
+{
+	if (size > THREAD_CACHE_MAX_BLOCK_SIZE)
+		return std::nullopt;
 
-		if (bestSize != 0 && !doesBestHaveUndesired && doesMemoryHaveUndesired)
+	ThreadCache& cache = getThreadCache();
+	std::scoped_lock lock(cache.mutex);
+	for (auto it = cache.blocks.rbegin(); it != cache.blocks.rend(); ++it)
+	{
+		if (it->size != size || !(typeMask & (1U << it->memoryType)))
+			continue;
+		if (alignment > 1 && it->offset % alignment != 0)
+			continue;
+		if (separatesResourceKinds() && it->resourceKind != resourceKind)
 			continue;
 
-		if (suitableChunkExists(type, size))
-			return allocate(size, alignment, type);
+		const MemoryChunk::MemoryBlock block = *it;
+		cache.blocks.erase(std::next(it).base());
+		return block;
+	}
+	return std::nullopt;
+}
 
-		const VkDeviceSize remainingSize = getRemainingSize(m_memoryStructure.m_memoryProperties.memoryTypes[type].heapIndex);
-		if (remainingSize >= bestSize)
+bool VulkanMemoryAllocator::cacheBlock(const MemoryChunk::MemoryBlock& block)
+{
+	if (block.dedicated || block.size == 0 || block.size > THREAD_CACHE_MAX_BLOCK_SIZE)
+		return false;
+
+	ThreadCache& cache = getThreadCache();
+	std::scoped_lock lock(cache.mutex);
+	if (cache.blocks.size() >= THREAD_CACHE_CAPACITY)
+		return false;
+
+	cache.blocks.push_back(block);
+	return true;
+}
+
+void VulkanMemoryAllocator::flushThreadCaches()
+{
+	std::vector<MemoryChunk::MemoryBlock> blocks;
+	{
+		std::scoped_lock cacheLock(m_sync->threadCacheMutex);
+		for (const std::shared_ptr<ThreadCache>& cache : m_sync->threadCaches)
 		{
-			bestType = type;
-			bestSize = remainingSize;
-			doesBestHaveUndesired = doesMemoryHaveUndesired;
+			std::scoped_lock lock(cache->mutex);
+			blocks.insert(blocks.end(), cache->blocks.begin(), cache->blocks.end());
+			cache->blocks.clear();
 		}
 	}
-	return allocate(size, alignment, bestType);
+
+	for (const MemoryChunk::MemoryBlock& block : blocks)
+		releaseBlock(block);
 }
 
-void VulkanMemoryAllocator::deallocate(const MemoryChunk::MemoryBlock& block)
+void VulkanMemoryAllocator::releaseBlock(const MemoryChunk::MemoryBlock& block)
 {
-	uint32_t chunkIndex = static_cast<uint32_t>(m_memoryChunks.size());
-	for (uint32_t i = 0; i < m_memoryChunks.size(); i++)
+	const uint32_t memoryType = block.memoryType;
+	std::unique_lock typeLock(m_sync->typeMutexes[memoryType]);
+
+	bool releaseChunks;
 	{
-		if (m_memoryChunks[i].getID() == block.chunk)
+		std::shared_lock listLock(m_sync->chunkListMutex);
+		MemoryChunk& chunk = getChunk(block);
+		chunk.deallocate(block);
+		reportChunkUsage(chunk);
+		if (chunk.isEmpty() && !chunk.isDedicated())
 		{
-			chunkIndex = i;
-			break;
+			chunk.m_emptySince = std::chrono::steady_clock::now();
+			Logger::print("Retaining empty chunk " + std::to_string(block.chunk));
 		}
+		releaseChunks = chunk.isDedicated() || (chunk.isEmpty() && getEmptyChunkCount(memoryType) > m_chunkPolicy.maxRetainedEmptyChunks);
 	}
 
-	if (chunkIndex == m_memoryChunks.size())
+	if (releaseChunks)
 	{
-		throw std::runtime_error("Block does not belong to any chunk!");
+		// The chunk may have been evicted by another thread while no list lock was held
+		std::unique_lock listLock(m_sync->chunkListMutex);
+		const MemoryChunk* dedicatedChunk = findChunk(block);
+		if (dedicatedChunk != nullptr && dedicatedChunk->isDedicated())
+			freeChunk(block.slot);
+
+		// Over the limit the chunk that has been empty the longest goes first
+		while (getEmptyChunkCount(memoryType) > m_chunkPolicy.maxRetainedEmptyChunks)
+		{
+			const MemoryChunk* oldest = nullptr;
+			for (const MemoryChunk& chunk : getChunks())
+			{
+				if (chunk.m_memoryType != memoryType || !chunk.isEmpty() || chunk.isDedicated())
+					continue;
+				if (oldest == nullptr || chunk.m_emptySince < oldest->m_emptySince)
+					oldest = &chunk;
+			}
+			freeChunk(oldest->m_slot);
+		}
 	}
 
-	m_memoryChunks[chunkIndex].deallocate(block);
-	if (m_memoryChunks[chunkIndex].isEmpty())
+	releaseExpiredChunks(memoryType);
+}
+
+bool VulkanMemoryAllocator::prefersDedicatedAllocation(const DedicatedResource& resource) const
+{
+	return m_backend->prefersDedicatedAllocation(resource.buffer, resource.image);
+}
+
+VkDeviceMemory VulkanMemoryAllocator::allocateDeviceMemory(const VkDeviceSize size, const uint32_t memoryType, const DedicatedResource* dedicatedResource)
+{
+	const uint32_t heap = m_memoryStructure.m_memoryProperties.memoryTypes[memoryType].heapIndex;
+
+	// Going over budget either fails or pages memory out, give retained chunks back first and skip the heap if that is not enough
+	if (size > getRemainingSize(heap))
 	{
-		vkFreeMemory(VulkanContext::getDevice(m_device).m_vkHandle, m_memoryChunks[chunkIndex].m_memory, nullptr);
-		m_memoryChunks.erase(m_memoryChunks.begin() + chunkIndex);
-		Logger::print("Freed empty chunk " + std::to_string(block.chunk));
+		evictEmptyChunks(heap);
+		if (size > getRemainingSize(heap))
+		{
+			Logger::print("Allocation of " + compactBytes(size) + " exceeds the remaining " + compactBytes(getRemainingSize(heap)) + " of heap " + std::to_string(heap));
+			return VK_NULL_HANDLE;
+		}
 	}
+
+	const VkBuffer dedicatedBuffer = dedicatedResource != nullptr ? dedicatedResource->buffer : VK_NULL_HANDLE;
+	const VkImage dedicatedImage = dedicatedResource != nullptr ? dedicatedResource->image : VK_NULL_HANDLE;
+
+	VkDeviceMemory memory;
+	VkResult result = m_backend->allocateMemory(size, memoryType, dedicatedBuffer, dedicatedImage, &memory);
+	if (result != VK_SUCCESS)
+	{
+		// The snapshot was too optimistic, the next checks should see what the driver sees
+		refreshBudget();
+		if (evictEmptyChunks(heap) > 0)
+			result = m_backend->allocateMemory(size, memoryType, dedicatedBuffer, dedicatedImage, &memory);
+	}
+	if (result != VK_SUCCESS)
+	{
+		Logger::print("vkAllocateMemory of " + compactBytes(size) + " from memory type " + std::to_string(memoryType) + " failed: " + string_VkResult(result));
+		return VK_NULL_HANDLE;
+	}
+
+	m_sync->driverAllocations++;
+	trackHeapUsage(memoryType, size, true);
+	return memory;
 }
 
-void VulkanMemoryAllocator::hideMemoryType(const uint32_t type)
+void VulkanMemoryAllocator::trackHeapUsage(const uint32_t memoryType, const VkDeviceSize size, const bool allocated)
 {
-	Logger::print("Hiding memory type " + std::to_string(type));
-	m_hiddenTypes.insert(type);
+	const uint32_t heap = m_memoryStructure.m_memoryProperties.memoryTypes[memoryType].heapIndex;
+	std::scoped_lock lock(m_sync->budgetMutex);
+	VkDeviceSize& usage = m_sync->heapUsages[heap];
+	usage = allocated ? usage + size : usage - std::min(usage, size);
 }
 
-void VulkanMemoryAllocator::unhideMemoryType(const uint32_t type)
+MemoryChunk& VulkanMemoryAllocator::createChunk(const VkDeviceSize size, const uint32_t memoryType, const VkDeviceMemory memory, const bool dedicated, const MemoryChunk::ResourceKind resourceKind)
 {
-	Logger::print("Unhiding memory type " + std::to_string(type));
-	m_hiddenTypes.erase(type);
+	void* mappedData = nullptr;
+	if (m_memoryStructure.doesMemoryContainProperties(memoryType, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+	{
+		if (m_backend->mapMemory(memory, &mappedData) != VK_SUCCESS)
+		{
+			m_backend->freeMemory(memory);
+			trackHeapUsage(memoryType, size, false);
+			throw std::runtime_error("Failed to map host visible memory chunk");
+		}
+	}
+
+	uint32_t slot;
+	if (!m_freeChunkSlots.empty())
+	{
+		slot = m_freeChunkSlots.back();
+		m_freeChunkSlots.pop_back();
+	}
+	else
+	{
+		slot = static_cast<uint32_t>(m_chunkSlots.size());
+		m_chunkSlots.emplace_back();
+	}
+
+	ChunkSlot& chunkSlot = m_chunkSlots[slot];
+	chunkSlot.chunk = MemoryChunk(size, memoryType, memory, getAllocationStrategy(memoryType), mappedData, dedicated, resourceKind);
+	MemoryChunk& chunk = chunkSlot.chunk.value();
+	chunk.m_slot = slot;
+	chunk.m_generation = chunkSlot.generation;
+	reportChunkUsage(chunk);
+
+	Logger::print("Allocated " + std::string(dedicated ? "dedicated " : "") + "chunk of size " + compactBytes(size) + " of memory type " + std::to_string(memoryType) + " (ID: " + std::to_string(chunk.getID()) + ")");
+	return chunk;
 }
 
-const MemoryStructure& VulkanMemoryAllocator::getMemoryStructure() const
+MemoryChunk::ResourceKind VulkanMemoryAllocator::getResourceKind(const DedicatedResource& resource)
 {
-	return m_memoryStructure;
+	// Every image in the project is created with optimal tiling
+	return resource.image != VK_NULL_HANDLE ? MemoryChunk::OPTIMAL : MemoryChunk::LINEAR;
 }
 
-VkDeviceSize VulkanMemoryAllocator::getRemainingSize(const uint32_t heap) const
+bool VulkanMemoryAllocator::canHostResourceKind(const MemoryChunk& chunk, const MemoryChunk::ResourceKind resourceKind) const
+{
+	return !separatesResourceKinds() || chunk.isEmpty() || chunk.m_resourceKind == resourceKind;
+}
+
+VkDeviceSize VulkanMemoryAllocator::evictEmptyChunks(const uint32_t heap)
+{
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	VkDeviceSize releasedSize = 0;
+	for (uint32_t slot = 0; slot < m_chunkSlots.size(); slot++)
+	{
+		if (!m_chunkSlots[slot].isUsed())
+			continue;
+
+		const MemoryChunk& chunk = m_chunkSlots[slot].get();
+		if (!chunk.isEmpty() || chunk.isDedicated())
+			continue;
+		if (heap != UINT32_MAX && m_memoryStructure.m_memoryProperties.memoryTypes[chunk.m_memoryType].heapIndex != heap)
+			continue;
+
+		releasedSize += chunk.getSize();
+		freeChunk(slot);
+	}
+	return releasedSize;
+}
+
+std::vector<uint32_t> VulkanMemoryAllocator::getDefragmentationCandidates(const float maxOccupancy)
 {
-	VkDeviceSize remainingSize = m_memoryStructure.m_memoryProperties.memoryHeaps[heap].size;
-	for (const auto& chunk : m_memoryChunks)
+	// Parked blocks would keep otherwise movable chunks alive
+	flushThreadCaches();
+
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	std::vector<const MemoryChunk*> candidates;
+	for (const MemoryChunk& chunk : getChunks())
 	{
-		if (m_memoryStructure.m_memoryProperties.memoryTypes[chunk.m_memoryType].heapIndex == heap)
+		if (chunk.isDedicated() || chunk.isEmpty())
+			continue;
+		if (static_cast<double>(chunk.getUsedSize()) > static_cast<double>(chunk.getSize()) * maxOccupancy)
+			continue;
+
+		// The contents have to fit in the free space of the other chunks of the same type
+		VkDeviceSize freeElsewhere = 0;
+		for (const MemoryChunk& other : getChunks())
 		{
-			remainingSize -= chunk.getSize();
+			if (&other != &chunk && other.m_memoryType == chunk.m_memoryType && !other.isDedicated())
+				freeElsewhere += other.getRemainingSize();
 		}
+		if (freeElsewhere >= chunk.getUsedSize())
+			candidates.push_back(&chunk);
 	}
-	return remainingSize;
+
+	// Emptiest chunks first, they are the cheapest ones to release
+	std::ranges::sort(candidates, [](const MemoryChunk* a, const MemoryChunk* b) { return a->getUsedSize() < b->getUsedSize(); });
+
+	std::vector<uint32_t> ids;
+	ids.reserve(candidates.size());
+	for (const MemoryChunk* chunk : candidates)
+		ids.push_back(chunk->getID());
+	return ids;
 }
 
-bool VulkanMemoryAllocator::suitableChunkExists(const uint32_t memoryType, const VkDeviceSize size) const
+MemoryChunk::MemoryBlock VulkanMemoryAllocator::allocateInExistingChunk(const VkDeviceSize size, const VkDeviceSize alignment, const uint32_t memoryType, const std::set<uint32_t>& excludedChunks)
 {
-	for (const auto& chunk : m_memoryChunks)
+	std::scoped_lock typeLock(m_sync->typeMutexes[memoryType]);
+	std::shared_lock listLock(m_sync->chunkListMutex);
+
+	// Fill the densest chunks first so that the sparse ones end up empty
+	std::vector<MemoryChunk*> chunks;
+	for (MemoryChunk& chunk : getChunks())
 	{
-		if (chunk.m_memoryType == memoryType && chunk.getBiggestChunkSize() >= size)
+		if (!excludedChunks.contains(chunk.getID()) && chunk.m_memoryType == memoryType && !chunk.isDedicated() && !chunk.isEmpty() && canHostResourceKind(chunk, MemoryChunk::LINEAR))
+			chunks.push_back(&chunk);
+	}
+	std::ranges::sort(chunks, [](const MemoryChunk* a, const MemoryChunk* b) { return a->getRemainingSize() < b->getRemainingSize(); });
+
+	for (MemoryChunk* chunk : chunks)
+	{
+		const MemoryChunk::MemoryBlock block = chunk->allocate(size, alignment);
+		if (block.size != 0)
 		{
-			return true;
+			reportChunkUsage(*chunk);
+			m_sync->allocationCount++;
+			captureAllocation(block, alignment);
+			return block;
 		}
 	}
-	return false;
+	return {};
 }
 
-bool VulkanMemoryAllocator::isMemoryTypeHidden(const unsigned value) const
+void VulkanMemoryAllocator::releaseEmptyChunk(const uint32_t chunkID)
 {
-	return m_hiddenTypes.contains(value);
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	for (const MemoryChunk& chunk : getChunks())
+	{
+		if (chunk.getID() == chunkID && chunk.isEmpty())
+		{
+			freeChunk(chunk.m_slot);
+			return;
+		}
+	}
+}
+
+VkDeviceMemory VulkanMemoryAllocator::getMemoryHandle(const MemoryChunk::MemoryBlock& block) const
+{
+	std::shared_lock listLock(m_sync->chunkListMutex);
+	return getChunk(block).m_memory;
+}
+
+void VulkanMemoryAllocator::reportChunkUsage(const MemoryChunk& chunk, const bool removed)
+{
+	// Called with the chunk's type mutex or an exclusive list lock held, whatever the chunk added before is replaced
+	MemoryUsage current{};
+	if (!removed)
+		current = {chunk.getSize(), chunk.getUsedSize(), chunk.getBiggestChunkSize(), 1, chunk.getAllocationCount(), chunk.getFreeRangeCount(), 0.0f};
+	MemoryUsage& previous = m_chunkSlots[chunk.m_slot].reportedUsage;
+
+	TypeUsage& typeUsage = m_sync->typeUsages[chunk.m_memoryType];
+	std::scoped_lock lock(typeUsage.mutex);
+	MemoryUsage& usage = typeUsage.usage;
+	usage.reservedSize = usage.reservedSize + current.reservedSize - previous.reservedSize;
+	usage.usedSize = usage.usedSize + current.usedSize - previous.usedSize;
+	usage.chunkCount = usage.chunkCount + current.chunkCount - previous.chunkCount;
+	usage.allocationCount = usage.allocationCount + current.allocationCount - previous.allocationCount;
+	usage.freeRangeCount = usage.freeRangeCount + current.freeRangeCount - previous.freeRangeCount;
+	typeUsage.largestFreeRangeSum = typeUsage.largestFreeRangeSum + current.largestFreeRange - previous.largestFreeRange;
+	if (previous.chunkCount > 0)
+		typeUsage.largestFreeRanges.erase(typeUsage.largestFreeRanges.find(previous.largestFreeRange));
+	if (current.chunkCount > 0)
+		typeUsage.largestFreeRanges.insert(current.largestFreeRange);
+	previous = current;
+}
+
+void VulkanMemoryAllocator::addUsage(MemoryUsage& usage, const MemoryUsage& other)
+{
+	usage.reservedSize += other.reservedSize;
+	usage.usedSize += other.usedSize;
+	usage.largestFreeRange = std::max(usage.largestFreeRange, other.largestFreeRange);
+	usage.chunkCount += other.chunkCount;
+	usage.allocationCount += other.allocationCount;
+	usage.freeRangeCount += other.freeRangeCount;
+}
+
+void VulkanMemoryAllocator::computeFragmentation(MemoryUsage& usage, const VkDeviceSize largestFreeRangeSum)
+{
+	const VkDeviceSize freeSize = usage.reservedSize - usage.usedSize;
+	usage.fragmentation = freeSize == 0 ? 0.0f : 1.0f - static_cast<float>(largestFreeRangeSum) / static_cast<float>(freeSize);
+}
+
+std::string VulkanMemoryAllocator::getAllocationFailureMessage(const VkDeviceSize size, const uint32_t memoryType) const
+{
+	const uint32_t heap = m_memoryStructure.m_memoryProperties.memoryTypes[memoryType].heapIndex;
+	return "Failed to allocate " + compactBytes(size) + " from memory type " + std::to_string(memoryType) + " (heap " + std::to_string(heap) + ", "
+		+ compactBytes(getRemainingSize(heap)) + (isMemoryBudgetSupported() ? " left in the reported budget)" : " estimated left, no budget information)");
+}
+
+MemoryChunk* VulkanMemoryAllocator::findChunk(const MemoryChunk::MemoryBlock& block)
+{
+	if (block.slot >= m_chunkSlots.size() || m_chunkSlots[block.slot].generation != block.generation || !m_chunkSlots[block.slot].isUsed())
+		return nullptr;
+
+	return &m_chunkSlots[block.slot].get();
+}
+
+const MemoryChunk* VulkanMemoryAllocator::findChunk(const MemoryChunk::MemoryBlock& block) const
+{
+	if (block.slot >= m_chunkSlots.size() || m_chunkSlots[block.slot].generation != block.generation || !m_chunkSlots[block.slot].isUsed())
+		return nullptr;
+
+	return &m_chunkSlots[block.slot].getConst();
+}
+
+MemoryChunk& VulkanMemoryAllocator::getChunk(const MemoryChunk::MemoryBlock& block)
+{
+	MemoryChunk* chunk = findChunk(block);
+	if (chunk == nullptr)
+		throw std::runtime_error("Block does not belong to any chunk!");
+
+	return *chunk;
+}
+
+const MemoryChunk& VulkanMemoryAllocator::getChunk(const MemoryChunk::MemoryBlock& block) const
+{
+	const MemoryChunk* chunk = findChunk(block);
+	if (chunk == nullptr)
+		throw std::runtime_error("Block does not belong to any chunk!");
+
+	return *chunk;
+}
+
+VkDeviceSize VulkanMemoryAllocator::getNextChunkSize(const uint32_t memoryType) const
+{
+	return m_nextChunkSizes[memoryType] != 0 ? m_nextChunkSizes[memoryType] : m_chunkSize;
+}
+
+uint32_t VulkanMemoryAllocator::getEmptyChunkCount(const uint32_t memoryType) const
+{
+	uint32_t count = 0;
+	for (const MemoryChunk& chunk : getChunks())
+	{
+		if (chunk.m_memoryType == memoryType && chunk.isEmpty() && !chunk.isDedicated())
+			count++;
+	}
+	return count;
+}
+
+void VulkanMemoryAllocator::releaseExpiredChunks(const uint32_t memoryType)
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const auto isExpired = [&](const MemoryChunk& chunk)
+	{
+		return chunk.m_memoryType == memoryType && chunk.isEmpty() && now - chunk.m_emptySince >= m_chunkPolicy.retentionTimeout;
+	};
+
+	// Called with the type mutex held, the exclusive list lock is only worth taking when something expired
+	{
+		std::shared_lock listLock(m_sync->chunkListMutex);
+		if (std::ranges::none_of(getChunks(), isExpired))
+			return;
+	}
+
+	std::unique_lock listLock(m_sync->chunkListMutex);
+	for (uint32_t slot = 0; slot < m_chunkSlots.size(); slot++)
+	{
+		if (m_chunkSlots[slot].isUsed() && isExpired(m_chunkSlots[slot].get()))
+			freeChunk(slot);
+	}
+}
+
+void VulkanMemoryAllocator::freeChunk(const uint32_t slot)
+{
+	ChunkSlot& chunkSlot = m_chunkSlots[slot];
+	const MemoryChunk& chunk = chunkSlot.get();
+	if (chunk.isMapped())
+		m_backend->unmapMemory(chunk.m_memory);
+	m_backend->freeMemory(chunk.m_memory);
+	m_sync->driverFrees++;
+	trackHeapUsage(chunk.m_memoryType, chunk.m_size, false);
+	reportChunkUsage(chunk, true);
+
+	Logger::print("Freed empty chunk " + std::to_string(chunk.getID()));
+	chunkSlot.chunk.reset();
+	chunkSlot.generation++;
+	m_freeChunkSlots.push_back(slot);
+}
+
+std::optional<VkMappedMemoryRange> VulkanMemoryAllocator::getNonCoherentRange(const MemoryChunk::MemoryBlock& block, const VkDeviceSize size, const VkDeviceSize offset) const
+{
+	std::shared_lock listLock(m_sync->chunkListMutex);
+	const MemoryChunk& chunk = getChunk(block);
+	if (!chunk.isMapped())
+		throw std::runtime_error("Memory chunk " + std::to_string(block.chunk) + " is not host visible");
+
+	if (m_memoryStructure.doesMemoryContainProperties(chunk.m_memoryType, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		return std::nullopt;
+
+	// Non coherent ranges have to start and end on nonCoherentAtomSize boundaries (or at the end of the allocation)
+	const VkDeviceSize begin = block.offset + offset;
+	const VkDeviceSize end = size == VK_WHOLE_SIZE ? block.offset + block.size : begin + size;
+	const VkDeviceSize alignedBegin = begin / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+	const VkDeviceSize alignedEnd = std::min((end + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize, chunk.m_size);
+
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = chunk.m_memory;
+	range.offset = alignedBegin;
+	range.size = alignedEnd - alignedBegin;
+	return range;
 }
@@ -0,0 +1,256 @@
+#include "vulkan_memory_backend.hpp"
+
+#include <algorithm>
+
+#include "vulkan_context.hpp"
+#include "vulkan_device.hpp"
+
+VulkanMemoryBackend::VulkanMemoryBackend(const VulkanDevice& device)
+	: m_device(device.m_vkHandle), m_physicalDevice(device.getGPU().m_vkHandle), m_limits(device.getGPU().getProperties().limits)
+{
+	if (device.isExtensionEnabled(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME) && device.isExtensionEnabled(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME))
+	{
+		m_vkGetBufferMemoryRequirements2 = reinterpret_cast<PFN_vkGetBufferMemoryRequirements2KHR>(vkGetDeviceProcAddr(m_device, "vkGetBufferMemoryRequirements2KHR"));
+		m_vkGetImageMemoryRequirements2 = reinterpret_cast<PFN_vkGetImageMemoryRequirements2KHR>(vkGetDeviceProcAddr(m_device, "vkGetImageMemoryRequirements2KHR"));
+	}
+
+	if (device.isExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+	{
+		m_vkGetPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(VulkanContext::m_vkHandle, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+		if (m_vkGetPhysicalDeviceMemoryProperties2 == nullptr)
+			m_vkGetPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(VulkanContext::m_vkHandle, "vkGetPhysicalDeviceMemoryProperties2"));
+	}
+}
+
+VkPhysicalDeviceMemoryProperties VulkanMemoryBackend::getMemoryProperties() const
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memoryProperties);
+	return memoryProperties;
+}
+
+VkDeviceSize VulkanMemoryBackend::getNonCoherentAtomSize() const
+{
+	return m_limits.nonCoherentAtomSize;
+}
+
+VkDeviceSize VulkanMemoryBackend::getBufferImageGranularity() const
+{
+	return m_limits.bufferImageGranularity;
+}
+
+bool VulkanMemoryBackend::supportsDedicatedAllocation() const
+{
+	return m_vkGetBufferMemoryRequirements2 != nullptr && m_vkGetImageMemoryRequirements2 != nullptr;
+}
+
+bool VulkanMemoryBackend::prefersDedicatedAllocation(const VkBuffer buffer, const VkImage image) const
+{
+	if (!supportsDedicatedAllocation() || (buffer == VK_NULL_HANDLE && image == VK_NULL_HANDLE))
+		return false;
+
+	VkMemoryDedicatedRequirementsKHR dedicatedRequirements{};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+	VkMemoryRequirements2KHR requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+	requirements.pNext = &dedicatedRequirements;
+
+	if (buffer != VK_NULL_HANDLE)
+	{
+		VkBufferMemoryRequirementsInfo2KHR info{};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2_KHR;
+		info.buffer = buffer;
+		m_vkGetBufferMemoryRequirements2(m_device, &info, &requirements);
+	}
+	else
+	{
+		VkImageMemoryRequirementsInfo2KHR info{};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR;
+		info.image = image;
+		m_vkGetImageMemoryRequirements2(m_device, &info, &requirements);
+	}
+
+	return dedicatedRequirements.prefersDedicatedAllocation == VK_TRUE || dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE;
+}
+
+bool VulkanMemoryBackend::supportsMemoryBudget() const
+{
+	return m_vkGetPhysicalDeviceMemoryProperties2 != nullptr;
+}
+
+std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> VulkanMemoryBackend::getMemoryBudget() const
+{
+	if (!supportsMemoryBudget())
+		return std::nullopt;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2KHR memoryProperties{};
+	memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+	memoryProperties.pNext = &budgetProperties;
+	m_vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties);
+
+	budgetProperties.pNext = nullptr;
+	return budgetProperties;
+}
+
+VkResult VulkanMemoryBackend::allocateMemory(const VkDeviceSize size, const uint32_t memoryType, const VkBuffer dedicatedBuffer, const VkImage dedicatedImage, VkDeviceMemory* memory)
+{
+	VkMemoryDedicatedAllocateInfoKHR dedicatedInfo{};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR;
+	dedicatedInfo.buffer = dedicatedBuffer;
+	dedicatedInfo.image = dedicatedImage;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = dedicatedBuffer != VK_NULL_HANDLE || dedicatedImage != VK_NULL_HANDLE ? &dedicatedInfo : nullptr;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	return vkAllocateMemory(m_device, &allocInfo, nullptr, memory);
+}
+
+void VulkanMemoryBackend::freeMemory(const VkDeviceMemory memory)
+{
+	vkFreeMemory(m_device, memory, nullptr);
+}
+
+VkResult VulkanMemoryBackend::mapMemory(const VkDeviceMemory memory, void** data)
+{
+	return vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, data);
+}
+
+void VulkanMemoryBackend::unmapMemory(const VkDeviceMemory memory)
+{
+	vkUnmapMemory(m_device, memory);
+}
+
+VkResult VulkanMemoryBackend::flushMemoryRange(const VkMappedMemoryRange& range)
+{
+	return vkFlushMappedMemoryRanges(m_device, 1, &range);
+}
+
+VkResult VulkanMemoryBackend::invalidateMemoryRange(const VkMappedMemoryRange& range)
+{
+	return vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+}
+
+FakeMemoryBackend::FakeMemoryBackend(const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkDeviceSize nonCoherentAtomSize, const VkDeviceSize bufferImageGranularity)
+	: m_memoryProperties(memoryProperties), m_nonCoherentAtomSize(nonCoherentAtomSize), m_bufferImageGranularity(bufferImageGranularity)
+{
+}
+
+VkPhysicalDeviceMemoryProperties FakeMemoryBackend::makeMemoryProperties(const uint32_t typeCount, const VkDeviceSize heapSize)
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	memoryProperties.memoryHeapCount = 1;
+	memoryProperties.memoryHeaps[0] = {heapSize, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+	memoryProperties.memoryTypeCount = std::min(typeCount, static_cast<uint32_t>(VK_MAX_MEMORY_TYPES));
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+		memoryProperties.memoryTypes[i] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+	return memoryProperties;
+}
+
+VkPhysicalDeviceMemoryProperties FakeMemoryBackend::getMemoryProperties() const
+{
+	return m_memoryProperties;
+}
+
+VkDeviceSize FakeMemoryBackend::getNonCoherentAtomSize() const
+{
+	return m_nonCoherentAtomSize;
+}
+
+VkDeviceSize FakeMemoryBackend::getBufferImageGranularity() const
+{
+	return m_bufferImageGranularity;
+}
+
+bool FakeMemoryBackend::supportsDedicatedAllocation() const
+{
+	return false;
+}
+
+bool FakeMemoryBackend::prefersDedicatedAllocation(const VkBuffer buffer, const VkImage image) const
+{
+	return false;
+}
+
+bool FakeMemoryBackend::supportsMemoryBudget() const
+{
+	return false;
+}
+
+std::optional<VkPhysicalDeviceMemoryBudgetPropertiesEXT> FakeMemoryBackend::getMemoryBudget() const
+{
+	return std::nullopt;
+}
+
+VkResult FakeMemoryBackend::allocateMemory(const VkDeviceSize size, const uint32_t memoryType, const VkBuffer dedicatedBuffer, const VkImage dedicatedImage, VkDeviceMemory* memory)
+{
+	if (memoryType >= m_memoryProperties.memoryTypeCount)
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+	std::scoped_lock lock(m_mutex);
+	const uint32_t heap = m_memoryProperties.memoryTypes[memoryType].heapIndex;
+	if (m_heapUsage[heap] + size > m_memoryProperties.memoryHeaps[heap].size)
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+
+	*memory = reinterpret_cast<VkDeviceMemory>(m_nextHandle++);
+	m_allocations.emplace(*memory, Allocation{size, heap, nullptr});
+	m_heapUsage[heap] += size;
+
+	m_statistics.allocations++;
+	m_statistics.reservedSize += size;
+	m_statistics.peakReservedSize = std::max(m_statistics.peakReservedSize, m_statistics.reservedSize);
+	return VK_SUCCESS;
+}
+
+void FakeMemoryBackend::freeMemory(const VkDeviceMemory memory)
+{
+	std::scoped_lock lock(m_mutex);
+	const auto it = m_allocations.find(memory);
+	if (it == m_allocations.end())
+		return;
+
+	m_heapUsage[it->second.heap] -= it->second.size;
+	m_statistics.frees++;
+	m_statistics.reservedSize -= it->second.size;
+	m_allocations.erase(it);
+}
+
+VkResult FakeMemoryBackend::mapMemory(const VkDeviceMemory memory, void** data)
+{
+	std::scoped_lock lock(m_mutex);
+	const auto it = m_allocations.find(memory);
+	if (it == m_allocations.end())
+		return VK_ERROR_MEMORY_MAP_FAILED;
+
+	// Left uninitialized like driver memory, pages the caller never touches are never committed
+	if (it->second.hostData == nullptr)
+		it->second.hostData.reset(new std::byte[it->second.size]);
+	*data = it->second.hostData.get();
+	return VK_SUCCESS;
+}
+
+void FakeMemoryBackend::unmapMemory(const VkDeviceMemory memory)
+{
+}
+
+VkResult FakeMemoryBackend::flushMemoryRange(const VkMappedMemoryRange& range)
+{
+	return VK_SUCCESS;
+}
+
+VkResult FakeMemoryBackend::invalidateMemoryRange(const VkMappedMemoryRange& range)
+{
+	return VK_SUCCESS;
+}
+
+FakeMemoryBackend::Statistics FakeMemoryBackend::getStatistics() const
+{
+	std::scoped_lock lock(m_mutex);
+	return m_statistics;
+}
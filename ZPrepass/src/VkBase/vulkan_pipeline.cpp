@@ -1,8 +1,9 @@
 #include "vulkan_pipeline.hpp"
 
+#include <algorithm>
 #include <array>
+#include <utility>
 
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 #include "vulkan_shader.hpp"
 
@@ -145,7 +146,7 @@ void VulkanPipelineBuilder::setDynamicState(const std::vector<VkDynamicState>& d
 	m_dynamicState.pDynamicStates = m_dynamicStates.data();
 }
 
-void VulkanPipelineBuilder::addShaderStage(const uint32_t shader)
+void VulkanPipelineBuilder::addShaderStage(const Handle<VulkanShader> shader)
 {
 	m_shaderStages.push_back(shader);
 }
@@ -240,12 +241,12 @@ void VulkanPipeline::free()
 	}
 }
 
-uint32_t VulkanPipeline::getLayout() const
+Handle<VulkanPipelineLayout> VulkanPipeline::getLayout() const
 {
 	return m_layout;
 }
 
-uint32_t VulkanPipeline::getRenderPass() const
+Handle<VulkanRenderPass> VulkanPipeline::getRenderPass() const
 {
 	return m_renderPass;
 }
@@ -255,8 +256,13 @@ uint32_t VulkanPipeline::getSubpass() const
 	return m_subpass;
 }
 
-VulkanPipeline::VulkanPipeline(VulkanDevice& device, const VkPipeline handle, const uint32_t layout, const uint32_t renderPass, const uint32_t subpass)
-	: m_vkHandle(handle), m_layout(layout), m_renderPass(renderPass), m_subpass(subpass), m_device(&device)
+bool VulkanPipeline::hasDynamicState(const VkDynamicState state) const
+{
+	return std::ranges::find(m_dynamicStates, state) != m_dynamicStates.end();
+}
+
+VulkanPipeline::VulkanPipeline(VulkanDevice& device, const VkPipeline handle, const Handle<VulkanPipelineLayout> layout, const Handle<VulkanRenderPass> renderPass, const uint32_t subpass, std::vector<VkDynamicState> dynamicStates)
+	: m_vkHandle(handle), m_layout(layout), m_renderPass(renderPass), m_subpass(subpass), m_dynamicStates(std::move(dynamicStates)), m_device(&device)
 {
 }
 
@@ -264,12 +270,12 @@ void VulkanPipelineLayout::free()
 {
 	if (m_vkHandle != VK_NULL_HANDLE)
 	{
-		vkDestroyPipelineLayout(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+		vkDestroyPipelineLayout(m_device->m_vkHandle, m_vkHandle, nullptr);
 		m_vkHandle = VK_NULL_HANDLE;
 	}
 }
 
-VulkanPipelineLayout::VulkanPipelineLayout(const uint32_t device, const VkPipelineLayout handle)
-	: m_vkHandle(handle), m_device(device)
+VulkanPipelineLayout::VulkanPipelineLayout(VulkanDevice& device, const VkPipelineLayout handle)
+	: m_vkHandle(handle), m_device(&device)
 {
 }
@@ -3,7 +3,6 @@
 #include <iostream>
 
 #include "logger.hpp"
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 
 VulkanRenderPassBuilder& VulkanRenderPassBuilder::addAttachment(const VkAttachmentDescription& attachment)
@@ -77,12 +76,12 @@ VkAttachmentDescription VulkanRenderPassBuilder::createAttachment(const VkFormat
 void VulkanRenderPass::free()
 {
 	Logger::print("Freeing render pass" + std::to_string(m_id));
-	vkDestroyRenderPass(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+	vkDestroyRenderPass(m_device->m_vkHandle, m_vkHandle, nullptr);
 	m_vkHandle = VK_NULL_HANDLE;
 }
 
-VulkanRenderPass::VulkanRenderPass(const uint32_t device, const VkRenderPass renderPass)
-	: m_vkHandle(renderPass), m_device(device)
+VulkanRenderPass::VulkanRenderPass(VulkanDevice& device, const VkRenderPass renderPass)
+	: m_vkHandle(renderPass), m_device(&device)
 {
 
 }
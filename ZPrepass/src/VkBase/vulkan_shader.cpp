@@ -3,7 +3,6 @@
 #include <fstream>
 #include <stdexcept>
 
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 
 shaderc_shader_kind VulkanShader::getKindFromStage(const VkShaderStageFlagBits stage)
@@ -32,13 +31,13 @@ void VulkanShader::free()
 {
 	if (m_vkHandle != VK_NULL_HANDLE)
 	{
-		vkDestroyShaderModule(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+		vkDestroyShaderModule(m_device->m_vkHandle, m_vkHandle, nullptr);
 		m_vkHandle = VK_NULL_HANDLE;
 	}
 }
 
-VulkanShader::VulkanShader(const uint32_t device, const VkShaderModule handle, const VkShaderStageFlagBits stage)
-	:  m_vkHandle(handle), m_stage(stage), m_device(device)
+VulkanShader::VulkanShader(VulkanDevice& device, const VkShaderModule handle, const VkShaderStageFlagBits stage)
+	:  m_vkHandle(handle), m_stage(stage), m_device(&device)
 {
 }
 
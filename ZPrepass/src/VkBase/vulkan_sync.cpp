@@ -1,23 +1,25 @@
 #include "vulkan_sync.hpp"
 
-#include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
 
 void VulkanFence::reset()
 {
-	vkResetFences(VulkanContext::getDevice(m_device).m_vkHandle, 1, &m_vkHandle);
+	vkResetFences(m_device->m_vkHandle, 1, &m_vkHandle);
 	m_isSignaled = false;
+	// Resetting is only valid once the submission has completed
+	m_submission = 0;
 }
 
 void VulkanFence::wait()
 {
-	vkWaitForFences(VulkanContext::getDevice(m_device).m_vkHandle, 1, &m_vkHandle, VK_TRUE, UINT64_MAX);
+	vkWaitForFences(m_device->m_vkHandle, 1, &m_vkHandle, VK_TRUE, UINT64_MAX);
 	m_isSignaled = true;
+	m_submission = 0;
 }
 
 void VulkanFence::free()
 {
-	vkDestroyFence(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+	vkDestroyFence(m_device->m_vkHandle, m_vkHandle, nullptr);
 	m_vkHandle = VK_NULL_HANDLE;
 }
 
@@ -26,8 +28,8 @@ bool VulkanFence::isSignaled() const
 	return m_isSignaled;
 }
 
-VulkanFence::VulkanFence(const uint32_t device, const VkFence fence, const bool isSignaled)
-	: m_vkHandle(fence), m_isSignaled(isSignaled), m_device(device)
+VulkanFence::VulkanFence(VulkanDevice& device, const VkFence fence, const bool isSignaled)
+	: m_vkHandle(fence), m_isSignaled(isSignaled), m_device(&device)
 {
 }
 
@@ -35,12 +37,12 @@ void VulkanSemaphore::free()
 {
 	if (m_vkHandle != VK_NULL_HANDLE)
 	{
-		vkDestroySemaphore(VulkanContext::getDevice(m_device).m_vkHandle, m_vkHandle, nullptr);
+		vkDestroySemaphore(m_device->m_vkHandle, m_vkHandle, nullptr);
 		m_vkHandle = VK_NULL_HANDLE;
 	}
 }
 
-VulkanSemaphore::VulkanSemaphore(const uint32_t device, const VkSemaphore semaphore)
-	: m_vkHandle(semaphore), m_device(device)
+VulkanSemaphore::VulkanSemaphore(VulkanDevice& device, const VkSemaphore semaphore)
+	: m_vkHandle(semaphore), m_device(&device)
 {
 }
@@ -0,0 +1,78 @@
+#include "worker_pool.hpp"
+
+#include <stdexcept>
+
+WorkerPool::WorkerPool(const uint32_t workerCount)
+{
+	if (workerCount == 0)
+		throw std::runtime_error("Worker pool needs at least one worker");
+
+	m_workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; i++)
+		m_workers.emplace_back(&WorkerPool::workerLoop, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::scoped_lock lock(m_mutex);
+		m_stopping = true;
+	}
+	m_jobReady.notify_all();
+
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+void WorkerPool::run(const std::function<void(uint32_t)>& job)
+{
+	std::unique_lock lock(m_mutex);
+	m_job = &job;
+	m_jobCounter++;
+	m_pendingWorkers = static_cast<uint32_t>(m_workers.size());
+	m_exception = nullptr;
+	m_jobReady.notify_all();
+
+	m_jobDone.wait(lock, [this] { return m_pendingWorkers == 0; });
+	m_job = nullptr;
+
+	if (m_exception)
+		std::rethrow_exception(m_exception);
+}
+
+uint32_t WorkerPool::getWorkerCount() const
+{
+	return static_cast<uint32_t>(m_workers.size());
+}
+
+void WorkerPool::workerLoop(const uint32_t workerIndex)
+{
+	uint64_t lastJob = 0;
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		m_jobReady.wait(lock, [this, lastJob] { return m_stopping || m_jobCounter != lastJob; });
+		if (m_stopping)
+			return;
+
+		lastJob = m_jobCounter;
+		const std::function<void(uint32_t)>& job = *m_job;
+		lock.unlock();
+
+		std::exception_ptr exception;
+		try
+		{
+			job(workerIndex);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		lock.lock();
+		if (exception && !m_exception)
+			m_exception = exception;
+		if (--m_pendingWorkers == 0)
+			m_jobDone.notify_one();
+	}
+}
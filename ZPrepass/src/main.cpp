@@ -3,16 +3,23 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <array>
 #include <bit>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include "command_stream.hpp"
 #include "logger.hpp"
 #include "sdl_window.hpp"
 #include "vulkan_context.hpp"
 #include "vulkan_device.hpp"
+#include "worker_pool.hpp"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
@@ -29,6 +36,16 @@ std::vector<glm::vec3> modelColors;
 
 glm::mat4 getMVPMat(const uint32_t model) { return projMatrix * viewMatrix * modelMatrices[model]; }
 
+// Bumped on every change of the camera or the models, the object buffer of the record once path is rewritten when it differs
+uint64_t sceneVersion = 1;
+
+// Per object data of the record once path, read as instanced vertex attributes instead of push constants
+struct ObjectData
+{
+	glm::mat4 mvpMat;
+	glm::vec4 color;
+};
+
 struct Vertex
 {
 	glm::vec3 pos;
@@ -120,7 +137,7 @@ void loadModel(std::string_view filename) {
     }
 }
 
-uint32_t createRenderPass()
+Handle<VulkanRenderPass> createRenderPass()
 {
 	const VkFormat depthFormat = VulkanContext::getDevice(deviceID).getGPU().findSupportedFormat(
 		{VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL,
@@ -157,18 +174,29 @@ uint32_t createRenderPass()
 	dependency.dependencyFlags = 0;
 	builder.addDependency(dependency);
 
+	// Frames in flight share the depth image, the clear of one frame has to wait for the depth writes of the previous one
+	VkSubpassDependency depthDependency;
+	depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	depthDependency.dstSubpass = 0;
+	depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	depthDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthDependency.dependencyFlags = 0;
+	builder.addDependency(depthDependency);
+
 	return VulkanContext::getDevice(deviceID).createRenderPass(builder, 0);
 }
 
-std::tuple<uint32_t, uint32_t, uint32_t> createGraphicsPipelines(const uint32_t renderPassID)
+std::tuple<Handle<VulkanPipeline>, Handle<VulkanPipeline>, Handle<VulkanPipelineLayout>> createGraphicsPipelines(const Handle<VulkanRenderPass> renderPassID)
 {
 	VkPushConstantRange pushConstantVertex{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4)};
 	VkPushConstantRange pushConstantFragment{VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(glm::mat4), sizeof(glm::vec3)};
-	const uint32_t layout = VulkanContext::getDevice(deviceID).createPipelineLayout({}, {pushConstantVertex, pushConstantFragment});
+	const Handle<VulkanPipelineLayout> layout = VulkanContext::getDevice(deviceID).createPipelineLayout({}, {pushConstantVertex, pushConstantFragment});
 
-	const uint32_t vertexDepthShader = VulkanContext::getDevice(deviceID).createShader("shaders/depth.vert", VK_SHADER_STAGE_VERTEX_BIT);
-	const uint32_t vertexColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color.vert", VK_SHADER_STAGE_VERTEX_BIT);
-	const uint32_t fragmentColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
+	const Handle<VulkanShader> vertexDepthShader = VulkanContext::getDevice(deviceID).createShader("shaders/depth.vert", VK_SHADER_STAGE_VERTEX_BIT);
+	const Handle<VulkanShader> vertexColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color.vert", VK_SHADER_STAGE_VERTEX_BIT);
+	const Handle<VulkanShader> fragmentColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
 
 	VulkanBinding binding{0, VK_VERTEX_INPUT_RATE_VERTEX, sizeof(Vertex)};
 	binding.addAttribDescription(VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
@@ -191,43 +219,85 @@ std::tuple<uint32_t, uint32_t, uint32_t> createGraphicsPipelines(const uint32_t
 	builder.setColorBlendState(VK_FALSE, VK_LOGIC_OP_COPY, {0.0f, 0.0f, 0.0f, 0.0f});
 	builder.setDynamicState({VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
 	builder.addShaderStage(vertexDepthShader);
-	const uint32_t depthPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 0);
+	const Handle<VulkanPipeline> depthPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 0);
 
 	builder.setDepthStencilState(VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL);
 	builder.resetShaderStages();
 	builder.addShaderStage(vertexColorShader);
 	builder.addShaderStage(fragmentColorShader);
-	const uint32_t colorPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 1);
+	const Handle<VulkanPipeline> colorPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 1);
 
 	return {depthPipeline, colorPipeline, layout};
 }
 
-std::pair<uint32_t, VkImageView> createDepthImage(const VkFormat depthFormat)
+std::pair<Handle<VulkanPipeline>, Handle<VulkanPipeline>> createStaticPipelines(const Handle<VulkanRenderPass> renderPassID, const Handle<VulkanPipelineLayout> layout)
+{
+	const Handle<VulkanShader> vertexDepthShader = VulkanContext::getDevice(deviceID).createShader("shaders/depth_static.vert", VK_SHADER_STAGE_VERTEX_BIT);
+	const Handle<VulkanShader> vertexColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color_static.vert", VK_SHADER_STAGE_VERTEX_BIT);
+	const Handle<VulkanShader> fragmentColorShader = VulkanContext::getDevice(deviceID).createShader("shaders/color_static.frag", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+	VulkanBinding binding{0, VK_VERTEX_INPUT_RATE_VERTEX, sizeof(Vertex)};
+	binding.addAttribDescription(VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
+	binding.addAttribDescription(VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord));
+	binding.addAttribDescription(VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal));
+
+	// A mat4 attribute takes one location per column
+	VulkanBinding objectBinding{1, VK_VERTEX_INPUT_RATE_INSTANCE, sizeof(ObjectData)};
+	objectBinding.addAttribDescription(3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ObjectData, mvpMat));
+	objectBinding.addAttribDescription(VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ObjectData, mvpMat) + sizeof(glm::vec4));
+	objectBinding.addAttribDescription(VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ObjectData, mvpMat) + 2 * sizeof(glm::vec4));
+	objectBinding.addAttribDescription(VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(ObjectData, mvpMat) + 3 * sizeof(glm::vec4));
+	objectBinding.addAttribDescription(VK_FORMAT_R32G32B32_SFLOAT, offsetof(ObjectData, color));
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VulkanPipelineBuilder builder{&VulkanContext::getDevice(deviceID)};
+
+	builder.addVertexBinding(binding);
+	builder.addVertexBinding(objectBinding);
+	builder.setInputAssemblyState(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
+	builder.setViewportState(1, 1);
+	builder.setRasterizationState(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_CLOCKWISE);
+	builder.setMultisampleState(VK_SAMPLE_COUNT_1_BIT, VK_FALSE, 1.0f);
+	builder.setDepthStencilState(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS);
+	builder.addColorBlendAttachment(colorBlendAttachment);
+	builder.setColorBlendState(VK_FALSE, VK_LOGIC_OP_COPY, {0.0f, 0.0f, 0.0f, 0.0f});
+	builder.setDynamicState({VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR});
+	builder.addShaderStage(vertexDepthShader);
+	const Handle<VulkanPipeline> depthPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 0);
+
+	builder.setDepthStencilState(VK_TRUE, VK_FALSE, VK_COMPARE_OP_EQUAL);
+	builder.resetShaderStages();
+	builder.addShaderStage(vertexColorShader);
+	builder.addShaderStage(fragmentColorShader);
+	const Handle<VulkanPipeline> colorPipeline = VulkanContext::getDevice(deviceID).createPipeline(builder, layout, renderPassID, 1);
+
+	return {depthPipeline, colorPipeline};
+}
+
+std::pair<Handle<VulkanImage>, VkImageView> createDepthImage(const VkFormat depthFormat)
 {
 	const VkExtent2D extent = window.getSwapchainExtent();
-	uint32_t depthImage = VulkanContext::getDevice(deviceID).createImage(VK_IMAGE_TYPE_2D, depthFormat, {extent.width, extent.height, 1}, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0);
-	VulkanContext::getDevice(deviceID).getImage(depthImage).allocateFromFlags({VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false});
+	// The depth buffer never leaves the render pass, on tilers it can live in tile memory without any backing allocation
+	const Handle<VulkanImage> depthImage = VulkanContext::getDevice(deviceID).createImage(VK_IMAGE_TYPE_2D, depthFormat, {extent.width, extent.height, 1}, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, 0);
+	VulkanContext::getDevice(deviceID).getImage(depthImage).allocateFromFlags({VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT});
 	VulkanImage& depthImageObj = VulkanContext::getDevice(deviceID).getImage(depthImage);
 	VkImageView depthImageView = depthImageObj.createImageView(depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
 	return {depthImage, depthImageView};
 }
 
-uint32_t createFramebuffer(const uint32_t renderPassID, const VkImageView colorAttachment, const VkImageView depthAttachment)
+Handle<VulkanFramebuffer> createFramebuffer(const Handle<VulkanRenderPass> renderPassID, const VkImageView colorAttachment, const VkImageView depthAttachment)
 {
 	const std::vector<VkImageView> attachments{colorAttachment, depthAttachment};
 	const VkExtent2D extent = window.getSwapchainExtent();
 	return VulkanContext::getDevice(deviceID).createFramebuffer({extent.width, extent.height, 1}, VulkanContext::getDevice(deviceID).getRenderPass(renderPassID), attachments);
 }
 
-void recordCommandBuffer(const uint32_t commandbufferID, const uint32_t renderPassID, const uint32_t framebufferID, const uint32_t depthPipelineID, const uint32_t colorPipelineID, const uint32_t layoutID, const uint32_t objectBufferID)
+VkViewport getSwapchainViewport()
 {
-	Logger::pushContext("Command buffer recording");
-
-	std::vector<VkClearValue> clearValues{2};
-    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-    clearValues[1].depthStencil = {1.0f, 0};
-
 	VkViewport viewport;
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -235,47 +305,192 @@ void recordCommandBuffer(const uint32_t commandbufferID, const uint32_t renderPa
     viewport.height = static_cast<float>(window.getSwapchainExtent().height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
+	return viewport;
+}
 
+VkRect2D getSwapchainScissor()
+{
 	VkRect2D scissor;
     scissor.offset = {0, 0};
     scissor.extent = window.getSwapchainExtent();
+	return scissor;
+}
 
+// Secondary command buffers one worker records into for the current frame
+struct WorkerCommandBuffers
+{
+	Handle<VulkanCommandBuffer> depthPass;
+	Handle<VulkanCommandBuffer> colorPass;
+	// Rebuilt every frame, kept with the worker so their memory is reused
+	CommandStream depthStream;
+	CommandStream colorStream;
+};
 
-	VulkanCommandBuffer& graphicsBuffer = VulkanContext::getDevice(deviceID).getCommandBuffer(commandbufferID, 0);
-	graphicsBuffer.reset();
-	graphicsBuffer.beginRecording();
-
-	graphicsBuffer.cmdBeginRenderPass(renderPassID, framebufferID, window.getSwapchainExtent(), clearValues);
-
-		graphicsBuffer.cmdBindVertexBuffer(objectBufferID, 0);
-		graphicsBuffer.cmdBindIndexBuffer(objectBufferID, vertices.size() * sizeof(vertices[0]), VK_INDEX_TYPE_UINT32);
+// Command pools are per thread ID, the main thread records with ID 0 and every worker with its own
+uint32_t getWorkerThreadID(const uint32_t worker) { return worker + 1; }
 
-		graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipelineID);
-		graphicsBuffer.cmdSetViewport(viewport);
-		graphicsBuffer.cmdSetScissor(scissor);
+// Builds a contiguous share of the draws of one subpass, draw i of the whole list renders the model at size - 1 - i.
+// Every draw is a packet binding all it needs, the command buffer drops what is already bound when the stream is replayed
+void buildSubpassDraws(CommandStream& stream, const uint32_t subpass, const Handle<VulkanPipeline> pipelineID, const Handle<VulkanPipelineLayout> layoutID, const VulkanBufferRange& vertexRange, const VulkanBufferRange& indexRange, const uint32_t firstDraw, const uint32_t drawCount)
+{
+	const VkExtent2D extent = window.getSwapchainExtent();
+	const CommandStream::Viewport viewport{0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+	const CommandStream::Rect scissor{0, 0, extent.width, extent.height};
 
-		for (int i = static_cast<int>(modelMatrices.size()) - 1; i >= 0 ; --i)
+	stream.clear();
+	for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; ++draw)
+	{
+		const uint32_t model = static_cast<uint32_t>(modelMatrices.size()) - 1 - draw;
+		stream.beginPacket(draw);
+		stream.cmdBindPipeline(CommandStream::BindPoint::GRAPHICS, pipelineID);
+		stream.cmdBindVertexBuffer(vertexRange.buffer, vertexRange.offset);
+		stream.cmdBindIndexBuffer(indexRange.buffer, indexRange.offset, CommandStream::IndexType::UINT32);
+		stream.cmdSetViewport(viewport);
+		stream.cmdSetScissor(scissor);
+
+		const glm::mat4 mvpMat = getMVPMat(model);
+		stream.cmdPushConstant(layoutID, CommandStream::VERTEX_STAGE, 0, sizeof(glm::mat4), &mvpMat);
+		if (subpass == 1)
 		{
-			const glm::mat4 mvpMat = getMVPMat(i);
-			graphicsBuffer.cmdPushConstant(layoutID, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &mvpMat);
-			graphicsBuffer.cmdDrawIndexed(static_cast<uint32_t>(indices.size()), 0, 0);
+			const glm::vec3 modelColor = modelColors[model];
+			stream.cmdPushConstant(layoutID, CommandStream::FRAGMENT_STAGE, sizeof(glm::mat4), sizeof(glm::vec3), &modelColor);
 		}
+		stream.cmdDrawIndexed(static_cast<uint32_t>(indices.size()), 0, 0);
+	}
+}
 
-		graphicsBuffer.cmdNextSubpass();
+void recordSubpassDraws(VulkanCommandBuffer& commandBuffer, const CommandStream& stream, const Handle<VulkanRenderPass> renderPassID, const uint32_t subpass, const Handle<VulkanFramebuffer> framebufferID)
+{
+	// Secondary command buffers inherit no state from the primary one, the first packet binds everything again
+	commandBuffer.setStateTracking(true);
+	commandBuffer.beginRecording(renderPassID, subpass, framebufferID, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	commandBuffer.cmdReplay(stream);
+	commandBuffer.endRecording();
+}
 
-		graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, colorPipelineID);
-		graphicsBuffer.cmdSetViewport(viewport);
-		graphicsBuffer.cmdSetScissor(scissor);
+// Everything a command buffer of the record once path captures, it is recorded again as soon as one of them differs
+struct StaticRecordingKey
+{
+	Handle<VulkanFramebuffer> framebuffer;
+	Handle<VulkanPipeline> depthPipeline;
+	Handle<VulkanPipeline> colorPipeline;
+	Handle<VulkanBuffer> objectBuffer;
+	uint32_t objectCount = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Memory compaction replaces the VkBuffer of a moved buffer, the recorded one would be destroyed
+	uint32_t objectBufferVersion = 0;
+	uint32_t vertexBufferVersion = 0;
+	uint32_t indexBufferVersion = 0;
+
+	bool operator==(const StaticRecordingKey&) const = default;
+};
 
-		for (int i = static_cast<int>(modelMatrices.size()) - 1; i >= 0 ; --i)
-		{
-			const glm::mat4 mvpMat = getMVPMat(i);
-			const glm::vec3 modelColor = modelColors[i];
-			graphicsBuffer.cmdPushConstant(layoutID, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &mvpMat);
-			graphicsBuffer.cmdPushConstant(layoutID, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(glm::mat4), sizeof(glm::vec3), &modelColor);
-			graphicsBuffer.cmdDrawIndexed(static_cast<uint32_t>(indices.size()), 0, 0);
-		}
+struct StaticCommandBuffer
+{
+	Handle<VulkanCommandBuffer> commandBuffer;
+	std::optional<StaticRecordingKey> recordedWith;
+};
+
+// Writes the object data in draw order, the last model is drawn first like in the per frame path
+void uploadObjectData(const Handle<VulkanBuffer> objectBuffer)
+{
+	VulkanDevice& device = VulkanContext::getDevice(deviceID);
+	const VkDeviceSize size = sizeof(ObjectData) * modelMatrices.size();
+	auto* objectData = static_cast<ObjectData*>(device.mapStagingBuffer(size, 0));
+	for (uint32_t draw = 0; draw < modelMatrices.size(); ++draw)
+	{
+		const uint32_t model = static_cast<uint32_t>(modelMatrices.size()) - 1 - draw;
+		objectData[draw] = {getMVPMat(model), glm::vec4(modelColors[model], 1.0f)};
+	}
+	device.dumpStagingBuffer(objectBuffer, size, 0, 0);
+}
+
+void recordStaticCommandBuffer(VulkanCommandBuffer& commandBuffer, const StaticRecordingKey& key, const Handle<VulkanRenderPass> renderPassID, const VulkanBufferRange& vertexRange, const VulkanBufferRange& indexRange)
+{
+	Logger::pushContext("Static command buffer recording");
+
+	std::vector<VkClearValue> clearValues{2};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+	commandBuffer.reset();
+	commandBuffer.setStateTracking(true);
+	commandBuffer.beginRecording();
+
+	commandBuffer.cmdBeginRenderPass(renderPassID, key.framebuffer, {key.width, key.height}, clearValues);
+
+		commandBuffer.cmdBindVertexBuffers({vertexRange.buffer, key.objectBuffer}, {vertexRange.offset, 0});
+		commandBuffer.cmdBindIndexBuffer(indexRange, VK_INDEX_TYPE_UINT32);
+
+		// One instance per object, the instance index selects its entry of the object buffer
+		commandBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, key.depthPipeline);
+		commandBuffer.cmdSetViewport(getSwapchainViewport());
+		commandBuffer.cmdSetScissor(getSwapchainScissor());
+		commandBuffer.cmdDrawIndexedInstanced(static_cast<uint32_t>(indices.size()), key.objectCount, 0, 0, 0);
+
+		commandBuffer.cmdNextSubpass();
+
+		commandBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, key.colorPipeline);
+		commandBuffer.cmdSetViewport(getSwapchainViewport());
+		commandBuffer.cmdSetScissor(getSwapchainScissor());
+		commandBuffer.cmdDrawIndexedInstanced(static_cast<uint32_t>(indices.size()), key.objectCount, 0, 0, 0);
+
+	commandBuffer.cmdEndRenderPass();
+	commandBuffer.endRecording();
+
+	const VulkanCommandBuffer::StateStatistics stats = commandBuffer.getStateStatistics();
+	Logger::print("Elided redundant state changes so far: " + std::to_string(stats.elidedPipelineBinds) + " pipeline(s), " + std::to_string(stats.elidedVertexBufferBinds + stats.elidedIndexBufferBinds) + " buffer bind(s), "
+		+ std::to_string(stats.elidedViewports + stats.elidedScissors) + " viewport/scissor(s), " + std::to_string(stats.elidedPushConstants) + " push constant(s)");
+
+	Logger::popContext();
+}
+
+void recordCommandBuffer(WorkerPool& workers, const QueueFamily& family, const uint32_t frameIndex, const Handle<VulkanCommandBuffer> commandbufferID, std::vector<WorkerCommandBuffers>& workerBuffers, const Handle<VulkanRenderPass> renderPassID, const Handle<VulkanFramebuffer> framebufferID, const Handle<VulkanPipeline> depthPipelineID, const Handle<VulkanPipeline> colorPipelineID, const Handle<VulkanPipelineLayout> layoutID, const VulkanBufferRange& vertexRange, const VulkanBufferRange& indexRange)
+{
+	Logger::pushContext("Command buffer recording");
+
+	// Both subpasses draw the same list, every worker records the same share of it for each of them
+	const uint32_t drawCount = static_cast<uint32_t>(modelMatrices.size());
+	const uint32_t workerCount = workers.getWorkerCount();
+	workers.run([&](const uint32_t worker)
+	{
+		VulkanDevice& device = VulkanContext::getDevice(deviceID);
+		const uint32_t threadID = getWorkerThreadID(worker);
+		const uint32_t firstDraw = drawCount * worker / workerCount;
+		const uint32_t lastDraw = drawCount * (worker + 1) / workerCount;
+
+		// The frame was waited on before recording started, every worker recycles the buffers of its own pool
+		device.resetFrameCommandPools(threadID, frameIndex);
+		WorkerCommandBuffers& buffers = workerBuffers[worker];
+		buffers.depthPass = device.getOrCreateCommandBuffer(family, threadID, frameIndex, true);
+		buffers.colorPass = device.getOrCreateCommandBuffer(family, threadID, frameIndex, true);
+
+		buildSubpassDraws(buffers.depthStream, 0, depthPipelineID, layoutID, vertexRange, indexRange, firstDraw, lastDraw - firstDraw);
+		buildSubpassDraws(buffers.colorStream, 1, colorPipelineID, layoutID, vertexRange, indexRange, firstDraw, lastDraw - firstDraw);
+		recordSubpassDraws(device.getCommandBuffer(buffers.depthPass, threadID), buffers.depthStream, renderPassID, 0, framebufferID);
+		recordSubpassDraws(device.getCommandBuffer(buffers.colorPass, threadID), buffers.colorStream, renderPassID, 1, framebufferID);
+	});
+
+	std::vector<std::pair<Handle<VulkanCommandBuffer>, uint32_t>> depthPassBuffers;
+	std::vector<std::pair<Handle<VulkanCommandBuffer>, uint32_t>> colorPassBuffers;
+	for (uint32_t worker = 0; worker < workerCount; ++worker)
+	{
+		depthPassBuffers.emplace_back(workerBuffers[worker].depthPass, getWorkerThreadID(worker));
+		colorPassBuffers.emplace_back(workerBuffers[worker].colorPass, getWorkerThreadID(worker));
+	}
+
+	std::vector<VkClearValue> clearValues{2};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+	VulkanCommandBuffer& graphicsBuffer = VulkanContext::getDevice(deviceID).getCommandBuffer(commandbufferID, 0);
+	graphicsBuffer.beginRecording(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
+	graphicsBuffer.cmdBeginRenderPass(renderPassID, framebufferID, window.getSwapchainExtent(), clearValues, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		graphicsBuffer.cmdExecuteCommands(depthPassBuffers);
+		graphicsBuffer.cmdNextSubpass(VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		graphicsBuffer.cmdExecuteCommands(colorPassBuffers);
 	graphicsBuffer.cmdEndRenderPass();
 	graphicsBuffer.endRecording();
 
@@ -284,15 +499,32 @@ void recordCommandBuffer(const uint32_t commandbufferID, const uint32_t renderPa
 
 int main(int argc, char* argv[])
 {
+	// Static scenes are recorded once per swapchain image, --record-every-frame brings back recording every frame.
+	// --capture-allocations <file> writes an allocation trace for the allocator benchmarks
+	bool recordOnce = true;
+	std::string allocationTraceFile;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string_view argument = argv[i];
+		if (argument == "--record-every-frame")
+			recordOnce = false;
+		else if (argument == "--capture-allocations" && i + 1 < argc)
+			allocationTraceFile = argv[++i];
+	}
+
 	try {
 		Logger::setRootContext("Initialization");
 
 		// Create window and Vulkan context
 		window = SDLWindow{"Test", 1920, 1080};
+		std::vector<const char*> instanceExtensions = window.getRequiredVulkanExtensions();
+		const bool properties2Supported = VulkanContext::isInstanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		if (properties2Supported)
+			instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 #ifdef _DEBUG
-		VulkanContext::init(VK_API_VERSION_1_0, true, window.getRequiredVulkanExtensions());
+		VulkanContext::init(VK_API_VERSION_1_0, true, instanceExtensions);
 #else
-		VulkanContext::init(VK_API_VERSION_1_0, false, window.getRequiredVulkanExtensions());
+		VulkanContext::init(VK_API_VERSION_1_0, false, instanceExtensions);
 #endif
 		window.createSurface();
 
@@ -318,8 +550,20 @@ int main(int argc, char* argv[])
 		const QueueSelection transferQueuePos = selector.addQueue(transferQueueFamily, 1.0);
 
 		// Create device and memory allocation system
-		deviceID = VulkanContext::createDevice(selectedGPU, selector, {VK_KHR_SWAPCHAIN_EXTENSION_NAME}, {});
+		// Memory extensions are optional, the allocator falls back to plain chunks and estimated budgets without them
+		std::vector<const char*> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+		if (selectedGPU.isExtensionSupported(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME) && selectedGPU.isExtensionSupported(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME))
+		{
+			deviceExtensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+			deviceExtensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+		}
+		if (properties2Supported && selectedGPU.isExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+			deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		deviceID = VulkanContext::createDevice(selectedGPU, selector, deviceExtensions, {});
 		VulkanDevice& device = VulkanContext::getDevice(deviceID);
+		if (!allocationTraceFile.empty())
+			device.startAllocationCapture(allocationTraceFile);
 
 		std::cout << "\n*************************************************************************\n"
 		          <<   "*************************** Memory Properties ***************************\n"
@@ -333,24 +577,40 @@ int main(int argc, char* argv[])
 		window.createSwapchain(deviceID, {VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR});
 
 		device.configureOneTimeQueue(transferQueuePos);
-		uint32_t graphicsBufferID = device.createCommandBuffer(graphicsQueueFamily, 0, false);
+		// Every frame in flight gets its own command buffer, semaphores and fence
+		const Handle<VulkanFrameRing> frameRingID = device.createFrameRing(graphicsQueueFamily, 0, 2);
+		VulkanFrameRing& frameRing = device.getFrameRing(frameRingID);
+
+		// Draws are recorded in parallel, every worker records a secondary buffer per subpass from its own frame pools
+		WorkerPool workers{std::max(1U, std::thread::hardware_concurrency() / 2)};
+		std::vector<WorkerCommandBuffers> workerCommandBuffers{workers.getWorkerCount()};
 
-		uint32_t renderPassID = createRenderPass();
+		const Handle<VulkanRenderPass> renderPassID = createRenderPass();
 		const auto [depthPipeline, colorPipeline, pipelineLayout] = createGraphicsPipelines(renderPassID);
+		const auto [depthStaticPipeline, colorStaticPipeline] = createStaticPipelines(renderPassID, pipelineLayout);
 
 		// Configure buffers
 		device.configureStagingBuffer(5LL * 1024 * 1024, transferQueuePos);
 
 		loadModel("models/stanfordDragon.obj");
-		uint32_t objectBufferID = device.createBuffer(sizeof(vertices[0]) * vertices.size() + sizeof(indices[0]) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-		VulkanBuffer& objectBuffer = device.getBuffer(objectBufferID);
-		objectBuffer.allocateFromFlags({VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false});
+		const Handle<VulkanBufferSuballocator> geometryAllocatorID = device.createBufferSuballocator(64LL * 1024 * 1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false});
+		VulkanBufferSuballocator& geometryAllocator = device.getBufferSuballocator(geometryAllocatorID);
+		const VulkanBufferRange vertexRange = geometryAllocator.allocate(sizeof(vertices[0]) * vertices.size(), sizeof(vertices[0]));
+		const VulkanBufferRange indexRange = geometryAllocator.allocate(sizeof(indices[0]) * indices.size(), sizeof(indices[0]));
 
 		{
-			void* dataPtr = device.mapStagingBuffer(objectBuffer.getSize(), 0);
-			memcpy(dataPtr, vertices.data(), sizeof(vertices[0]) * vertices.size());
-			memcpy(static_cast<char*>(dataPtr) + sizeof(vertices[0]) * vertices.size(), indices.data(), sizeof(indices[0]) * indices.size());
-			device.dumpStagingBuffer(objectBufferID, objectBuffer.getSize(), 0, 0);
+			void* dataPtr = device.mapStagingBuffer(vertexRange.size + indexRange.size, 0);
+			memcpy(dataPtr, vertices.data(), vertexRange.size);
+			memcpy(static_cast<char*>(dataPtr) + vertexRange.size, indices.data(), indexRange.size);
+			if (vertexRange.buffer == indexRange.buffer)
+			{
+				device.dumpStagingBuffer(vertexRange.buffer, {{0, vertexRange.offset, vertexRange.size}, {vertexRange.size, indexRange.offset, indexRange.size}}, 0);
+			}
+			else
+			{
+				device.dumpStagingBuffer(vertexRange.buffer, {{0, vertexRange.offset, vertexRange.size}}, 0);
+				device.dumpStagingBuffer(indexRange.buffer, {{vertexRange.size, indexRange.offset, indexRange.size}}, 0);
+			}
 		}
 
 		// Configure depth buffer
@@ -358,20 +618,13 @@ int main(int argc, char* argv[])
 		auto [depthImage, depthImageView] = createDepthImage(depthFormat);
 
 		// Create frame buffers
-		std::vector<uint32_t> framebuffers{};
+		std::vector<Handle<VulkanFramebuffer>> framebuffers{};
 		framebuffers.resize(window.getImageCount());
 		for (uint32_t i = 0; i < window.getImageCount(); i++)
 			framebuffers[i] = createFramebuffer(renderPassID, window.getImageView(i), depthImageView);
 
-		// Create sync objects
-		uint32_t imageAvailableSemaphoreID = device.createSemaphore();
-		uint32_t renderFinishedSemaphoreID = device.createSemaphore();
-		uint32_t inFlightFenceID = device.createFence(true);
-		VulkanFence& inFlightFence = device.getFence(inFlightFenceID);
-
 		VulkanQueue graphicsQueue = device.getQueue(graphicsQueuePos);
 		VulkanQueue presentQueue = device.getQueue(presentQueuePos);
-		VulkanCommandBuffer& graphicsBuffer = device.getCommandBuffer(graphicsBufferID, 0);
 
 		// Configure push constant data
 		{
@@ -394,9 +647,21 @@ int main(int argc, char* argv[])
 				modelColors.emplace_back(value, 1.0f - value, 1.0f);
 			}
 
+			sceneVersion++;
 			Logger::popContext();
 		}
 
+		// Object data of the record once path, it lives as long as the object count doesn't change
+		Handle<VulkanBuffer> objectBuffer{};
+		uint32_t objectBufferCapacity = 0;
+		uint64_t uploadedSceneVersion = 0;
+		std::vector<StaticCommandBuffer> staticCommandBuffers;
+
+		// Sparsely used chunks are compacted every few hundred frames, a few megabytes at a time. Device local buffers are
+		// created with TRANSFER_SRC so that compaction can copy them
+		constexpr uint64_t compactionInterval = 300;
+		constexpr VkDeviceSize compactionBudget = 8LL * 1024 * 1024;
+
 		// Main loop
 		uint64_t frameCounter = 0;
 		Logger::setRootContext("Frame" + std::to_string(frameCounter));
@@ -404,7 +669,8 @@ int main(int argc, char* argv[])
 		{
 			window.pollEvents();
 
-			inFlightFence.wait();
+			const VulkanFrameRing::FrameContext& frame = frameRing.beginFrame();
+			device.releaseDeferredResources();
 
 			if (window.getAndResetSwapchainRebuildFlag())
 			{
@@ -420,24 +686,64 @@ int main(int argc, char* argv[])
 
 				float aspectRatio = static_cast<float>(window.getSwapchainExtent().width) / static_cast<float>(window.getSwapchainExtent().height);
 				projMatrix = glm::perspective(glm::radians(70.0f), aspectRatio, 0.1f, 500.0f);
+				sceneVersion++;
 
 				Logger::popContext();
 			}
 
-			uint32_t nextImage = window.acquireNextImage(imageAvailableSemaphoreID, nullptr);
+			uint32_t nextImage = window.acquireNextImage(frame.imageAvailableSemaphore, nullptr);
 			if (nextImage == UINT32_MAX)
 			{
-				inFlightFence.reset();
 				frameCounter++;
 				continue;
 			}
+			frameRing.waitForImage(nextImage);
 
-			inFlightFence.reset();
+			if (recordOnce)
+			{
+				const uint32_t objectCount = static_cast<uint32_t>(modelMatrices.size());
+				if (uploadedSceneVersion != sceneVersion)
+				{
+					// Scene edits are rare, waiting for the frames that read the old data is cheaper than versioning the buffer
+					device.waitIdle();
+					if (objectCount > objectBufferCapacity)
+					{
+						if (!objectBuffer.isNull())
+							device.freeBuffer(objectBuffer);
+						objectBuffer = device.createBuffer(sizeof(ObjectData) * objectCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+						device.getBuffer(objectBuffer).allocateFromFlags({VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false});
+						objectBufferCapacity = objectCount;
+					}
+					uploadObjectData(objectBuffer);
+					uploadedSceneVersion = sceneVersion;
+				}
 
-			recordCommandBuffer(graphicsBufferID, renderPassID, framebuffers[nextImage], depthPipeline, colorPipeline, pipelineLayout, objectBufferID);
+				if (staticCommandBuffers.size() < window.getImageCount())
+					staticCommandBuffers.resize(window.getImageCount());
+
+				// The image was just waited for, the buffer recorded for it is not pending anymore
+				StaticCommandBuffer& staticBuffer = staticCommandBuffers[nextImage];
+				const StaticRecordingKey key{framebuffers[nextImage], depthStaticPipeline, colorStaticPipeline, objectBuffer, objectCount, window.getSwapchainExtent().width, window.getSwapchainExtent().height,
+					device.getBuffer(objectBuffer).getVersion(), device.getBuffer(vertexRange.buffer).getVersion(), device.getBuffer(indexRange.buffer).getVersion()};
+				if (staticBuffer.commandBuffer.isNull())
+					staticBuffer.commandBuffer = device.createRecordOnceCommandBuffer(graphicsQueueFamily, 0);
+				if (staticBuffer.recordedWith != key)
+				{
+					recordStaticCommandBuffer(device.getCommandBuffer(staticBuffer.commandBuffer, 0), key, renderPassID, vertexRange, indexRange);
+					staticBuffer.recordedWith = key;
+				}
+
+				frameRing.submit(graphicsQueue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, staticBuffer.commandBuffer);
+			}
+			else
+			{
+				recordCommandBuffer(workers, graphicsQueueFamily, frameRing.getFrameIndex(), frame.commandBuffer, workerCommandBuffers, renderPassID, framebuffers[nextImage], depthPipeline, colorPipeline, pipelineLayout, vertexRange, indexRange);
+				frameRing.submit(graphicsQueue, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			}
+			window.present(presentQueue, nextImage, frame.renderFinishedSemaphore);
 
-			graphicsBuffer.submit(graphicsQueue, {{imageAvailableSemaphoreID, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT}}, {renderFinishedSemaphoreID}, inFlightFenceID);
-			window.present(presentQueue, nextImage, renderFinishedSemaphoreID);
+			if (frameCounter % compactionInterval == compactionInterval - 1)
+				device.defragmentMemory(compactionBudget, 0);
 
 			frameCounter++;
 		}
@@ -0,0 +1,240 @@
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "command_stream.hpp"
+
+// Encodes command streams and checks that forEachCommand gives back exactly what was recorded, in packet order after
+// sort() and merge(). Needs neither a device nor the Vulkan SDK
+
+static void check(const bool condition, const std::string& message)
+{
+	if (!condition)
+		throw std::runtime_error(message);
+}
+
+static void checkThrows(const std::function<void()>& function, const std::string& message)
+{
+	try
+	{
+		function();
+	}
+	catch (const std::runtime_error&)
+	{
+		return;
+	}
+	throw std::runtime_error(message);
+}
+
+// Flattens every visited command into a line of text, so whole streams can be compared at once
+struct CommandPrinter
+{
+	std::vector<std::string>& lines;
+
+	void operator()(const CommandStream::BindPipeline& command) const
+	{
+		lines.push_back("pipeline " + std::to_string(static_cast<int>(command.bindPoint)) + " " + std::to_string(command.pipeline.getID()));
+	}
+
+	void operator()(const CommandStream::BindVertexBuffers& command) const
+	{
+		std::string line = "vertex";
+		for (uint32_t i = 0; i < command.count; i++)
+			line += " " + std::to_string(command.buffers[i].getID()) + "@" + std::to_string(command.offsets[i]);
+		lines.push_back(line);
+	}
+
+	void operator()(const CommandStream::BindIndexBuffer& command) const
+	{
+		lines.push_back("index " + std::to_string(command.buffer.getID()) + "@" + std::to_string(command.offset) + " " + std::to_string(static_cast<int>(command.indexType)));
+	}
+
+	void operator()(const CommandStream::SetViewport& command) const
+	{
+		const CommandStream::Viewport& viewport = command.viewport;
+		lines.push_back("viewport " + std::to_string(viewport.x) + " " + std::to_string(viewport.y) + " " + std::to_string(viewport.width) + " " + std::to_string(viewport.height)
+			+ " " + std::to_string(viewport.minDepth) + " " + std::to_string(viewport.maxDepth));
+	}
+
+	void operator()(const CommandStream::SetScissor& command) const
+	{
+		const CommandStream::Rect& scissor = command.scissor;
+		lines.push_back("scissor " + std::to_string(scissor.x) + " " + std::to_string(scissor.y) + " " + std::to_string(scissor.width) + " " + std::to_string(scissor.height));
+	}
+
+	void operator()(const CommandStream::PushConstant& command, const void* pValues) const
+	{
+		std::string line = "push " + std::to_string(command.layout.getID()) + " " + std::to_string(command.stageFlags) + " " + std::to_string(command.offset) + " " + std::to_string(command.size);
+		const auto* bytes = static_cast<const unsigned char*>(pValues);
+		for (uint32_t i = 0; i < command.size; i++)
+			line += " " + std::to_string(bytes[i]);
+		lines.push_back(line);
+	}
+
+	void operator()(const CommandStream::Draw& command) const
+	{
+		lines.push_back("draw " + std::to_string(command.vertexCount) + " " + std::to_string(command.firstVertex));
+	}
+
+	void operator()(const CommandStream::DrawIndexed& command) const
+	{
+		lines.push_back("drawIndexed " + std::to_string(command.indexCount) + " " + std::to_string(command.instanceCount) + " " + std::to_string(command.firstIndex)
+			+ " " + std::to_string(command.vertexOffset) + " " + std::to_string(command.firstInstance));
+	}
+};
+
+static std::vector<std::string> print(const CommandStream& stream)
+{
+	std::vector<std::string> lines;
+	stream.forEachCommand(CommandPrinter{lines});
+	return lines;
+}
+
+// One packet per draw, each binding everything like the draws of the application do
+static void recordDraw(CommandStream& stream, const uint64_t sortKey, const uint32_t draw)
+{
+	stream.beginPacket(sortKey);
+	stream.cmdBindPipeline(CommandStream::BindPoint::GRAPHICS, Handle<VulkanPipeline>(draw));
+	stream.cmdDraw(3, draw);
+}
+
+static void testEncodeRoundTrip()
+{
+	CommandStream stream;
+	check(stream.isEmpty() && stream.getPacketCount() == 0, "New stream is not empty");
+
+	const unsigned char values[] = {1, 2, 3, 4, 5, 6, 7};
+	stream.beginPacket(0);
+	stream.cmdBindPipeline(CommandStream::BindPoint::COMPUTE, Handle<VulkanPipeline>(7));
+	stream.cmdBindVertexBuffer(Handle<VulkanBuffer>(3), 1ULL << 40);
+	stream.cmdBindVertexBuffers({Handle<VulkanBuffer>(1), Handle<VulkanBuffer>(2)}, {16, 32});
+	stream.cmdBindIndexBuffer(Handle<VulkanBuffer>(4), 64, CommandStream::IndexType::UINT16);
+	stream.cmdSetViewport({1.5f, 2.0f, 1920.0f, 1080.0f, 0.0f, 1.0f});
+	stream.cmdSetScissor({-4, 8, 640, 480});
+	stream.cmdPushConstant(Handle<VulkanPipelineLayout>(9), CommandStream::VERTEX_STAGE | CommandStream::FRAGMENT_STAGE, 12, sizeof(values), values);
+	stream.cmdPushConstant(Handle<VulkanPipelineLayout>(9), CommandStream::COMPUTE_STAGE, 0, 0, nullptr);
+	stream.cmdDraw(36, 6);
+	stream.cmdDrawIndexed(300, 10, -5);
+	stream.cmdDrawIndexedInstanced(30, 4, 1, 2, 3);
+
+	const std::vector<std::string> expected = {
+		"pipeline 1 7",
+		"vertex 3@1099511627776",
+		"vertex 1@16 2@32",
+		"index 4@64 0",
+		"viewport 1.500000 2.000000 1920.000000 1080.000000 0.000000 1.000000",
+		"scissor -4 8 640 480",
+		"push 9 17 12 7 1 2 3 4 5 6 7",
+		"push 9 32 0 0",
+		"draw 36 6",
+		"drawIndexed 300 1 10 -5 0",
+		"drawIndexed 30 4 1 2 3"
+	};
+	check(print(stream) == expected, "Decoded commands differ from the recorded ones");
+	check(stream.getPacketCount() == 1 && stream.getCommandCount() == expected.size(), "Wrong packet or command count");
+	check(!stream.isEmpty() && stream.getByteSize() > 0, "Recorded stream is empty");
+}
+
+static void testSort()
+{
+	CommandStream stream;
+	recordDraw(stream, 3, 0);
+	recordDraw(stream, 1, 1);
+	recordDraw(stream, 2, 2);
+	recordDraw(stream, 1, 3);
+	stream.sort();
+
+	// Packets with the same key keep their recording order
+	const std::vector<std::string> expected = {"pipeline 0 1", "draw 3 1", "pipeline 0 3", "draw 3 3", "pipeline 0 2", "draw 3 2", "pipeline 0 0", "draw 3 0"};
+	check(print(stream) == expected, "Sorted packets are out of order");
+	check(stream.getPacketCount() == 4 && stream.getCommandCount() == 8, "Sorting changed the packet or command count");
+
+	checkThrows([&] { stream.cmdDraw(3, 0); }, "Recording after sort without a new packet did not throw");
+	recordDraw(stream, 0, 4);
+	check(print(stream).size() == 10 && print(stream)[8] == "pipeline 0 4", "Packet begun after sort was not appended");
+}
+
+static void testMerge()
+{
+	// Two workers building their share of the draws, merged and sorted into one list
+	CommandStream first;
+	recordDraw(first, 0, 0);
+	recordDraw(first, 2, 2);
+
+	CommandStream second;
+	recordDraw(second, 1, 1);
+	const unsigned char value = 42;
+	second.cmdPushConstant(Handle<VulkanPipelineLayout>(1), CommandStream::VERTEX_STAGE, 0, 1, &value);
+	recordDraw(second, 3, 3);
+
+	const size_t byteSize = first.getByteSize() + second.getByteSize();
+	first.merge(second);
+	check(first.getPacketCount() == 4 && first.getCommandCount() == 9 && first.getByteSize() == byteSize, "Merged stream has the wrong size");
+	check(second.getPacketCount() == 2 && print(second).size() == 5, "Merging changed the source stream");
+	checkThrows([&] { first.cmdDraw(3, 0); }, "Recording after merge without a new packet did not throw");
+
+	std::vector<std::string> expected = {"pipeline 0 0", "draw 3 0", "pipeline 0 2", "draw 3 2", "pipeline 0 1", "draw 3 1", "push 1 1 0 1 42", "pipeline 0 3", "draw 3 3"};
+	check(print(first) == expected, "Merged packets are out of order");
+
+	first.sort();
+	expected = {"pipeline 0 0", "draw 3 0", "pipeline 0 1", "draw 3 1", "push 1 1 0 1 42", "pipeline 0 2", "draw 3 2", "pipeline 0 3", "draw 3 3"};
+	check(print(first) == expected, "Merged and sorted packets are out of order");
+}
+
+static void testClearAndErrors()
+{
+	CommandStream stream;
+	checkThrows([&] { stream.cmdDraw(3, 0); }, "Recording without a packet did not throw");
+
+	stream.beginPacket(0);
+	checkThrows([&] { stream.cmdBindVertexBuffers({Handle<VulkanBuffer>(1)}, {}); }, "Vertex buffers without offsets did not throw");
+	const std::vector<Handle<VulkanBuffer>> tooManyBuffers(CommandStream::MAX_VERTEX_BUFFERS + 1);
+	checkThrows([&] { stream.cmdBindVertexBuffers(tooManyBuffers, std::vector<uint64_t>(tooManyBuffers.size())); }, "Too many vertex buffers did not throw");
+
+	std::vector<Handle<VulkanBuffer>> buffers;
+	std::vector<uint64_t> offsets;
+	for (uint32_t i = 0; i < CommandStream::MAX_VERTEX_BUFFERS; i++)
+	{
+		buffers.emplace_back(i);
+		offsets.push_back(i * 4);
+	}
+	stream.cmdBindVertexBuffers(buffers, offsets);
+	check(print(stream).size() == 1 && print(stream)[0].starts_with("vertex 0@0 1@4"), "Widest vertex buffer bind did not round trip");
+
+	stream.clear();
+	check(stream.isEmpty() && stream.getPacketCount() == 0 && stream.getByteSize() == 0 && print(stream).empty(), "Cleared stream is not empty");
+	checkThrows([&] { stream.cmdDraw(3, 0); }, "Recording after clear without a packet did not throw");
+
+	recordDraw(stream, 5, 5);
+	check((print(stream) == std::vector<std::string>{"pipeline 0 5", "draw 3 5"}), "Reused stream decodes wrong commands");
+}
+
+int main()
+{
+	const std::vector<std::pair<const char*, void(*)()>> tests = {
+		{"encode round trip", testEncodeRoundTrip},
+		{"sort", testSort},
+		{"merge", testMerge},
+		{"clear and errors", testClearAndErrors}
+	};
+
+	int failures = 0;
+	for (const auto& [name, test] : tests)
+	{
+		try
+		{
+			test();
+			std::cout << "[PASS] " << name << '\n';
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "[FAIL] " << name << ": " << e.what() << '\n';
+			failures++;
+		}
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}